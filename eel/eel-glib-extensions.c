@@ -32,6 +32,7 @@
 #include <glib-object.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 gboolean
 eel_g_strv_equal (char **a, char **b)
@@ -134,6 +135,268 @@ eel_g_hash_table_safe_for_each (GHashTable *hash_table,
 	g_list_free (flattened.values);
 }
 
+#define PARALLEL_SORT_MAX_RUNS 16
+
+typedef struct {
+	GCompareDataFunc compare_func;
+	gpointer user_data;
+
+	GMutex lock;
+	GCond done;
+	guint pending;
+} ParallelSort;
+
+typedef struct {
+	ParallelSort *sort;
+	/* Sort task: the run to sort in place is src[0 .. n_left).
+	 * Merge task: src holds two adjacent sorted runs of n_left
+	 * and n_right items, merged into dest.
+	 */
+	gpointer *src;
+	gpointer *dest;
+	gsize n_left;
+	gsize n_right;
+} ParallelSortTask;
+
+static GThreadPool *parallel_sort_pool = NULL;
+
+static int
+parallel_sort_compare (gconstpointer a,
+		       gconstpointer b,
+		       gpointer user_data)
+{
+	ParallelSort *sort;
+
+	sort = user_data;
+	return sort->compare_func (*(gpointer *) a, *(gpointer *) b, sort->user_data);
+}
+
+static void
+parallel_sort_merge (ParallelSortTask *task)
+{
+	ParallelSort *sort;
+	gpointer *left, *left_end, *right, *right_end, *dest;
+
+	sort = task->sort;
+	left = task->src;
+	left_end = right = task->src + task->n_left;
+	right_end = right + task->n_right;
+	dest = task->dest;
+
+	/* Take from the left run on ties to keep the sort stable. */
+	while (left < left_end && right < right_end) {
+		if (sort->compare_func (*left, *right, sort->user_data) <= 0) {
+			*dest++ = *left++;
+		} else {
+			*dest++ = *right++;
+		}
+	}
+	memcpy (dest, left, (left_end - left) * sizeof (gpointer));
+	dest += left_end - left;
+	memcpy (dest, right, (right_end - right) * sizeof (gpointer));
+}
+
+static void
+parallel_sort_thread (gpointer data,
+		      gpointer user_data)
+{
+	ParallelSortTask *task;
+	ParallelSort *sort;
+
+	task = data;
+	sort = task->sort;
+
+	if (task->dest == NULL) {
+		g_qsort_with_data (task->src, task->n_left, sizeof (gpointer),
+				   parallel_sort_compare, sort);
+	} else {
+		parallel_sort_merge (task);
+	}
+
+	g_mutex_lock (&sort->lock);
+	if (--sort->pending == 0) {
+		g_cond_signal (&sort->done);
+	}
+	g_mutex_unlock (&sort->lock);
+}
+
+static void
+parallel_sort_run_tasks (ParallelSort *sort,
+			 ParallelSortTask *tasks,
+			 guint n_tasks)
+{
+	guint i;
+
+	g_mutex_lock (&sort->lock);
+	sort->pending = n_tasks;
+	for (i = 0; i < n_tasks; i++) {
+		g_thread_pool_push (parallel_sort_pool, &tasks[i], NULL);
+	}
+	while (sort->pending > 0) {
+		g_cond_wait (&sort->done, &sort->lock);
+	}
+	g_mutex_unlock (&sort->lock);
+}
+
+/**
+ * eel_sort_parallel:
+ * @items: array of items to sort in place
+ * @n_items: number of items
+ * @compare_func: comparison function, called with two items
+ * @user_data: data passed to @compare_func
+ *
+ * Stable sort of @items, in the same order g_qsort_with_data would
+ * produce. Large arrays are split in runs that are sorted and then
+ * merged pairwise on a thread pool, so @compare_func must be safe to
+ * call from several threads at once. Returns when the sort is done.
+ */
+void
+eel_sort_parallel (gpointer *items,
+		   gsize n_items,
+		   GCompareDataFunc compare_func,
+		   gpointer user_data)
+{
+	ParallelSort sort;
+	ParallelSortTask tasks[PARALLEL_SORT_MAX_RUNS];
+	gsize bounds[PARALLEL_SORT_MAX_RUNS + 1];
+	gpointer *src, *dest, *scratch, *swap;
+	guint n_runs, n_tasks, i;
+
+	sort.compare_func = compare_func;
+	sort.user_data = user_data;
+
+	n_runs = MIN (g_get_num_processors (), PARALLEL_SORT_MAX_RUNS);
+	/* Below this many items, waking up threads costs more than it saves. */
+	if (n_items < EEL_SORT_PARALLEL_MIN_ITEMS || n_runs < 2) {
+		g_qsort_with_data (items, n_items, sizeof (gpointer),
+				   parallel_sort_compare, &sort);
+		return;
+	}
+
+	if (parallel_sort_pool == NULL) {
+		parallel_sort_pool = g_thread_pool_new (parallel_sort_thread, NULL,
+							n_runs, FALSE, NULL);
+	}
+
+	g_mutex_init (&sort.lock);
+	g_cond_init (&sort.done);
+
+	for (i = 0; i <= n_runs; i++) {
+		bounds[i] = n_items * i / n_runs;
+	}
+
+	/* Sort each run. */
+	for (i = 0; i < n_runs; i++) {
+		tasks[i].sort = &sort;
+		tasks[i].src = items + bounds[i];
+		tasks[i].dest = NULL;
+		tasks[i].n_left = bounds[i + 1] - bounds[i];
+		tasks[i].n_right = 0;
+	}
+	parallel_sort_run_tasks (&sort, tasks, n_runs);
+
+	/* Merge neighbouring runs until only one is left, going back
+	 * and forth between the items and a scratch array.
+	 */
+	scratch = g_new (gpointer, n_items);
+	src = items;
+	dest = scratch;
+	while (n_runs > 1) {
+		n_tasks = n_runs / 2;
+		for (i = 0; i < n_tasks; i++) {
+			tasks[i].sort = &sort;
+			tasks[i].src = src + bounds[2 * i];
+			tasks[i].dest = dest + bounds[2 * i];
+			tasks[i].n_left = bounds[2 * i + 1] - bounds[2 * i];
+			tasks[i].n_right = bounds[2 * i + 2] - bounds[2 * i + 1];
+		}
+		if (n_runs % 2 == 1) {
+			memcpy (dest + bounds[n_runs - 1], src + bounds[n_runs - 1],
+				(bounds[n_runs] - bounds[n_runs - 1]) * sizeof (gpointer));
+		}
+		parallel_sort_run_tasks (&sort, tasks, n_tasks);
+
+		for (i = 0; i < n_tasks; i++) {
+			bounds[i + 1] = bounds[2 * i + 2];
+		}
+		if (n_runs % 2 == 1) {
+			bounds[n_tasks + 1] = bounds[n_runs];
+		}
+		n_runs = n_tasks + n_runs % 2;
+
+		swap = src;
+		src = dest;
+		dest = swap;
+	}
+
+	if (src != items) {
+		memcpy (items, src, n_items * sizeof (gpointer));
+	}
+
+	g_free (scratch);
+	g_mutex_clear (&sort.lock);
+	g_cond_clear (&sort.done);
+}
+
 #if !defined (EEL_OMIT_SELF_CHECK)
 
+static int
+compare_sort_check_keys (gconstpointer a,
+			 gconstpointer b,
+			 gpointer user_data)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+/* Sorts @n_items keys with many duplicates both ways and returns
+ * whether eel_sort_parallel left the very same pointers in the same
+ * order as g_list_sort_with_data, which is stable.
+ */
+static gboolean
+check_sort_parallel (gsize n_items)
+{
+	int *keys;
+	gpointer *array;
+	GList *list, *node;
+	gboolean same;
+	gsize i;
+
+	keys = g_new (int, n_items);
+	array = g_new (gpointer, n_items);
+	list = NULL;
+	for (i = 0; i < n_items; i++) {
+		keys[i] = (i * 7919) % 97;
+		array[i] = &keys[i];
+		list = g_list_prepend (list, &keys[i]);
+	}
+	list = g_list_reverse (list);
+
+	eel_sort_parallel (array, n_items, compare_sort_check_keys, NULL);
+	list = g_list_sort_with_data (list, compare_sort_check_keys, NULL);
+
+	same = TRUE;
+	for (node = list, i = 0; node != NULL; node = node->next, i++) {
+		if (node->data != array[i]) {
+			same = FALSE;
+		}
+	}
+
+	g_list_free (list);
+	g_free (array);
+	g_free (keys);
+
+	return same;
+}
+
+void
+eel_self_check_glib_extensions (void)
+{
+	EEL_CHECK_BOOLEAN_RESULT (check_sort_parallel (0), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (check_sort_parallel (1), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (check_sort_parallel (100), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (check_sort_parallel (EEL_SORT_PARALLEL_MIN_ITEMS), TRUE);
+	/* uneven runs, so an odd one out is carried along some merge passes */
+	EEL_CHECK_BOOLEAN_RESULT (check_sort_parallel (EEL_SORT_PARALLEL_MIN_ITEMS * 3 + 7), TRUE);
+}
+
 #endif /* !EEL_OMIT_SELF_CHECK */
@@ -48,4 +48,12 @@ void        eel_g_hash_table_safe_for_each              (GHashTable            *
 gboolean    eel_g_strv_equal                            (char                 **a,
 							 char                 **b);
 
+/* Pointer arrays. Below EEL_SORT_PARALLEL_MIN_ITEMS items,
+ * eel_sort_parallel sorts in the calling thread only. */
+#define EEL_SORT_PARALLEL_MIN_ITEMS 8192
+void        eel_sort_parallel                           (gpointer              *items,
+							 gsize                  n_items,
+							 GCompareDataFunc       compare_func,
+							 gpointer               user_data);
+
 #endif /* EEL_GLIB_EXTENSIONS_H */
@@ -584,8 +584,27 @@ eel_strdup_printf_with_custom (EelPrintfHandler *handlers,
 
 /*********** refcounted strings ****************/
 
-G_LOCK_DEFINE_STATIC (unique_ref_strs);
-static GHashTable *unique_ref_strs = NULL;
+/* The unique strings are spread over several tables, picked by the
+ * string hash, each with its own lock; files are created from several
+ * threads at once and almost all of them intern their owner, group,
+ * MIME type and filesystem id.
+ */
+#define UNIQUE_REF_STR_SHARDS 16
+
+typedef struct {
+	GMutex lock;
+	GHashTable *table;
+	guint hits;
+	guint misses;
+} UniqueRefStrShard;
+
+static UniqueRefStrShard unique_ref_strs[UNIQUE_REF_STR_SHARDS];
+
+static UniqueRefStrShard *
+get_unique_ref_str_shard (const char *string)
+{
+	return &unique_ref_strs[g_str_hash (string) % UNIQUE_REF_STR_SHARDS];
+}
 
 static eel_ref_str
 eel_ref_str_new_internal (const char *string, int start_count)
@@ -616,31 +635,61 @@ eel_ref_str_new (const char *string)
 eel_ref_str
 eel_ref_str_get_unique (const char *string)
 {
+	UniqueRefStrShard *shard;
 	eel_ref_str res;
 
 	if (string == NULL) {
 		return NULL;
 	}
 	
-	G_LOCK (unique_ref_strs);
-	if (unique_ref_strs == NULL) {
-		unique_ref_strs =
+	shard = get_unique_ref_str_shard (string);
+
+	g_mutex_lock (&shard->lock);
+	if (shard->table == NULL) {
+		shard->table =
 			g_hash_table_new (g_str_hash, g_str_equal);
 	}
 
-	res = g_hash_table_lookup (unique_ref_strs, string);
+	res = g_hash_table_lookup (shard->table, string);
 	if (res != NULL) {
 		eel_ref_str_ref (res);
+		shard->hits++;
 	} else {
 		res = eel_ref_str_new_internal (string, 0x80000001);
-		g_hash_table_insert (unique_ref_strs, res, res);
+		g_hash_table_insert (shard->table, res, res);
+		shard->misses++;
 	}
 	
-	G_UNLOCK (unique_ref_strs);
+	g_mutex_unlock (&shard->lock);
 
 	return res;
 }
 
+void
+eel_ref_str_get_unique_statistics (guint *hits,
+				   guint *misses,
+				   guint *size)
+{
+	UniqueRefStrShard *shard;
+	int i;
+
+	*hits = 0;
+	*misses = 0;
+	*size = 0;
+
+	for (i = 0; i < UNIQUE_REF_STR_SHARDS; i++) {
+		shard = &unique_ref_strs[i];
+
+		g_mutex_lock (&shard->lock);
+		*hits += shard->hits;
+		*misses += shard->misses;
+		if (shard->table != NULL) {
+			*size += g_hash_table_size (shard->table);
+		}
+		g_mutex_unlock (&shard->lock);
+	}
+}
+
 eel_ref_str
 eel_ref_str_ref (eel_ref_str str)
 {
@@ -655,6 +704,7 @@ eel_ref_str_ref (eel_ref_str str)
 void
 eel_ref_str_unref (eel_ref_str str)
 {
+	UniqueRefStrShard *shard;
 	volatile gint *count;
 	gint old_ref;
 
@@ -668,13 +718,14 @@ eel_ref_str_unref (eel_ref_str str)
 	if (old_ref == 1) {
 		g_free ((char *)count);
 	} else if (old_ref == 0x80000001) {
-		G_LOCK (unique_ref_strs);
+		shard = get_unique_ref_str_shard (str);
+		g_mutex_lock (&shard->lock);
 		/* Need to recheck after taking lock to avoid races with _get_unique() */
 		if (g_atomic_int_add (count, -1) == 0x80000001) {
-			g_hash_table_remove (unique_ref_strs, (char *)str);
+			g_hash_table_remove (shard->table, (char *)str);
 			g_free ((char *)count);
 		} 
-		G_UNLOCK (unique_ref_strs);
+		g_mutex_unlock (&shard->lock);
 	} else if (!g_atomic_int_compare_and_exchange (count,
 						       old_ref, old_ref - 1)) {
 		goto retry_atomic_decrement;
@@ -754,6 +805,64 @@ verify_custom (const char *orig, const char *format, ...)
 	EEL_CHECK_STRING_RESULT (new, orig);
 }
 
+#define REF_STR_CHECK_STRINGS 64
+
+/* Interns strings spread over several shards twice, then drops both
+ * references, checking that each string is shared and that the tables
+ * end up as they started.
+ */
+static void
+check_unique_ref_strs (void)
+{
+	eel_ref_str strs[REF_STR_CHECK_STRINGS];
+	gboolean shards_used[UNIQUE_REF_STR_SHARDS] = { FALSE };
+	guint hits, misses, size, old_hits, old_misses, old_size;
+	int n_shards;
+	char *string;
+	int i;
+
+	eel_ref_str_get_unique_statistics (&old_hits, &old_misses, &old_size);
+
+	for (i = 0; i < REF_STR_CHECK_STRINGS; i++) {
+		string = g_strdup_printf ("eel-self-check-%d", i);
+		strs[i] = eel_ref_str_get_unique (string);
+		shards_used[get_unique_ref_str_shard (string) - unique_ref_strs] = TRUE;
+		g_free (string);
+	}
+	n_shards = 0;
+	for (i = 0; i < UNIQUE_REF_STR_SHARDS; i++) {
+		n_shards += shards_used[i];
+	}
+	EEL_CHECK_BOOLEAN_RESULT (n_shards > 1, TRUE);
+
+	eel_ref_str_get_unique_statistics (&hits, &misses, &size);
+	EEL_CHECK_INTEGER_RESULT (misses - old_misses, REF_STR_CHECK_STRINGS);
+	EEL_CHECK_INTEGER_RESULT (size - old_size, REF_STR_CHECK_STRINGS);
+
+	for (i = 0; i < REF_STR_CHECK_STRINGS; i++) {
+		string = g_strdup (eel_ref_str_peek (strs[i]));
+		EEL_CHECK_BOOLEAN_RESULT (eel_ref_str_get_unique (string) == strs[i], TRUE);
+		g_free (string);
+	}
+
+	eel_ref_str_get_unique_statistics (&hits, &misses, &size);
+	EEL_CHECK_INTEGER_RESULT (hits - old_hits, REF_STR_CHECK_STRINGS);
+	EEL_CHECK_INTEGER_RESULT (size - old_size, REF_STR_CHECK_STRINGS);
+
+	/* the first unref keeps the strings interned, the second frees them */
+	for (i = 0; i < REF_STR_CHECK_STRINGS; i++) {
+		eel_ref_str_unref (strs[i]);
+	}
+	eel_ref_str_get_unique_statistics (&hits, &misses, &size);
+	EEL_CHECK_INTEGER_RESULT (size - old_size, REF_STR_CHECK_STRINGS);
+
+	for (i = 0; i < REF_STR_CHECK_STRINGS; i++) {
+		eel_ref_str_unref (strs[i]);
+	}
+	eel_ref_str_get_unique_statistics (&hits, &misses, &size);
+	EEL_CHECK_INTEGER_RESULT (size, old_size);
+}
+
 void
 eel_self_check_string (void)
 {
@@ -831,6 +940,7 @@ eel_self_check_string (void)
 	verify_custom ("c1-42- bar c2-foo-","%N %s %Y", 42, "bar" ,"foo");
 	verify_custom ("c1-42- bar c2-foo-","%3$N %2$s %1$Y","foo", "bar", 42);
 
+	check_unique_ref_strs ();
 }
 
 #endif /* !EEL_OMIT_SELF_CHECK */
@@ -66,6 +66,13 @@ eel_ref_str eel_ref_str_get_unique (const char  *string);
 eel_ref_str eel_ref_str_ref        (eel_ref_str  str);
 void        eel_ref_str_unref      (eel_ref_str  str);
 
+/* How many eel_ref_str_get_unique calls found an existing string, how
+ * many added one, and how many unique strings are alive right now.
+ */
+void        eel_ref_str_get_unique_statistics (guint *hits,
+					       guint *misses,
+					       guint *size);
+
 #define eel_ref_str_peek(__str) ((const char *)(__str))
 
 
@@ -46,6 +46,7 @@ typedef enum {
   NAUTILUS_DEBUG_UNDO = 1 << 14,
   NAUTILUS_DEBUG_SEARCH = 1 << 15,
   NAUTILUS_DEBUG_SEARCH_HIT = 1 << 16,
+  NAUTILUS_DEBUG_ASYNC_JOBS = 1 << 17,
 } DebugFlags;
 
 void nautilus_debug_set_flags (DebugFlags flags);
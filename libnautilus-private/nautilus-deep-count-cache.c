@@ -0,0 +1,724 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-deep-count-cache.c: Persistent cache of folder sizes.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include "nautilus-deep-count-cache.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Changes usually come in bursts, so write the cache out a little
+ * while after the last one.
+ */
+#define SAVE_DELAY_SECONDS 5
+
+/* Beyond MAX_ENTRIES levels the least recently used ones are dropped,
+ * and levels not used for MAX_AGE_DAYS are dropped on load and save.
+ */
+#define MAX_ENTRIES 50000
+#define MAX_AGE_DAYS 30
+
+#define URI_KEY "uri"
+#define COUNTS_KEY "counts"
+#define VISIBLE_COUNTS_KEY "visible-counts"
+#define SUBDIRECTORIES_KEY "subdirectories"
+#define VISIBLE_SUBDIRECTORIES_KEY "visible-subdirectories"
+#define FILES_KEY "files"
+#define VISIBLE_FILES_KEY "visible-files"
+#define HARD_LINKS_KEY "hard-links"
+#define VISIBLE_HARD_LINKS_KEY "visible-hard-links"
+#define MTIME_KEY "mtime"
+#define USED_KEY "used"
+
+typedef struct {
+	const char *counts;
+	const char *subdirectories;
+	const char *files;
+	const char *hard_links;
+} LevelKeys;
+
+/* Indexed by include_hidden */
+static const LevelKeys level_keys[2] = {
+	{ VISIBLE_COUNTS_KEY, VISIBLE_SUBDIRECTORIES_KEY, VISIBLE_FILES_KEY, VISIBLE_HARD_LINKS_KEY },
+	{ COUNTS_KEY, SUBDIRECTORIES_KEY, FILES_KEY, HARD_LINKS_KEY }
+};
+
+typedef struct {
+	char *key; /* "device:inode" */
+	char *uri; /* where the directory was last seen */
+	guint64 mtime;
+	gint64 used; /* seconds since the epoch */
+	gboolean has_level[2]; /* indexed by include_hidden */
+	NautilusDeepCountLevel levels[2];
+	GList *lru_link; /* in cache_lru */
+} CacheEntry;
+
+G_LOCK_DEFINE_STATIC (cache);
+static GHashTable *cache_entries; /* key -> CacheEntry * */
+static GHashTable *cache_uris; /* uri -> CacheEntry * */
+static GQueue cache_lru = G_QUEUE_INIT; /* entries, least recently used first */
+static GHashTable *monitored_uris; /* uri -> number of monitors */
+static gboolean cache_loaded;
+static GHashTable *invalidated_while_loading; /* set of uris */
+static guint save_timeout_id;
+static GMutex save_mutex; /* one save at a time, in order */
+
+void
+nautilus_deep_count_level_clear (NautilusDeepCountLevel *level)
+{
+	g_strfreev (level->subdirectories);
+	g_strfreev (level->files);
+	g_strfreev (level->hard_links);
+	memset (level, 0, sizeof (NautilusDeepCountLevel));
+}
+
+static void
+deep_count_level_copy (NautilusDeepCountLevel *dest,
+		       const NautilusDeepCountLevel *src)
+{
+	dest->counts = src->counts;
+	dest->subdirectories = g_strdupv (src->subdirectories);
+	dest->files = g_strdupv (src->files);
+	dest->hard_links = g_strdupv (src->hard_links);
+	dest->sizes_trusted = src->sizes_trusted;
+}
+
+static char *
+get_cache_path (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "nautilus", "deep-count-levels", NULL);
+}
+
+static char *
+make_key (guint64 device,
+	  guint64 inode)
+{
+	return g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+				device, inode);
+}
+
+static gboolean
+key_is_valid (const char *key)
+{
+	guint64 device, inode;
+
+	return sscanf (key, "%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+		       &device, &inode) == 2 && inode != 0;
+}
+
+static gint64
+get_now (void)
+{
+	return g_get_real_time () / G_USEC_PER_SEC;
+}
+
+static gboolean
+cache_entry_is_expired (CacheEntry *entry,
+			gint64 now)
+{
+	return now - entry->used > MAX_AGE_DAYS * 24 * 60 * 60;
+}
+
+static void
+cache_entry_free (gpointer data)
+{
+	CacheEntry *entry = data;
+
+	nautilus_deep_count_level_clear (&entry->levels[FALSE]);
+	nautilus_deep_count_level_clear (&entry->levels[TRUE]);
+	g_free (entry->key);
+	g_free (entry->uri);
+	g_free (entry);
+}
+
+static gboolean
+parse_counts (const char *string,
+	      NautilusDeepCounts *counts)
+{
+	guint64 size;
+
+	if (string == NULL ||
+	    sscanf (string, "%u %u %u %" G_GUINT64_FORMAT,
+		    &counts->directory_count,
+		    &counts->file_count,
+		    &counts->unreadable_count,
+		    &size) != 4) {
+		return FALSE;
+	}
+	counts->size = size;
+
+	return TRUE;
+}
+
+static char *
+format_counts (const NautilusDeepCounts *counts)
+{
+	return g_strdup_printf ("%u %u %u %" G_GUINT64_FORMAT,
+				counts->directory_count,
+				counts->file_count,
+				counts->unreadable_count,
+				(guint64) counts->size);
+}
+
+static gboolean
+parse_names (GKeyFile *keyfile,
+	     const char *group,
+	     const char *key,
+	     char ***names)
+{
+	GError *error;
+
+	error = NULL;
+	*names = g_key_file_get_string_list (keyfile, group, key, NULL, &error);
+	if (error != NULL) {
+		g_error_free (error);
+		return FALSE;
+	}
+	if (*names == NULL) {
+		/* an empty list */
+		*names = g_new0 (char *, 1);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+parse_level (GKeyFile *keyfile,
+	     const char *group,
+	     const LevelKeys *keys,
+	     NautilusDeepCountLevel *level)
+{
+	char *string;
+	gboolean parsed;
+
+	string = g_key_file_get_string (keyfile, group, keys->counts, NULL);
+	parsed = parse_counts (string, &level->counts) &&
+		parse_names (keyfile, group, keys->subdirectories, &level->subdirectories) &&
+		parse_names (keyfile, group, keys->files, &level->files) &&
+		parse_names (keyfile, group, keys->hard_links, &level->hard_links);
+	g_free (string);
+
+	if (!parsed) {
+		nautilus_deep_count_level_clear (level);
+	}
+
+	return parsed;
+}
+
+static void
+format_names (GKeyFile *keyfile,
+	      const char *group,
+	      const char *key,
+	      char **names)
+{
+	g_key_file_set_string_list (keyfile, group, key,
+				    (const char * const *) names,
+				    g_strv_length (names));
+}
+
+static void
+format_level (GKeyFile *keyfile,
+	      const char *group,
+	      const LevelKeys *keys,
+	      const NautilusDeepCountLevel *level)
+{
+	char *string;
+
+	string = format_counts (&level->counts);
+	g_key_file_set_string (keyfile, group, keys->counts, string);
+	g_free (string);
+	format_names (keyfile, group, keys->subdirectories, level->subdirectories);
+	format_names (keyfile, group, keys->files, level->files);
+	format_names (keyfile, group, keys->hard_links, level->hard_links);
+}
+
+/* Call with the lock held. */
+static void
+cache_remove (CacheEntry *entry)
+{
+	g_queue_delete_link (&cache_lru, entry->lru_link);
+	if (entry->uri != NULL &&
+	    g_hash_table_lookup (cache_uris, entry->uri) == entry) {
+		g_hash_table_remove (cache_uris, entry->uri);
+	}
+	g_hash_table_remove (cache_entries, entry->key);
+}
+
+/* Call with the lock held. A directory at the same place as the one
+ * of another entry replaced it, so that one is gone.
+ */
+static void
+cache_entry_set_uri (CacheEntry *entry,
+		     const char *uri)
+{
+	CacheEntry *other;
+
+	if (g_strcmp0 (entry->uri, uri) == 0) {
+		return;
+	}
+
+	if (entry->uri != NULL &&
+	    g_hash_table_lookup (cache_uris, entry->uri) == entry) {
+		g_hash_table_remove (cache_uris, entry->uri);
+	}
+	g_free (entry->uri);
+	entry->uri = g_strdup (uri);
+
+	other = g_hash_table_lookup (cache_uris, uri);
+	if (other != NULL) {
+		cache_remove (other);
+	}
+	g_hash_table_insert (cache_uris, entry->uri, entry);
+}
+
+/* Call with the lock held. */
+static void
+cache_trim (void)
+{
+	while (g_hash_table_size (cache_entries) > MAX_ENTRIES) {
+		cache_remove (g_queue_peek_head (&cache_lru));
+	}
+}
+
+/* Call with the lock held. */
+static void
+cache_entry_touch (CacheEntry *entry)
+{
+	entry->used = get_now ();
+	g_queue_unlink (&cache_lru, entry->lru_link);
+	g_queue_push_tail_link (&cache_lru, entry->lru_link);
+}
+
+static int
+compare_entries_by_use (gconstpointer a,
+			gconstpointer b)
+{
+	const CacheEntry *entry_a, *entry_b;
+
+	entry_a = *(const CacheEntry **) a;
+	entry_b = *(const CacheEntry **) b;
+
+	return (entry_a->used > entry_b->used) - (entry_a->used < entry_b->used);
+}
+
+static void
+load_thread (GTask *task,
+	     gpointer source_object,
+	     gpointer task_data,
+	     GCancellable *cancellable)
+{
+	GKeyFile *keyfile;
+	GPtrArray *loaded, *kept;
+	CacheEntry *entry;
+	char *path;
+	char **groups;
+	gint64 now;
+	gsize i;
+	int include_hidden;
+
+	/* Read and parse the file without holding the lock. */
+	loaded = g_ptr_array_new ();
+	now = get_now ();
+
+	keyfile = g_key_file_new ();
+	path = get_cache_path ();
+	if (g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, NULL)) {
+		groups = g_key_file_get_groups (keyfile, NULL);
+		for (i = 0; groups[i] != NULL; i++) {
+			if (!key_is_valid (groups[i])) {
+				continue;
+			}
+
+			entry = g_new0 (CacheEntry, 1);
+			entry->key = g_strdup (groups[i]);
+			entry->uri = g_key_file_get_string (keyfile, groups[i], URI_KEY, NULL);
+			entry->mtime = g_key_file_get_uint64 (keyfile, groups[i], MTIME_KEY, NULL);
+			entry->used = g_key_file_get_int64 (keyfile, groups[i], USED_KEY, NULL);
+			/* Nothing watched the directories in the meantime,
+			 * so none of the sizes are trusted.
+			 */
+			for (include_hidden = FALSE; include_hidden <= TRUE; include_hidden++) {
+				entry->has_level[include_hidden] =
+					parse_level (keyfile, groups[i],
+						     &level_keys[include_hidden],
+						     &entry->levels[include_hidden]);
+			}
+
+			if (entry->uri == NULL ||
+			    entry->mtime == 0 ||
+			    cache_entry_is_expired (entry, now) ||
+			    (!entry->has_level[TRUE] && !entry->has_level[FALSE])) {
+				cache_entry_free (entry);
+				continue;
+			}
+
+			g_ptr_array_add (loaded, entry);
+		}
+		g_strfreev (groups);
+	}
+	g_key_file_free (keyfile);
+	g_free (path);
+
+	G_LOCK (cache);
+
+	/* Levels stored or invalidated in the meantime are newer. */
+	kept = g_ptr_array_new ();
+	for (i = 0; i < loaded->len; i++) {
+		entry = g_ptr_array_index (loaded, i);
+		if (g_hash_table_contains (cache_entries, entry->key) ||
+		    g_hash_table_contains (cache_uris, entry->uri) ||
+		    g_hash_table_contains (invalidated_while_loading, entry->uri)) {
+			cache_entry_free (entry);
+			continue;
+		}
+		g_hash_table_insert (cache_entries, entry->key, entry);
+		g_hash_table_insert (cache_uris, entry->uri, entry);
+		g_ptr_array_add (kept, entry);
+	}
+	g_ptr_array_free (loaded, TRUE);
+
+	/* All of them were used before the ones of this session. */
+	g_ptr_array_sort (kept, compare_entries_by_use);
+	for (i = kept->len; i > 0; i--) {
+		entry = g_ptr_array_index (kept, i - 1);
+		g_queue_push_head (&cache_lru, entry);
+		entry->lru_link = cache_lru.head;
+	}
+	g_ptr_array_free (kept, TRUE);
+
+	cache_trim ();
+	g_hash_table_destroy (invalidated_while_loading);
+	invalidated_while_loading = NULL;
+	cache_loaded = TRUE;
+
+	G_UNLOCK (cache);
+}
+
+/* Call with the lock held. The file is read in a worker thread, until
+ * then lookups find nothing.
+ */
+static void
+ensure_cache (void)
+{
+	GTask *task;
+
+	if (cache_entries != NULL) {
+		return;
+	}
+
+	cache_entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+					       NULL, cache_entry_free);
+	cache_uris = g_hash_table_new (g_str_hash, g_str_equal);
+	invalidated_while_loading = g_hash_table_new_full (g_str_hash, g_str_equal,
+							   g_free, NULL);
+
+	task = g_task_new (NULL, NULL, NULL, NULL);
+	g_task_run_in_thread (task, load_thread);
+	g_object_unref (task);
+}
+
+static void schedule_save (void);
+
+static void
+save_thread (GTask *task,
+	     gpointer source_object,
+	     gpointer task_data,
+	     GCancellable *cancellable)
+{
+	GKeyFile *keyfile;
+	GList *l, *next;
+	CacheEntry *entry;
+	char *path, *dirname, *contents;
+	gsize length;
+	gint64 now;
+	int include_hidden;
+
+	g_mutex_lock (&save_mutex);
+
+	G_LOCK (cache);
+	if (!cache_loaded) {
+		/* Don't write over the levels still being read. */
+		schedule_save ();
+		G_UNLOCK (cache);
+		g_mutex_unlock (&save_mutex);
+		return;
+	}
+
+	keyfile = g_key_file_new ();
+	now = get_now ();
+	for (l = cache_lru.head; l != NULL; l = next) {
+		next = l->next;
+		entry = l->data;
+
+		if (cache_entry_is_expired (entry, now)) {
+			cache_remove (entry);
+			continue;
+		}
+
+		g_key_file_set_string (keyfile, entry->key, URI_KEY, entry->uri);
+		g_key_file_set_uint64 (keyfile, entry->key, MTIME_KEY, entry->mtime);
+		g_key_file_set_int64 (keyfile, entry->key, USED_KEY, entry->used);
+		for (include_hidden = FALSE; include_hidden <= TRUE; include_hidden++) {
+			if (entry->has_level[include_hidden]) {
+				format_level (keyfile, entry->key,
+					      &level_keys[include_hidden],
+					      &entry->levels[include_hidden]);
+			}
+		}
+	}
+	G_UNLOCK (cache);
+
+	contents = g_key_file_to_data (keyfile, &length, NULL);
+	g_key_file_free (keyfile);
+
+	path = get_cache_path ();
+	dirname = g_path_get_dirname (path);
+	g_mkdir_with_parents (dirname, 0700);
+	g_file_set_contents (path, contents, length, NULL);
+	g_free (dirname);
+	g_free (path);
+	g_free (contents);
+
+	g_mutex_unlock (&save_mutex);
+}
+
+static gboolean
+save_timeout_callback (gpointer data)
+{
+	GTask *task;
+
+	G_LOCK (cache);
+	save_timeout_id = 0;
+	G_UNLOCK (cache);
+
+	task = g_task_new (NULL, NULL, NULL, NULL);
+	g_task_run_in_thread (task, save_thread);
+	g_object_unref (task);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Call with the lock held. */
+static void
+schedule_save (void)
+{
+	if (save_timeout_id == 0) {
+		save_timeout_id = g_timeout_add_seconds (SAVE_DELAY_SECONDS,
+							 save_timeout_callback,
+							 NULL);
+	}
+}
+
+gboolean
+nautilus_deep_count_cache_lookup (GFile *location,
+				  guint64 device,
+				  guint64 inode,
+				  guint64 mtime,
+				  gboolean include_hidden,
+				  NautilusDeepCountLevel *level)
+{
+	CacheEntry *entry;
+	char *key, *uri;
+	gboolean found;
+
+	if (mtime == 0 || inode == 0) {
+		return FALSE;
+	}
+
+	include_hidden = include_hidden != FALSE;
+	key = make_key (device, inode);
+	uri = g_file_get_uri (location);
+
+	G_LOCK (cache);
+	ensure_cache ();
+	entry = g_hash_table_lookup (cache_entries, key);
+	found = entry != NULL &&
+		entry->mtime == mtime &&
+		entry->has_level[include_hidden];
+	if (found) {
+		if (strcmp (entry->uri, uri) != 0) {
+			/* Moved; nothing watched it at its new place. */
+			entry->levels[FALSE].sizes_trusted = FALSE;
+			entry->levels[TRUE].sizes_trusted = FALSE;
+			cache_entry_set_uri (entry, uri);
+		}
+		deep_count_level_copy (level, &entry->levels[include_hidden]);
+		cache_entry_touch (entry);
+	}
+	G_UNLOCK (cache);
+
+	g_free (uri);
+	g_free (key);
+
+	return found;
+}
+
+void
+nautilus_deep_count_cache_store (GFile *location,
+				 guint64 device,
+				 guint64 inode,
+				 guint64 mtime,
+				 gboolean include_hidden,
+				 const NautilusDeepCountLevel *level)
+{
+	CacheEntry *entry;
+	char *key, *uri;
+
+	if (mtime == 0 || inode == 0) {
+		return;
+	}
+
+	include_hidden = include_hidden != FALSE;
+	key = make_key (device, inode);
+	uri = g_file_get_uri (location);
+
+	G_LOCK (cache);
+	ensure_cache ();
+	entry = g_hash_table_lookup (cache_entries, key);
+	if (entry == NULL) {
+		entry = g_new0 (CacheEntry, 1);
+		entry->key = key;
+		g_hash_table_insert (cache_entries, entry->key, entry);
+		g_queue_push_tail (&cache_lru, entry);
+		entry->lru_link = cache_lru.tail;
+		key = NULL;
+	} else if (entry->mtime != mtime) {
+		nautilus_deep_count_level_clear (&entry->levels[FALSE]);
+		nautilus_deep_count_level_clear (&entry->levels[TRUE]);
+		entry->has_level[FALSE] = entry->has_level[TRUE] = FALSE;
+	}
+	cache_entry_set_uri (entry, uri);
+	entry->mtime = mtime;
+	entry->has_level[include_hidden] = TRUE;
+	nautilus_deep_count_level_clear (&entry->levels[include_hidden]);
+	deep_count_level_copy (&entry->levels[include_hidden], level);
+	entry->levels[include_hidden].sizes_trusted =
+		monitored_uris != NULL &&
+		g_hash_table_contains (monitored_uris, uri);
+	cache_entry_touch (entry);
+	cache_trim ();
+	schedule_save ();
+	G_UNLOCK (cache);
+
+	g_free (uri);
+	g_free (key);
+}
+
+void
+nautilus_deep_count_cache_set_monitored (GFile *location,
+					 gboolean monitored)
+{
+	CacheEntry *entry;
+	char *uri;
+	int count;
+
+	uri = g_file_get_uri (location);
+
+	G_LOCK (cache);
+	if (monitored_uris == NULL) {
+		monitored_uris = g_hash_table_new_full (g_str_hash, g_str_equal,
+							g_free, NULL);
+	}
+
+	count = GPOINTER_TO_INT (g_hash_table_lookup (monitored_uris, uri));
+	if (monitored) {
+		g_hash_table_insert (monitored_uris, g_strdup (uri),
+				     GINT_TO_POINTER (count + 1));
+	} else if (count > 1) {
+		g_hash_table_insert (monitored_uris, g_strdup (uri),
+				     GINT_TO_POINTER (count - 1));
+	} else {
+		g_hash_table_remove (monitored_uris, uri);
+
+		/* From now on changes go unnoticed. */
+		entry = cache_uris != NULL ? g_hash_table_lookup (cache_uris, uri) : NULL;
+		if (entry != NULL) {
+			entry->levels[FALSE].sizes_trusted = FALSE;
+			entry->levels[TRUE].sizes_trusted = FALSE;
+		}
+	}
+	G_UNLOCK (cache);
+
+	g_free (uri);
+}
+
+/* A change to a file changes what its directory holds, and if it is a
+ * directory itself, its own level may be gone. The levels of the
+ * directories further up stay valid.
+ */
+void
+nautilus_deep_count_cache_invalidate (GList *locations)
+{
+	GHashTable *directories;
+	GHashTableIter iter;
+	GPtrArray *uris;
+	CacheEntry *entry;
+	GFile *directory, *parent;
+	GList *l;
+	gboolean changed;
+	guint i;
+
+	G_LOCK (cache);
+	ensure_cache ();
+	if (cache_loaded && g_hash_table_size (cache_entries) == 0) {
+		G_UNLOCK (cache);
+		return;
+	}
+	G_UNLOCK (cache);
+
+	/* Files of a batch usually share their directory, so get the
+	 * uri of each directory only once and outside the lock.
+	 */
+	directories = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+					     g_object_unref, NULL);
+	for (l = locations; l != NULL; l = l->next) {
+		g_hash_table_add (directories, g_object_ref (l->data));
+		parent = g_file_get_parent (l->data);
+		if (parent != NULL) {
+			g_hash_table_add (directories, parent);
+		}
+	}
+
+	uris = g_ptr_array_new_with_free_func (g_free);
+	g_hash_table_iter_init (&iter, directories);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &directory, NULL)) {
+		g_ptr_array_add (uris, g_file_get_uri (directory));
+	}
+	g_hash_table_destroy (directories);
+
+	changed = FALSE;
+	G_LOCK (cache);
+	for (i = 0; i < uris->len; i++) {
+		entry = g_hash_table_lookup (cache_uris, g_ptr_array_index (uris, i));
+		if (entry != NULL) {
+			cache_remove (entry);
+			changed = TRUE;
+		}
+		if (invalidated_while_loading != NULL) {
+			g_hash_table_add (invalidated_while_loading,
+					  g_strdup (g_ptr_array_index (uris, i)));
+		}
+	}
+	if (changed) {
+		schedule_save ();
+	}
+	G_UNLOCK (cache);
+
+	g_ptr_array_free (uris, TRUE);
+}
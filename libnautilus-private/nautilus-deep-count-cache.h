@@ -0,0 +1,83 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-deep-count-cache.h: Persistent cache of folder sizes.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NAUTILUS_DEEP_COUNT_CACHE_H
+#define NAUTILUS_DEEP_COUNT_CACHE_H
+
+#include <gio/gio.h>
+
+/* The totals below one directory, not counting the directory itself. */
+typedef struct {
+	guint directory_count;
+	guint file_count;
+	guint unreadable_count;
+	goffset size;
+} NautilusDeepCounts;
+
+/* What a deep count needs to know of one directory. The size in
+ * @counts is that of the files in @files only: subdirectories and
+ * hard-linked files are looked at again on every count, the latter so
+ * that each inode is counted once however many links the tree holds.
+ */
+typedef struct {
+	NautilusDeepCounts counts;
+	char **subdirectories; /* the ones a count descends into */
+	char **files; /* files with a single link */
+	char **hard_links; /* files with more than one link */
+
+	/* Set if the directory was monitored ever since the level was
+	 * stored. Otherwise a file rewritten in place may have changed
+	 * size without touching the directory, and the size in @counts
+	 * can't be used; stat @files instead.
+	 */
+	gboolean sizes_trusted;
+} NautilusDeepCountLevel;
+
+void     nautilus_deep_count_level_clear      (NautilusDeepCountLevel   *level);
+
+/* The cache holds one level per directory, keyed by its device and
+ * inode. A level is only returned while the directory's modification
+ * time still matches the one it was stored with, so a count checks
+ * every level of a tree on its own. All functions may be called from
+ * any thread.
+ */
+gboolean nautilus_deep_count_cache_lookup     (GFile                    *location,
+					       guint64                   device,
+					       guint64                   inode,
+					       guint64                   mtime,
+					       gboolean                  include_hidden,
+					       NautilusDeepCountLevel   *level);
+void     nautilus_deep_count_cache_store      (GFile                    *location,
+					       guint64                   device,
+					       guint64                   inode,
+					       guint64                   mtime,
+					       gboolean                  include_hidden,
+					       const NautilusDeepCountLevel *level);
+
+/* Tell the cache when a directory starts and stops being monitored;
+ * only the sizes of monitored directories are trusted.
+ */
+void     nautilus_deep_count_cache_set_monitored (GFile                 *location,
+						  gboolean               monitored);
+
+/* Forget the levels that changed with @locations (a list of GFile *):
+ * those of the locations and of their parent directories.
+ */
+void     nautilus_deep_count_cache_invalidate (GList                    *locations);
+
+#endif /* NAUTILUS_DEEP_COUNT_CACHE_H */
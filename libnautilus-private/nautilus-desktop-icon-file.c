@@ -184,12 +184,12 @@ update_info_from_link (NautilusDesktopIconFile *icon_file)
 	file->details->can_mount = FALSE;
 	file->details->can_unmount = FALSE;
 	file->details->can_eject = FALSE;
-	if (file->details->mount) {
-		g_object_unref (file->details->mount);
+	if (file->details->rare_details != NULL) {
+		g_clear_object (&file->details->rare_details->mount);
 	}
 	mount = nautilus_desktop_link_get_mount (link);
-	file->details->mount = mount;
 	if (mount) {
+		nautilus_file_ensure_rare_details (file)->mount = mount;
 		file->details->can_unmount = g_mount_can_unmount (mount);
 		file->details->can_eject = g_mount_can_eject (mount);
 	}
@@ -22,6 +22,7 @@
 
 #include <config.h>
 
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-notify.h"
 #include "nautilus-directory-private.h"
 #include "nautilus-file-attributes.h"
@@ -30,12 +31,16 @@
 #include "nautilus-signaller.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-link.h"
+#include "nautilus-local-enumerator.h"
 #include "nautilus-profile.h"
+#define DEBUG_FLAG NAUTILUS_DEBUG_ASYNC_JOBS
+#include "nautilus-debug.h"
 #include <eel/eel-glib-extensions.h>
 #include <gtk/gtk.h>
 #include <libxml/parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* turn this on to see messages about each load_directory call: */
 #if 0
@@ -54,9 +59,38 @@
 
 #define DIRECTORY_LOAD_ITEMS_PER_CALLBACK 100
 
-/* Keep async. jobs down to this number for all directories. */
+/* Time the idle callback may spend turning loaded file info into
+ * NautilusFile objects before it lets the main loop run again.
+ */
+#define DEQUEUE_PENDING_SLICE_USEC 5000
+
+/* Keep async. jobs down to this number for all directories. Can be
+ * overridden with NAUTILUS_MAX_ASYNC_JOBS in the environment.
+ */
 #define MAX_ASYNC_JOBS 10
 
+/* Job slots only directories someone is looking at may use, so that
+ * background work can't lock out the folder the user just opened.
+ */
+#define FOREGROUND_ASYNC_JOBS_RESERVE 3
+
+/* A directory that has waited this long for a job slot is served
+ * before all others, foreground or not.
+ */
+#define ASYNC_JOB_STARVATION_USEC (2 * G_USEC_PER_SEC)
+
+/* Local directories are counted in a shared thread pool instead, and
+ * all the counts of one directory take up a single job slot.
+ */
+#define MAX_BATCHED_COUNT_THREADS 4
+
+/* Threads walking the trees of all deep counts, shared by all of
+ * them, and how often the partial counts are pushed to the file
+ * while they run.
+ */
+#define MAX_DEEP_COUNT_THREADS 8
+#define DEEP_COUNT_PROGRESS_INTERVAL_MSEC 200
+
 struct TopLeftTextReadState {
 	NautilusDirectory *directory;
 	NautilusFile *file;
@@ -94,22 +128,31 @@ struct DirectoryLoadState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
 	GFileEnumerator *enumerator;
+	NautilusLocalEnumerator *local_enumerator;
 	GHashTable *load_mime_list_hash;
 	NautilusFile *load_directory_file;
 	int load_file_count;
 };
 
+struct DeferredInfoState {
+	NautilusDirectory *directory;
+	GCancellable *cancellable;
+	GFileEnumerator *enumerator;
+};
+
 struct MimeListState {
 	NautilusDirectory *directory;
 	NautilusFile *mime_list_file;
 	GCancellable *cancellable;
 	GFileEnumerator *enumerator;
 	GHashTable *mime_list_hash;
+	int file_count;
 };
 
 struct GetInfoState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
+	NautilusFile *file;
 };
 
 struct NewFilesState {
@@ -124,16 +167,51 @@ struct DirectoryCountState {
 	GCancellable *cancellable;
 	GFileEnumerator *enumerator;
 	int file_count;
+
+	/* For counts done in the batched count pool. */
+	char *path;
+	gboolean show_hidden_files;
+	GHashTable *mime_list_hash; /* if the MIME list is read too */
+};
+
+typedef struct {
+	guint64 device;
+	guint64 inode;
+} DeepCountInode;
+
+/* A directory of the tree being counted. It lives until its own
+ * listing and all of its subdirectories are done.
+ */
+typedef struct DeepCountNode DeepCountNode;
+struct DeepCountNode {
+	DeepCountState *state;
+	DeepCountNode *parent;
+	GFile *location;
+	guint64 mtime; /* in microseconds */
+	guint64 device;
+	guint64 inode;
+	int pending;
 };
 
+/* A directory's level as it is being read, see NautilusDeepCountLevel. */
+typedef struct {
+	NautilusDeepCounts counts;
+	GPtrArray *subdirectories;
+	GPtrArray *files;
+	GPtrArray *hard_links;
+} DeepCountListing;
+
 struct DeepCountState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
-	GFileEnumerator *enumerator;
-	GFile *deep_count_location;
-	GList *deep_count_subdirectories;
-	GArray *seen_deep_count_inodes;
+	gboolean show_hidden_files;
 	char *fs_id;
+	guint progress_timeout_id;
+
+	/* Shared with the worker threads, protected by lock. */
+	GMutex lock;
+	GHashTable *seen_inodes; /* set of DeepCountInode * */
+	NautilusDeepCounts counts;
 };
 
 
@@ -151,8 +229,17 @@ typedef struct {
 			  * in the list so we can kill it when the file
 			  * goes away.
 			  */
+	GList *table_link; /* in call_when_ready_hash */
+	GList *key_link; /* in call_when_ready_keys */
+	GList *ready_link; /* in ready_callbacks while not active */
+	RequestType waiting_for; /* first unsatisfied request type,
+				  * REQUEST_TYPE_LAST until checked
+				  */
+	GList *waiting_link; /* in waiting_callbacks while active */
 } ReadyCallback;
 
+#define REQUEST_ALL ((Request) ((1 << REQUEST_TYPE_LAST) - 1))
+
 typedef struct {
 	NautilusFile *file; /* Which file, NULL means all. */
 	gboolean monitor_hidden_files; /* defines whether "all" includes hidden files */
@@ -170,19 +257,103 @@ typedef struct {
 typedef gboolean (* RequestCheck) (Request);
 typedef gboolean (* FileCheck) (NautilusFile *);
 
+typedef enum {
+	ASYNC_JOB_FILE_LIST,
+	ASYNC_JOB_ATTRIBUTES,
+	ASYNC_JOB_THUMBNAIL,
+	ASYNC_JOB_COUNT,
+	ASYNC_JOB_DEEP_COUNT,
+	ASYNC_JOB_KIND_LAST
+} AsyncJobKind;
+
+static const struct {
+	const char *job;
+	AsyncJobKind kind;
+} async_job_kinds[] = {
+	{ "file list", ASYNC_JOB_FILE_LIST },
+	{ "deferred info", ASYNC_JOB_FILE_LIST },
+	{ "file info", ASYNC_JOB_ATTRIBUTES },
+	{ "link info", ASYNC_JOB_ATTRIBUTES },
+	{ "mount", ASYNC_JOB_ATTRIBUTES },
+	{ "filesystem info", ASYNC_JOB_ATTRIBUTES },
+	{ "extension info", ASYNC_JOB_ATTRIBUTES },
+	{ "thumbnail", ASYNC_JOB_THUMBNAIL },
+	{ "directory count", ASYNC_JOB_COUNT },
+	{ "MIME list", ASYNC_JOB_COUNT },
+	{ "deep count", ASYNC_JOB_DEEP_COUNT }
+};
+
+/* Share of the job slots (in percent) each kind of job may take. */
+static const int async_job_kind_shares[ASYNC_JOB_KIND_LAST] = {
+	100,	/* ASYNC_JOB_FILE_LIST */
+	100,	/* ASYNC_JOB_ATTRIBUTES */
+	50,	/* ASYNC_JOB_THUMBNAIL */
+	50,	/* ASYNC_JOB_COUNT */
+	30	/* ASYNC_JOB_DEEP_COUNT */
+};
+
+/* How many fetches of each kind a single directory may have running
+ * at once, so that slow mounts see a stream of requests rather than
+ * one round-trip at a time. MAX_ASYNC_JOBS still bounds the total.
+ * Each can be overridden in the environment, like MAX_ASYNC_JOBS.
+ */
+typedef enum {
+	DIRECTORY_JOB_FILE_INFO,
+	DIRECTORY_JOB_DIRECTORY_COUNT,
+	DIRECTORY_JOB_BATCHED_COUNT,
+	DIRECTORY_JOB_LINK_INFO,
+	DIRECTORY_JOB_THUMBNAIL,
+	DIRECTORY_JOB_MOUNT,
+	DIRECTORY_JOB_FILESYSTEM_INFO,
+	DIRECTORY_JOB_LAST
+} DirectoryJobKind;
+
+static struct {
+	const char *variable;
+	int default_limit;
+	int limit;
+} directory_job_limits[DIRECTORY_JOB_LAST] = {
+	{ "NAUTILUS_MAX_FILE_INFO_JOBS", 6 },
+	{ "NAUTILUS_MAX_DIRECTORY_COUNT_JOBS", 4 },
+	{ "NAUTILUS_MAX_BATCHED_COUNT_JOBS", 64 },
+	{ "NAUTILUS_MAX_LINK_INFO_JOBS", 4 },
+	{ "NAUTILUS_MAX_THUMBNAIL_JOBS", 4 },
+	{ "NAUTILUS_MAX_MOUNT_JOBS", 2 },
+	{ "NAUTILUS_MAX_FILESYSTEM_INFO_JOBS", 2 }
+};
+
+typedef struct {
+	NautilusDirectory *directory;
+	gint64 waiting_since;
+	guint blocked_kinds; /* mask of 1 << AsyncJobKind */
+	guint woken_serial;
+} AsyncJobWaiter;
+
 /* Current number of async. jobs. */
 static int async_job_count;
-static GHashTable *waiting_directories;
+static int async_job_kind_counts[ASYNC_JOB_KIND_LAST];
+static int async_job_limit;
+/* Directories blocked on a job slot, in the order they got blocked. */
+static GList *waiting_directories; /* list of AsyncJobWaiter * */
+static GThreadPool *batched_count_pool;
+static GThreadPool *deep_count_pool;
+G_LOCK_DEFINE_STATIC (batched_count_results);
+static GList *batched_count_results; /* list of DirectoryCountState * */
+static guint batched_count_results_idle_id;
+static AsyncJobWaiter *waking_waiter;
+static guint wake_up_serial;
 #ifdef DEBUG_ASYNC_JOBS
 static GHashTable *async_jobs;
 #endif
 
 /* Forward declarations for functions that need them. */
-static void     deep_count_load                               (DeepCountState         *state,
-							       GFile                  *location);
 static gboolean request_is_satisfied                          (NautilusDirectory      *directory,
 							       NautilusFile           *file,
 							       Request                 request);
+static void     mark_request_changed                          (NautilusDirectory      *directory,
+							       NautilusFile           *file,
+							       Request                 request);
+static void     async_service_loop                            (NautilusDirectory      *directory);
 static void     cancel_loading_attributes                     (NautilusDirectory      *directory,
 							       NautilusFileAttributes  file_attributes);
 static void     add_all_files_to_work_queue                   (NautilusDirectory      *directory);
@@ -294,7 +465,8 @@ request_counter_remove_request (RequestCounter counter,
 static void
 nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 {
-	GList *l;
+	GHashTableIter iter;
+	GList *list, *l;
 	RequestCounter counters;
 	int i;
 	gboolean fail;
@@ -303,9 +475,12 @@ nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 	for (i = 0; i < REQUEST_TYPE_LAST; i ++) {
 		counters[i] = 0;
 	}
-	for (l = directory->details->monitor_list; l != NULL; l = l->next) {
-		Monitor *monitor = l->data;
-		request_counter_add_request (counters, monitor->request);
+	g_hash_table_iter_init (&iter, directory->details->monitor_hash);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &list)) {
+		for (l = list; l != NULL; l = l->next) {
+			Monitor *monitor = l->data;
+			request_counter_add_request (counters, monitor->request);
+		}
 	}
 	for (i = 0; i < REQUEST_TYPE_LAST; i ++) {
 		if (counters[i] != directory->details->monitor_counters[i]) {
@@ -317,9 +492,12 @@ nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 	for (i = 0; i < REQUEST_TYPE_LAST; i ++) {
 		counters[i] = 0;
 	}
-	for (l = directory->details->call_when_ready_list; l != NULL; l = l->next) {
-		ReadyCallback *callback = l->data;
-		request_counter_add_request (counters, callback->request);
+	g_hash_table_iter_init (&iter, directory->details->call_when_ready_hash);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &list)) {
+		for (l = list; l != NULL; l = l->next) {
+			ReadyCallback *callback = l->data;
+			request_counter_add_request (counters, callback->request);
+		}
 	}
 	for (i = 0; i < REQUEST_TYPE_LAST; i ++) {
 		if (counters[i] != directory->details->call_when_ready_counters[i]) {
@@ -332,6 +510,233 @@ nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 }
 #endif
 
+static int
+get_async_job_limit (void)
+{
+	const char *limit_string;
+
+	if (async_job_limit == 0) {
+		async_job_limit = MAX_ASYNC_JOBS;
+		limit_string = g_getenv ("NAUTILUS_MAX_ASYNC_JOBS");
+		if (limit_string != NULL && atoi (limit_string) > 0) {
+			async_job_limit = atoi (limit_string);
+		}
+	}
+
+	return async_job_limit;
+}
+
+static int
+get_directory_job_limit (DirectoryJobKind kind)
+{
+	const char *limit_string;
+
+	if (directory_job_limits[kind].limit == 0) {
+		directory_job_limits[kind].limit = directory_job_limits[kind].default_limit;
+		limit_string = g_getenv (directory_job_limits[kind].variable);
+		if (limit_string != NULL && atoi (limit_string) > 0) {
+			directory_job_limits[kind].limit = atoi (limit_string);
+		}
+	}
+
+	return directory_job_limits[kind].limit;
+}
+
+static AsyncJobKind
+async_job_get_kind (const char *job)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (async_job_kinds); i++) {
+		if (strcmp (async_job_kinds[i].job, job) == 0) {
+			return async_job_kinds[i].kind;
+		}
+	}
+
+	g_assert_not_reached ();
+	return ASYNC_JOB_ATTRIBUTES;
+}
+
+static AsyncJobWaiter *
+async_job_find_waiter (NautilusDirectory *directory)
+{
+	GList *node;
+	AsyncJobWaiter *waiter;
+
+	for (node = waiting_directories; node != NULL; node = node->next) {
+		waiter = node->data;
+		if (waiter->directory == directory) {
+			return waiter;
+		}
+	}
+	return NULL;
+}
+
+static gboolean
+async_job_waiter_is_starving (AsyncJobWaiter *waiter,
+			      gint64 now)
+{
+	return now - waiter->waiting_since >= ASYNC_JOB_STARVATION_USEC;
+}
+
+/* Directories someone is displaying get the reserved job slots. */
+static gboolean
+async_job_is_foreground (NautilusDirectory *directory)
+{
+	return nautilus_directory_is_anyone_monitoring_file_list (directory);
+}
+
+static void
+async_job_debug_dump (const char *event,
+		      NautilusDirectory *directory)
+{
+	GList *node;
+	AsyncJobWaiter *waiter;
+	int foreground, background, starving;
+	gint64 now;
+	char *uri;
+
+	if (!nautilus_debug_flag_is_set (NAUTILUS_DEBUG_ASYNC_JOBS)) {
+		return;
+	}
+
+	now = g_get_monotonic_time ();
+	foreground = background = starving = 0;
+	for (node = waiting_directories; node != NULL; node = node->next) {
+		waiter = node->data;
+		if (async_job_waiter_is_starving (waiter, now)) {
+			starving++;
+		}
+		if (async_job_is_foreground (waiter->directory)) {
+			foreground++;
+		} else {
+			background++;
+		}
+	}
+
+	uri = nautilus_directory_get_uri (directory);
+	DEBUG ("%s %s: %d/%d jobs (list %d, attributes %d, thumbnails %d, "
+	       "counts %d, deep counts %d), waiting %d foreground, "
+	       "%d background, %d starving",
+	       event, uri, async_job_count, get_async_job_limit (),
+	       async_job_kind_counts[ASYNC_JOB_FILE_LIST],
+	       async_job_kind_counts[ASYNC_JOB_ATTRIBUTES],
+	       async_job_kind_counts[ASYNC_JOB_THUMBNAIL],
+	       async_job_kind_counts[ASYNC_JOB_COUNT],
+	       async_job_kind_counts[ASYNC_JOB_DEEP_COUNT],
+	       foreground, background, starving);
+	g_free (uri);
+}
+
+static gboolean
+async_job_kind_is_full (AsyncJobKind kind)
+{
+	return async_job_kind_counts[kind] >=
+		MAX (1, get_async_job_limit () * async_job_kind_shares[kind] / 100);
+}
+
+/* Could the starving directory use a slot if we left it free? */
+static gboolean
+async_job_waiter_could_start (AsyncJobWaiter *waiter)
+{
+	AsyncJobKind kind;
+
+	for (kind = 0; kind < ASYNC_JOB_KIND_LAST; kind++) {
+		if ((waiter->blocked_kinds & (1 << kind)) != 0 &&
+		    !async_job_kind_is_full (kind)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static gboolean
+async_job_can_start (NautilusDirectory *directory,
+		     AsyncJobKind kind)
+{
+	GList *node;
+	AsyncJobWaiter *waiter, *own_waiter;
+	gboolean starving;
+	gint64 now;
+	int limit;
+
+	limit = get_async_job_limit ();
+	if (async_job_count >= limit) {
+		return FALSE;
+	}
+
+	if (async_job_kind_is_full (kind)) {
+		return FALSE;
+	}
+
+	now = g_get_monotonic_time ();
+	own_waiter = waking_waiter != NULL && waking_waiter->directory == directory ?
+		waking_waiter : async_job_find_waiter (directory);
+	starving = own_waiter != NULL && async_job_waiter_is_starving (own_waiter, now);
+
+	/* Leave the free slots to whoever has waited too long. */
+	if (!starving) {
+		for (node = waiting_directories; node != NULL; node = node->next) {
+			waiter = node->data;
+			if (waiter->directory != directory &&
+			    async_job_waiter_is_starving (waiter, now) &&
+			    async_job_waiter_could_start (waiter)) {
+				return FALSE;
+			}
+		}
+	}
+
+	if (!starving && !async_job_is_foreground (directory) &&
+	    async_job_count >= MAX (1, limit - FOREGROUND_ASYNC_JOBS_RESERVE)) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+async_job_wait (NautilusDirectory *directory,
+		AsyncJobKind kind)
+{
+	AsyncJobWaiter *waiter;
+
+	waiter = async_job_find_waiter (directory);
+	if (waiter != NULL) {
+		waiter->blocked_kinds |= 1 << kind;
+		return;
+	}
+
+	waiter = g_new0 (AsyncJobWaiter, 1);
+	waiter->blocked_kinds = 1 << kind;
+	waiter->directory = directory;
+
+	/* Being woken up and not getting everything doesn't make it
+	 * lose its place.
+	 */
+	if (waking_waiter != NULL && waking_waiter->directory == directory) {
+		waiter->waiting_since = waking_waiter->waiting_since;
+		waiter->woken_serial = waking_waiter->woken_serial;
+	} else {
+		waiter->waiting_since = g_get_monotonic_time ();
+	}
+
+	waiting_directories = g_list_append (waiting_directories, waiter);
+
+	async_job_debug_dump ("blocked", directory);
+}
+
+static void
+async_job_forget (NautilusDirectory *directory)
+{
+	AsyncJobWaiter *waiter;
+
+	waiter = async_job_find_waiter (directory);
+	if (waiter != NULL) {
+		waiting_directories = g_list_remove (waiting_directories, waiter);
+		g_free (waiter);
+	}
+}
+
 /* Start a job. This is really just a way of limiting the number of
  * async. requests that we issue at any given time. Without this, the
  * number of requests is unbounded.
@@ -340,6 +745,7 @@ static gboolean
 async_job_start (NautilusDirectory *directory,
 		 const char *job)
 {
+	AsyncJobKind kind;
 #ifdef DEBUG_ASYNC_JOBS
 	char *key;
 #endif
@@ -349,17 +755,12 @@ async_job_start (NautilusDirectory *directory,
 #endif
 
 	g_assert (async_job_count >= 0);
-	g_assert (async_job_count <= MAX_ASYNC_JOBS);
+	g_assert (async_job_count <= get_async_job_limit ());
 
-	if (async_job_count >= MAX_ASYNC_JOBS) {
-		if (waiting_directories == NULL) {
-			waiting_directories = g_hash_table_new (NULL, NULL);
-		}
+	kind = async_job_get_kind (job);
 
-		g_hash_table_insert (waiting_directories,
-				     directory,
-				     directory);
-		
+	if (!async_job_can_start (directory, kind)) {
+		async_job_wait (directory, kind);
 		return FALSE;
 	}
 
@@ -381,6 +782,7 @@ async_job_start (NautilusDirectory *directory,
 #endif	
 
 	async_job_count += 1;
+	async_job_kind_counts[kind] += 1;
 	return TRUE;
 }
 
@@ -389,6 +791,7 @@ static void
 async_job_end (NautilusDirectory *directory,
 	       const char *job)
 {
+	AsyncJobKind kind;
 #ifdef DEBUG_ASYNC_JOBS
 	char *key;
 	gpointer table_key, value;
@@ -398,7 +801,10 @@ async_job_end (NautilusDirectory *directory,
 	g_message ("stopping %s in %p", job, directory->details->location);
 #endif
 
+	kind = async_job_get_kind (job);
+
 	g_assert (async_job_count > 0);
+	g_assert (async_job_kind_counts[kind] > 0);
 
 #ifdef DEBUG_ASYNC_JOBS
 	{
@@ -419,29 +825,48 @@ async_job_end (NautilusDirectory *directory,
 #endif
 
 	async_job_count -= 1;
+	async_job_kind_counts[kind] -= 1;
 }
 
-/* Helper to get one value from a hash table. */
-static void
-get_one_value_callback (gpointer key, gpointer value, gpointer callback_data)
-{
-	gpointer *returned_value;
-
-	returned_value = callback_data;
-	*returned_value = value;
-}
-
-/* return a single value from a hash table. */
-static gpointer
-get_one_value (GHashTable *table)
+/* Pick the next directory to wake up: the ones that have waited too
+ * long first, then the ones being displayed, then the others, each in
+ * the order they got blocked. Directories already woken up in this
+ * round are skipped.
+ */
+static AsyncJobWaiter *
+async_job_pick_waiter (void)
 {
-	gpointer value;
+	GList *node;
+	AsyncJobWaiter *waiter, *foreground, *background;
+	gint64 now;
+
+	now = g_get_monotonic_time ();
+	foreground = background = NULL;
+	for (node = waiting_directories; node != NULL; node = node->next) {
+		waiter = node->data;
+		if (waiter->woken_serial == wake_up_serial) {
+			continue;
+		}
+		if (async_job_waiter_is_starving (waiter, now)) {
+			return waiter;
+		}
+		if (async_job_is_foreground (waiter->directory)) {
+			if (foreground == NULL) {
+				foreground = waiter;
+			}
+		} else if (background == NULL) {
+			background = waiter;
+		}
+	}
 
-	value = NULL;
-	if (table != NULL) {
-		g_hash_table_foreach (table, get_one_value_callback, &value);
+	if (foreground != NULL) {
+		return foreground;
 	}
-	return value;
+	if (background != NULL &&
+	    async_job_count < MAX (1, get_async_job_limit () - FOREGROUND_ASYNC_JOBS_RESERVE)) {
+		return background;
+	}
+	return NULL;
 }
 
 /* Wake up directories that are "blocked" as long as there are job
@@ -451,34 +876,67 @@ static void
 async_job_wake_up (void)
 {
 	static gboolean already_waking_up = FALSE;
-	gpointer value;
+	AsyncJobWaiter *waiter;
 
 	g_assert (async_job_count >= 0);
-	g_assert (async_job_count <= MAX_ASYNC_JOBS);
+	g_assert (async_job_count <= get_async_job_limit ());
 
 	if (already_waking_up) {
 		return;
 	}
 	
 	already_waking_up = TRUE;
-	while (async_job_count < MAX_ASYNC_JOBS) {
-		value = get_one_value (waiting_directories);
-		if (value == NULL) {
+	wake_up_serial++;
+	while (async_job_count < get_async_job_limit ()) {
+		waiter = async_job_pick_waiter ();
+		if (waiter == NULL) {
 			break;
 		}
-		g_hash_table_remove (waiting_directories, value);
-		nautilus_directory_async_state_changed
-			(NAUTILUS_DIRECTORY (value));
+		waiting_directories = g_list_remove (waiting_directories, waiter);
+		waiter->woken_serial = wake_up_serial;
+
+		waking_waiter = waiter;
+		async_job_debug_dump ("waking up", waiter->directory);
+		async_service_loop (waiter->directory);
+		waking_waiter = NULL;
+
+		g_free (waiter);
 	}
 	already_waking_up = FALSE;
 }
 
+static DirectoryCountState *
+directory_count_find_state (NautilusDirectory *directory,
+			    NautilusFile *file)
+{
+	GList *node;
+	DirectoryCountState *state;
+
+	for (node = directory->details->count_in_progress; node != NULL; node = node->next) {
+		state = node->data;
+		if (state->count_file == file) {
+			return state;
+		}
+	}
+	return NULL;
+}
+
+static void
+directory_count_cancel_one (NautilusDirectory *directory,
+			    DirectoryCountState *state)
+{
+	/* The callback ends the job once it sees the cancellation. */
+	g_cancellable_cancel (state->cancellable);
+	directory->details->count_in_progress =
+		g_list_remove (directory->details->count_in_progress, state);
+}
+
 static void
 directory_count_cancel (NautilusDirectory *directory)
 {
-	if (directory->details->count_in_progress != NULL) {
-		g_cancellable_cancel (directory->details->count_in_progress->cancellable);
-		directory->details->count_in_progress = NULL;
+	while (directory->details->count_in_progress != NULL) {
+		directory_count_cancel_one (directory,
+					    directory->details->count_in_progress->data);
 	}
 }
 
@@ -508,49 +966,183 @@ mime_list_cancel (NautilusDirectory *directory)
 	}
 }
 
+static LinkInfoReadState *
+link_info_find_state (NautilusDirectory *directory,
+		      NautilusFile *file)
+{
+	GList *node;
+	LinkInfoReadState *state;
+
+	for (node = directory->details->link_info_read_states; node != NULL; node = node->next) {
+		state = node->data;
+		if (state->file == file) {
+			return state;
+		}
+	}
+	return NULL;
+}
+
+static void
+link_info_cancel_one (NautilusDirectory *directory,
+		      LinkInfoReadState *state)
+{
+	g_cancellable_cancel (state->cancellable);
+	state->directory = NULL;
+	directory->details->link_info_read_states =
+		g_list_remove (directory->details->link_info_read_states, state);
+	async_job_end (directory, "link info");
+}
+
 static void
 link_info_cancel (NautilusDirectory *directory)
 {
-	if (directory->details->link_info_read_state != NULL) {
-		g_cancellable_cancel (directory->details->link_info_read_state->cancellable);
-		directory->details->link_info_read_state->directory = NULL;
-		directory->details->link_info_read_state = NULL;
-		async_job_end (directory, "link info");
+	while (directory->details->link_info_read_states != NULL) {
+		link_info_cancel_one (directory,
+				      directory->details->link_info_read_states->data);
+	}
+}
+
+static ThumbnailState *
+thumbnail_find_state (NautilusDirectory *directory,
+		      NautilusFile *file)
+{
+	GList *node;
+	ThumbnailState *state;
+
+	for (node = directory->details->thumbnail_states; node != NULL; node = node->next) {
+		state = node->data;
+		if (state->file == file) {
+			return state;
+		}
 	}
+	return NULL;
+}
+
+static void
+thumbnail_cancel_one (NautilusDirectory *directory,
+		      ThumbnailState *state)
+{
+	g_cancellable_cancel (state->cancellable);
+	state->directory = NULL;
+	directory->details->thumbnail_states =
+		g_list_remove (directory->details->thumbnail_states, state);
+	async_job_end (directory, "thumbnail");
 }
 
 static void
 thumbnail_cancel (NautilusDirectory *directory)
 {
-	if (directory->details->thumbnail_state != NULL) {
-		g_cancellable_cancel (directory->details->thumbnail_state->cancellable);
-		directory->details->thumbnail_state->directory = NULL;
-		directory->details->thumbnail_state = NULL;
-		async_job_end (directory, "thumbnail");
+	while (directory->details->thumbnail_states != NULL) {
+		thumbnail_cancel_one (directory,
+				      directory->details->thumbnail_states->data);
+	}
+}
+
+static MountState *
+mount_find_state (NautilusDirectory *directory,
+		  NautilusFile *file)
+{
+	GList *node;
+	MountState *state;
+
+	for (node = directory->details->mount_states; node != NULL; node = node->next) {
+		state = node->data;
+		if (state->file == file) {
+			return state;
+		}
 	}
+	return NULL;
+}
+
+static void
+mount_cancel_one (NautilusDirectory *directory,
+		  MountState *state)
+{
+	g_cancellable_cancel (state->cancellable);
+	state->directory = NULL;
+	directory->details->mount_states =
+		g_list_remove (directory->details->mount_states, state);
+	async_job_end (directory, "mount");
 }
 
 static void
 mount_cancel (NautilusDirectory *directory)
 {
-	if (directory->details->mount_state != NULL) {
-		g_cancellable_cancel (directory->details->mount_state->cancellable);
-		directory->details->mount_state->directory = NULL;
-		directory->details->mount_state = NULL;
-		async_job_end (directory, "mount");
+	while (directory->details->mount_states != NULL) {
+		mount_cancel_one (directory,
+				  directory->details->mount_states->data);
+	}
+}
+
+static FilesystemInfoState *
+filesystem_info_find_state (NautilusDirectory *directory,
+			    NautilusFile *file)
+{
+	GList *node;
+	FilesystemInfoState *state;
+
+	for (node = directory->details->filesystem_info_states; node != NULL; node = node->next) {
+		state = node->data;
+		if (state->file == file) {
+			return state;
+		}
 	}
+	return NULL;
 }
 
 static void
-file_info_cancel (NautilusDirectory *directory)
+filesystem_info_cancel_one (NautilusDirectory *directory,
+			    FilesystemInfoState *state)
+{
+	g_cancellable_cancel (state->cancellable);
+	state->directory = NULL;
+	directory->details->filesystem_info_states =
+		g_list_remove (directory->details->filesystem_info_states, state);
+	async_job_end (directory, "filesystem info");
+}
+
+static void
+filesystem_info_cancel (NautilusDirectory *directory)
+{
+	while (directory->details->filesystem_info_states != NULL) {
+		filesystem_info_cancel_one (directory,
+					    directory->details->filesystem_info_states->data);
+	}
+}
+
+static GetInfoState *
+file_info_find_state (NautilusDirectory *directory,
+		      NautilusFile *file)
+{
+	GList *node;
+	GetInfoState *state;
+
+	for (node = directory->details->get_info_in_progress; node != NULL; node = node->next) {
+		state = node->data;
+		if (state->file == file) {
+			return state;
+		}
+	}
+	return NULL;
+}
+
+static void
+file_info_cancel_one (NautilusDirectory *directory,
+		      GetInfoState *state)
 {
-	if (directory->details->get_info_in_progress != NULL) {
-		g_cancellable_cancel (directory->details->get_info_in_progress->cancellable);
-		directory->details->get_info_in_progress->directory = NULL;
-		directory->details->get_info_in_progress = NULL;
-		directory->details->get_info_file = NULL;
+	g_cancellable_cancel (state->cancellable);
+	state->directory = NULL;
+	directory->details->get_info_in_progress =
+		g_list_remove (directory->details->get_info_in_progress, state);
+	async_job_end (directory, "file info");
+}
 
-		async_job_end (directory, "file info");
+static void
+file_info_cancel (NautilusDirectory *directory)
+{
+	while (directory->details->get_info_in_progress != NULL) {
+		file_info_cancel_one (directory,
+				      directory->details->get_info_in_progress->data);
 	}
 }
 
@@ -598,6 +1190,48 @@ monitor_key_compare (gconstpointer a,
 	return 0;
 }
 
+/* The monitor and call_when_ready tables map a file, or NULL for
+ * the whole directory, to the list of requests made for it. Those
+ * lists only hold one entry per client, so finding a monitor is
+ * a hash lookup and a very short walk. Ready callbacks are found by
+ * their key in call_when_ready_keys instead, and remember their
+ * links, so they are never looked for in the lists.
+ */
+static GList *
+request_table_get (GHashTable *table,
+		   NautilusFile *file)
+{
+	return g_hash_table_lookup (table, file);
+}
+
+static GList *
+request_table_add (GHashTable *table,
+		   NautilusFile *file,
+		   gpointer data)
+{
+	GList *list;
+
+	list = g_list_prepend (request_table_get (table, file), data);
+	g_hash_table_insert (table, file, list);
+
+	return list;
+}
+
+static void
+request_table_remove_link (GHashTable *table,
+			   NautilusFile *file,
+			   GList *link)
+{
+	GList *list;
+
+	list = g_list_delete_link (request_table_get (table, file), link);
+	if (list == NULL) {
+		g_hash_table_remove (table, file);
+	} else {
+		g_hash_table_insert (table, file, list);
+	}
+}
+
 static GList *
 find_monitor (NautilusDirectory *directory,
 	      NautilusFile *file,
@@ -608,7 +1242,7 @@ find_monitor (NautilusDirectory *directory,
 	monitor.client = client;
 	monitor.file = file;
 
-	return g_list_find_custom (directory->details->monitor_list,
+	return g_list_find_custom (request_table_get (directory->details->monitor_hash, file),
 				   &monitor,
 				   monitor_key_compare);
 }
@@ -623,10 +1257,9 @@ remove_monitor_link (NautilusDirectory *directory,
 		monitor = link->data;
 		request_counter_remove_request (directory->details->monitor_counters,
 						monitor->request);
-		directory->details->monitor_list =
-			g_list_remove_link (directory->details->monitor_list, link);
-		g_free (monitor);
-		g_list_free_1 (link);
+		request_table_remove_link (directory->details->monitor_hash,
+					   monitor->file, link);
+		g_slice_free (Monitor, monitor);
 	}
 }
 
@@ -729,7 +1362,7 @@ nautilus_directory_monitor_add_internal (NautilusDirectory *directory,
 	remove_monitor (directory, file, client);
 
 	/* Add the new monitor. */
-	monitor = g_new (Monitor, 1);
+	monitor = g_slice_new (Monitor);
 	monitor->file = file;
 	monitor->monitor_hidden_files = monitor_hidden_files;
 	monitor->client = client;
@@ -738,8 +1371,7 @@ nautilus_directory_monitor_add_internal (NautilusDirectory *directory,
 	if (file == NULL) {
 		REQUEST_SET_TYPE (monitor->request, REQUEST_FILE_LIST);
 	}
-	directory->details->monitor_list =
-		g_list_prepend (directory->details->monitor_list, monitor);
+	request_table_add (directory->details->monitor_hash, file, monitor);
 	request_counter_add_request (directory->details->monitor_counters,
 				     monitor->request);
 
@@ -756,6 +1388,7 @@ nautilus_directory_monitor_add_internal (NautilusDirectory *directory,
 	 */
 	if (directory->details->monitor == NULL) {
 		directory->details->monitor = nautilus_monitor_directory (directory->details->location);
+		nautilus_deep_count_cache_set_monitored (directory->details->location, TRUE);
 	}
 	
 
@@ -809,7 +1442,7 @@ show_hidden_files_changed_callback (gpointer callback_data)
 }
 
 static gboolean
-should_skip_file (NautilusDirectory *directory, GFileInfo *info)
+get_show_hidden_files (void)
 {
 	static gboolean show_hidden_files_changed_callback_installed = FALSE;
 
@@ -826,7 +1459,13 @@ should_skip_file (NautilusDirectory *directory, GFileInfo *info)
 		show_hidden_files_changed_callback (NULL);
 	}
 
-	if (!show_hidden_files &&
+	return show_hidden_files;
+}
+
+static gboolean
+should_skip_file (NautilusDirectory *directory, GFileInfo *info)
+{
+	if (!get_show_hidden_files () &&
 	    (g_file_info_get_is_hidden (info) ||
 	     g_file_info_get_is_backup (info))) {
 		return TRUE;
@@ -835,6 +1474,42 @@ should_skip_file (NautilusDirectory *directory, GFileInfo *info)
 	return FALSE;
 }
 
+/* Info coming from the first loading pass has the fast content type only. */
+static gboolean
+info_is_partial (GFileInfo *info)
+{
+	return !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE) &&
+		g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+}
+
+static const char *
+get_content_type_from_info (GFileInfo *info)
+{
+	if (info_is_partial (info)) {
+		return g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+	}
+
+	return g_file_info_get_content_type (info);
+}
+
+static gboolean
+update_file_from_info (NautilusFile *file,
+		       GFileInfo *info)
+{
+	/* Don't replace complete info by the partial info of a reload,
+	 * that would drop the real MIME type, thumbnail and metadata
+	 * until the second pass. Take the fresh first-pass attributes
+	 * and leave the rest to the second pass.
+	 */
+	if (info_is_partial (info) &&
+	    file->details->got_file_info &&
+	    !file->details->file_info_is_partial) {
+		return nautilus_file_update_fast_info (file, info);
+	}
+
+	return nautilus_file_update_info (file, info);
+}
+
 static gboolean
 dequeue_pending_idle_callback (gpointer callback_data)
 {
@@ -844,21 +1519,24 @@ dequeue_pending_idle_callback (gpointer callback_data)
 	NautilusFile *file;
 	GList *changed_files, *added_files;
 	GFileInfo *file_info;
-	const char *mimetype, *name;
-	DirectoryLoadState *dir_load_state;
+	const char *name;
+	gint64 deadline;
+	guint n_handled;
 
 	directory = NAUTILUS_DIRECTORY (callback_data);
 
 	nautilus_directory_ref (directory);
 
-	nautilus_profile_start ("nitems %d", g_list_length (directory->details->pending_file_info));
-
 	directory->details->dequeue_pending_idle_id = 0;
 
 	/* Handle the files in the order we saw them. */
-	pending_file_info = g_list_reverse (directory->details->pending_file_info);
+	pending_file_info = g_list_concat (directory->details->dequeue_pending_file_info,
+					   g_list_reverse (directory->details->pending_file_info));
+	directory->details->dequeue_pending_file_info = NULL;
 	directory->details->pending_file_info = NULL;
 
+	nautilus_profile_start ("nitems %d", g_list_length (pending_file_info));
+
 	/* If we are no longer monitoring, then throw away these. */
 	if (!nautilus_directory_is_file_list_monitored (directory)) {
 		nautilus_directory_async_state_changed (directory);
@@ -868,33 +1546,25 @@ dequeue_pending_idle_callback (gpointer callback_data)
 	added_files = NULL;
 	changed_files = NULL;
 
-	dir_load_state = directory->details->directory_load_in_progress;
-	
-	/* Build a list of NautilusFile objects. */
-	for (node = pending_file_info; node != NULL; node = node->next) {
+	/* Build a list of NautilusFile objects, for as long as the
+	 * time slice allows; the rest is left for the next idle.
+	 */
+	deadline = g_get_monotonic_time () + DEQUEUE_PENDING_SLICE_USEC;
+	n_handled = 0;
+	while (pending_file_info != NULL) {
+		if (n_handled > 0 && n_handled % 16 == 0 &&
+		    g_get_monotonic_time () >= deadline) {
+			break;
+		}
+		n_handled++;
+
+		node = pending_file_info;
+		pending_file_info = g_list_remove_link (pending_file_info, node);
 		file_info = node->data;
+		g_list_free_1 (node);
 
 		name = g_file_info_get_name (file_info);
 		
-		/* Update the file count. */
-		/* FIXME bugzilla.gnome.org 45063: This could count a
-		 * file twice if we get it from both load_directory
-		 * and from new_files_callback. Not too hard to fix by
-		 * moving this into the actual callback instead of
-		 * waiting for the idle function.
-		 */
-		if (dir_load_state &&
-		    !should_skip_file (directory, file_info)) {
-			dir_load_state->load_file_count += 1;
-
-			/* Add the MIME type to the set. */
-			mimetype = g_file_info_get_content_type (file_info);
-			if (mimetype != NULL) {
-				istr_set_insert (dir_load_state->load_mime_list_hash,
-						 mimetype);
-			}
-		}
-		
 		/* check if the file already exists */
 		file = nautilus_directory_find_file_by_name (directory, name);
 		if (file != NULL) {
@@ -909,7 +1579,7 @@ dequeue_pending_idle_callback (gpointer callback_data)
 				nautilus_file_ref (file);
 				file->details->is_added = TRUE;
 				added_files = g_list_prepend (added_files, file);
-			} else if (nautilus_file_update_info (file, file_info)) {
+			} else if (update_file_from_info (file, file_info)) {
 				/* File changed, notify about the change. */
 				nautilus_file_ref (file);
 				changed_files = g_list_prepend (changed_files, file);
@@ -921,12 +1591,14 @@ dequeue_pending_idle_callback (gpointer callback_data)
 			file->details->is_added = TRUE;
 			added_files = g_list_prepend (added_files, file);
 		}
+
+		g_object_unref (file_info);
 	}
 
 	/* If we are done loading, then we assume that any unconfirmed
          * files are gone.
 	 */
-	if (directory->details->directory_loaded) {
+	if (directory->details->directory_loaded && pending_file_info == NULL) {
 		for (node = directory->details->file_list;
 		     node != NULL; node = next) {
 			file = NAUTILUS_FILE (node->data);
@@ -947,27 +1619,20 @@ dequeue_pending_idle_callback (gpointer callback_data)
 	nautilus_directory_emit_files_added (directory, added_files);
 	nautilus_file_list_free (added_files);
 
+	/* Signal handlers may have stopped the monitoring. */
+	if (pending_file_info != NULL &&
+	    nautilus_directory_is_file_list_monitored (directory)) {
+		directory->details->dequeue_pending_file_info = pending_file_info;
+		pending_file_info = NULL;
+		nautilus_directory_schedule_dequeue_pending (directory);
+		goto drain;
+	}
+
 	if (directory->details->directory_loaded &&
 	    !directory->details->directory_loaded_sent_notification) {
 		/* Send the done_loading signal. */
 		nautilus_directory_emit_done_loading (directory);
 
-		if (dir_load_state) {
-			file = dir_load_state->load_directory_file;
-			
-			file->details->directory_count = dir_load_state->load_file_count;
-			file->details->directory_count_is_up_to_date = TRUE;
-			file->details->got_directory_count = TRUE;
-
-			file->details->got_mime_list = TRUE;
-			file->details->mime_list_is_up_to_date = TRUE;
-			g_list_free_full (file->details->mime_list, g_free);
-			file->details->mime_list = istr_set_get_as_list
-				(dir_load_state->load_mime_list_hash);
-
-			nautilus_file_changed (file);
-		}
-		
 		nautilus_directory_async_state_changed (directory);
 
 		directory->details->directory_loaded_sent_notification = TRUE;
@@ -998,6 +1663,9 @@ static void
 directory_load_one (NautilusDirectory *directory,
 		    GFileInfo *info)
 {
+	DirectoryLoadState *dir_load_state;
+	const char *mimetype;
+
 	if (info == NULL) {
 		return;
 	}
@@ -1011,6 +1679,24 @@ directory_load_one (NautilusDirectory *directory,
 		
 		return;
 	}
+
+	/* Update the file count. */
+	/* FIXME bugzilla.gnome.org 45063: This could count a
+	 * file twice if we get it from both load_directory
+	 * and from new_files_callback.
+	 */
+	dir_load_state = directory->details->directory_load_in_progress;
+	if (dir_load_state &&
+	    !should_skip_file (directory, info)) {
+		dir_load_state->load_file_count += 1;
+
+		/* Add the MIME type to the set. */
+		mimetype = get_content_type_from_info (info);
+		if (mimetype != NULL) {
+			istr_set_insert (dir_load_state->load_mime_list_hash,
+					 mimetype);
+		}
+	}
 	
 	/* Arrange for the "loading" part of the work. */
 	g_object_ref (info);
@@ -1040,10 +1726,30 @@ directory_load_cancel (NautilusDirectory *directory)
 	}
 }
 
+static void
+deferred_info_cancel (NautilusDirectory *directory)
+{
+	DeferredInfoState *state;
+
+	state = directory->details->deferred_info_in_progress;
+	if (state != NULL) {
+		g_cancellable_cancel (state->cancellable);
+		state->directory = NULL;
+		directory->details->deferred_info_in_progress = NULL;
+		async_job_end (directory, "deferred info");
+	}
+
+	/* Files left with partial info are now completed one by one,
+	 * if anyone asks for them.
+	 */
+	directory->details->deferred_info_wanted = FALSE;
+}
+
 static void
 file_list_cancel (NautilusDirectory *directory)
 {
 	directory_load_cancel (directory);
+	deferred_info_cancel (directory);
 	
 	if (directory->details->dequeue_pending_idle_id != 0) {
 		g_source_remove (directory->details->dequeue_pending_idle_id);
@@ -1054,6 +1760,11 @@ file_list_cancel (NautilusDirectory *directory)
 		g_list_free_full (directory->details->pending_file_info, g_object_unref);
 		directory->details->pending_file_info = NULL;
 	}
+
+	if (directory->details->dequeue_pending_file_info != NULL) {
+		g_list_free_full (directory->details->dequeue_pending_file_info, g_object_unref);
+		directory->details->dequeue_pending_file_info = NULL;
+	}
 }
 
 static void
@@ -1061,6 +1772,8 @@ directory_load_done (NautilusDirectory *directory,
 		     GError *error)
 {
 	GList *node;
+	DirectoryLoadState *dir_load_state;
+	NautilusFile *file;
 
 	nautilus_profile_start (NULL);
         g_object_ref (directory);
@@ -1083,7 +1796,30 @@ directory_load_done (NautilusDirectory *directory,
 		nautilus_directory_emit_load_error (directory, error);
 	}
 
-	/* Call the idle function right away. */
+	/* The item count and MIME list are complete now, even if not
+	 * all the files have been added yet.
+	 */
+	dir_load_state = directory->details->directory_load_in_progress;
+	if (dir_load_state) {
+		file = dir_load_state->load_directory_file;
+
+		file->details->directory_count = dir_load_state->load_file_count;
+		file->details->directory_count_is_up_to_date = TRUE;
+		file->details->got_directory_count = TRUE;
+
+		file->details->got_mime_list = TRUE;
+		file->details->mime_list_is_up_to_date = TRUE;
+		g_list_free_full (file->details->mime_list, g_free);
+		file->details->mime_list = istr_set_get_as_list
+			(dir_load_state->load_mime_list_hash);
+
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_OTHER);
+		nautilus_file_changed (file);
+	}
+
+	/* Start adding the files right away, big directories get
+	 * finished in later idles.
+	 */
 	if (directory->details->dequeue_pending_idle_id != 0) {
 		g_source_remove (directory->details->dequeue_pending_idle_id);
 	}
@@ -1107,9 +1843,16 @@ nautilus_directory_monitor_remove_internal (NautilusDirectory *directory,
 	remove_monitor (directory, file, client);
 
 	if (directory->details->monitor != NULL
-	    && directory->details->monitor_list == NULL) {
+	    && g_hash_table_size (directory->details->monitor_hash) == 0) {
 		nautilus_monitor_cancel (directory->details->monitor);
 		directory->details->monitor = NULL;
+		nautilus_deep_count_cache_set_monitored (directory->details->location, FALSE);
+
+		/* Nobody is showing these files anymore, so don't keep
+		 * their sort keys around until they're sorted again.
+		 */
+		g_list_foreach (directory->details->file_list,
+				(GFunc) nautilus_file_forget_collation_keys, NULL);
 	}
 
 	/* XXX - do we need to remove anything from the work queue? */
@@ -1121,26 +1864,20 @@ FileMonitors *
 nautilus_directory_remove_file_monitors (NautilusDirectory *directory,
 					 NautilusFile *file)
 {
-	GList *result, **list, *node, *next;
+	GList *result, *node;
 	Monitor *monitor;
 
 	g_assert (NAUTILUS_IS_DIRECTORY (directory));
 	g_assert (NAUTILUS_IS_FILE (file));
 	g_assert (file->details->directory == directory);
 
-	result = NULL;
+	result = request_table_get (directory->details->monitor_hash, file);
+	g_hash_table_remove (directory->details->monitor_hash, file);
 
-	list = &directory->details->monitor_list;
-	for (node = directory->details->monitor_list; node != NULL; node = next) {
-		next = node->next;
+	for (node = result; node != NULL; node = node->next) {
 		monitor = node->data;
-
-		if (monitor->file == file) {
-			*list = g_list_remove_link (*list, node);
-			result = g_list_concat (node, result);
-			request_counter_remove_request (directory->details->monitor_counters,
-							monitor->request);
-		}
+		request_counter_remove_request (directory->details->monitor_counters,
+						monitor->request);
 	}
 
 	/* XXX - do we need to remove anything from the work queue? */
@@ -1155,7 +1892,6 @@ nautilus_directory_add_file_monitors (NautilusDirectory *directory,
 				      NautilusFile *file,
 				      FileMonitors *monitors)
 {
-	GList **list;
 	GList *l;
 	Monitor *monitor;
 
@@ -1169,12 +1905,14 @@ nautilus_directory_add_file_monitors (NautilusDirectory *directory,
 
 	for (l = (GList *)monitors; l != NULL; l = l->next) {
 		monitor = l->data;
+		g_assert (monitor->file == file);
 		request_counter_add_request (directory->details->monitor_counters,
 					     monitor->request);
 	}
 
-	list = &directory->details->monitor_list;
-	*list = g_list_concat (*list, (GList *) monitors);
+	g_hash_table_insert (directory->details->monitor_hash, file,
+			     g_list_concat (request_table_get (directory->details->monitor_hash, file),
+					    (GList *) monitors));
 
 	nautilus_directory_add_file_to_work_queue (directory, file);
 
@@ -1225,19 +1963,60 @@ ready_callback_key_compare (gconstpointer a, gconstpointer b)
 	return 0;
 }
 
-static int
-ready_callback_key_compare_only_active (gconstpointer a, gconstpointer b)
+static guint
+ready_callback_key_hash (gconstpointer key)
 {
-	const ReadyCallback *callback_a;
+	const ReadyCallback *callback;
+	gconstpointer function;
 
-	callback_a = a;
+	callback = key;
+	if (callback->file == NULL) {
+		function = (void *) callback->callback.directory;
+	} else {
+		function = (void *) callback->callback.file;
+	}
 
-	/* Non active callbacks never match */
-	if (!callback_a->active) {
-		return -1;
+	return g_direct_hash (callback->file) ^
+		g_direct_hash (function) ^
+		g_direct_hash (callback->callback_data);
+}
+
+static gboolean
+ready_callback_key_equal (gconstpointer a,
+			  gconstpointer b)
+{
+	return ready_callback_key_compare (a, b) == 0;
+}
+
+/* The callbacks with the same file, callback and data as @key. */
+static GList *
+ready_callback_key_lookup (NautilusDirectory *directory,
+			   const ReadyCallback *key)
+{
+	if (directory->details->call_when_ready_keys == NULL) {
+		return NULL;
+	}
+
+	return g_hash_table_lookup (directory->details->call_when_ready_keys, key);
+}
+
+/* A callback is only added if there's no active one with its key, and
+ * the new one goes first, so only the first one can be active.
+ */
+static ReadyCallback *
+ready_callback_find_active (NautilusDirectory *directory,
+			    const ReadyCallback *key)
+{
+	GList *callbacks;
+	ReadyCallback *callback;
+
+	callbacks = ready_callback_key_lookup (directory, key);
+	if (callbacks == NULL) {
+		return NULL;
 	}
 
-	return ready_callback_key_compare (a, b);
+	callback = callbacks->data;
+	return callback->active ? callback : NULL;
 }
 
 static void
@@ -1278,7 +2057,7 @@ nautilus_directory_call_when_ready_internal (NautilusDirectory *directory,
 					     NautilusFileCallback file_callback,
 					     gpointer callback_data)
 {
-	ReadyCallback callback;
+	ReadyCallback callback, *new_callback;
 
 	g_assert (directory == NULL || NAUTILUS_IS_DIRECTORY (directory));
 	g_assert (file == NULL || NAUTILUS_IS_FILE (file));
@@ -1286,6 +2065,9 @@ nautilus_directory_call_when_ready_internal (NautilusDirectory *directory,
 
 	/* Construct a callback object. */
 	callback.active = TRUE;
+	callback.ready_link = NULL;
+	callback.waiting_for = REQUEST_TYPE_LAST;
+	callback.waiting_link = NULL;
 	callback.file = file;
 	if (file == NULL) {
 		callback.callback.directory = directory_callback;
@@ -1305,9 +2087,7 @@ nautilus_directory_call_when_ready_internal (NautilusDirectory *directory,
 	}
 
 	/* Check if the callback is already there. */
-	if (g_list_find_custom (directory->details->call_when_ready_list,
-				&callback,
-				ready_callback_key_compare_only_active) != NULL) {
+	if (ready_callback_find_active (directory, &callback) != NULL) {
 		if (file_callback != NULL && directory_callback != NULL) {
 			g_warning ("tried to add a new callback while an old one was pending");
 		}
@@ -1316,11 +2096,24 @@ nautilus_directory_call_when_ready_internal (NautilusDirectory *directory,
 	}
 
 	/* Add the new callback to the list. */
-	directory->details->call_when_ready_list = g_list_prepend
-		(directory->details->call_when_ready_list,
-		 g_memdup (&callback, sizeof (callback)));
+	if (directory->details->call_when_ready_keys == NULL) {
+		directory->details->call_when_ready_keys =
+			g_hash_table_new (ready_callback_key_hash,
+					  ready_callback_key_equal);
+	}
+	new_callback = g_slice_dup (ReadyCallback, &callback);
+	new_callback->table_link = request_table_add (directory->details->call_when_ready_hash,
+						      file, new_callback);
+	new_callback->key_link = g_list_prepend (ready_callback_key_lookup (directory, new_callback),
+						 new_callback);
+	/* The key must stay valid, so it is always the first callback. */
+	g_hash_table_replace (directory->details->call_when_ready_keys,
+			      new_callback, new_callback->key_link);
 	request_counter_add_request (directory->details->call_when_ready_counters,
 				     callback.request);
+	g_queue_push_tail (&directory->details->waiting_callbacks[REQUEST_TYPE_LAST],
+			   new_callback);
+	new_callback->waiting_link = directory->details->waiting_callbacks[REQUEST_TYPE_LAST].tail;
 
 	/* Put the callback file or all the files on the work queue. */
 	if (file != NULL) {
@@ -1329,7 +2122,8 @@ nautilus_directory_call_when_ready_internal (NautilusDirectory *directory,
 		add_all_files_to_work_queue (directory);
 	}
 
-	nautilus_directory_async_state_changed (directory);
+	/* Nothing else changed, only the new callback needs checking. */
+	async_service_loop (directory);
 }
 
 gboolean      
@@ -1346,30 +2140,45 @@ nautilus_directory_check_if_ready_internal (NautilusDirectory *directory,
 }
 
 static void
-remove_callback_link_keep_data (NautilusDirectory *directory,
-				GList *link)
-{
-	ReadyCallback *callback;
-
-	callback = link->data;
-	
-	directory->details->call_when_ready_list = g_list_remove_link
-		(directory->details->call_when_ready_list, link);
+remove_callback_keep_data (NautilusDirectory *directory,
+			   ReadyCallback *callback)
+{
+	GList *callbacks;
+
+	if (callback->ready_link != NULL) {
+		g_queue_delete_link (&directory->details->ready_callbacks,
+				     callback->ready_link);
+		callback->ready_link = NULL;
+	}
+	if (callback->waiting_link != NULL) {
+		g_queue_delete_link (&directory->details->waiting_callbacks[callback->waiting_for],
+				     callback->waiting_link);
+		callback->waiting_link = NULL;
+	}
+	request_table_remove_link (directory->details->call_when_ready_hash,
+				   callback->file, callback->table_link);
+	callback->table_link = NULL;
+
+	callbacks = g_list_delete_link (ready_callback_key_lookup (directory, callback),
+					callback->key_link);
+	callback->key_link = NULL;
+	if (callbacks == NULL) {
+		g_hash_table_remove (directory->details->call_when_ready_keys, callback);
+	} else {
+		g_hash_table_replace (directory->details->call_when_ready_keys,
+				      callbacks->data, callbacks);
+	}
 	
 	request_counter_remove_request (directory->details->call_when_ready_counters,
 					callback->request);
-	g_list_free_1 (link);
 }
 
 static void
-remove_callback_link (NautilusDirectory *directory,
-		      GList *link)
+remove_callback (NautilusDirectory *directory,
+		 ReadyCallback *callback)
 {
-	ReadyCallback *callback;
-	
-	callback = link->data;
-	remove_callback_link_keep_data (directory, link);
-	g_free (callback);
+	remove_callback_keep_data (directory, callback);
+	g_slice_free (ReadyCallback, callback);
 }
 
 void
@@ -1380,7 +2189,7 @@ nautilus_directory_cancel_callback_internal (NautilusDirectory *directory,
 					     gpointer callback_data)
 {
 	ReadyCallback callback;
-	GList *node;
+	GList *callbacks;
 
 	if (directory == NULL) {
 		return;
@@ -1401,16 +2210,11 @@ nautilus_directory_cancel_callback_internal (NautilusDirectory *directory,
 	callback.callback_data = callback_data;
 
 	/* Remove all queued callback from the list (including non-active). */
-	do {
-		node = g_list_find_custom (directory->details->call_when_ready_list,
-					   &callback,
-					   ready_callback_key_compare);
-		if (node != NULL) {
-			remove_callback_link (directory, node);
-			
-			nautilus_directory_async_state_changed (directory);
-		}
-	} while (node != NULL);
+	while ((callbacks = ready_callback_key_lookup (directory, &callback)) != NULL) {
+		remove_callback (directory, callbacks->data);
+
+		nautilus_directory_async_state_changed (directory);
+	}
 }
 
 static void
@@ -1496,52 +2300,102 @@ nautilus_directory_get_info_for_new_files (NautilusDirectory *directory,
 				  state);
 }
 
+static void
+monitor_free (gpointer data)
+{
+	g_slice_free (Monitor, data);
+}
+
+static void
+ready_callback_free (gpointer data)
+{
+	g_slice_free (ReadyCallback, data);
+}
+
+/* Frees the monitors and ready callbacks left when the directory
+ * goes away.
+ */
+void
+nautilus_directory_free_requests (NautilusDirectory *directory)
+{
+	GHashTableIter iter;
+	GList *list;
+	int i;
+
+	if (g_hash_table_size (directory->details->monitor_hash) != 0) {
+		g_warning ("destroying a NautilusDirectory while it's being monitored");
+		g_hash_table_iter_init (&iter, directory->details->monitor_hash);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &list)) {
+			g_list_free_full (list, monitor_free);
+		}
+		g_hash_table_remove_all (directory->details->monitor_hash);
+	}
+
+	if (directory->details->call_when_ready_keys != NULL) {
+		g_hash_table_iter_init (&iter, directory->details->call_when_ready_keys);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &list)) {
+			g_list_free (list);
+		}
+		g_hash_table_destroy (directory->details->call_when_ready_keys);
+		directory->details->call_when_ready_keys = NULL;
+	}
+	g_hash_table_iter_init (&iter, directory->details->call_when_ready_hash);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &list)) {
+		g_list_free_full (list, ready_callback_free);
+	}
+	g_hash_table_remove_all (directory->details->call_when_ready_hash);
+	g_queue_clear (&directory->details->ready_callbacks);
+	for (i = 0; i <= REQUEST_TYPE_LAST; i++) {
+		g_queue_clear (&directory->details->waiting_callbacks[i]);
+	}
+}
+
 void
 nautilus_async_destroying_file (NautilusFile *file)
 {
 	NautilusDirectory *directory;
 	gboolean changed;
-	GList *node, *next;
+	GList *node;
 	ReadyCallback *callback;
-	Monitor *monitor;
+	DirectoryCountState *count_state;
+	GetInfoState *get_info_state;
+	LinkInfoReadState *link_info_state;
+	ThumbnailState *thumbnail_state;
+	MountState *mount_state;
+	FilesystemInfoState *filesystem_info_state;
 
 	directory = file->details->directory;
 	changed = FALSE;
 
 	/* Check for callbacks. */
-	for (node = directory->details->call_when_ready_list; node != NULL; node = next) {
-		next = node->next;
+	while ((node = request_table_get (directory->details->call_when_ready_hash, file)) != NULL) {
 		callback = node->data;
 
-		if (callback->file == file) {
-			/* Client should have cancelled callback. */
-			if (callback->active) {
-				g_warning ("destroyed file has call_when_ready pending");
-			}
-			remove_callback_link (directory, node);
-			changed = TRUE;
+		/* Client should have cancelled callback. */
+		if (callback->active) {
+			g_warning ("destroyed file has call_when_ready pending");
 		}
+		remove_callback (directory, callback);
+		changed = TRUE;
+	}
+	if (directory->details->changed_files != NULL) {
+		g_hash_table_remove (directory->details->changed_files, file);
 	}
 
 	/* Check for monitors. */
-	for (node = directory->details->monitor_list; node != NULL; node = next) {
-		next = node->next;
-		monitor = node->data;
-
-		if (monitor->file == file) {
-			/* Client should have removed monitor earlier. */
-			g_warning ("destroyed file still being monitored");
-			remove_monitor_link (directory, node);
-			changed = TRUE;
-		}
+	while ((node = request_table_get (directory->details->monitor_hash, file)) != NULL) {
+		/* Client should have removed monitor earlier. */
+		g_warning ("destroyed file still being monitored");
+		remove_monitor_link (directory, node);
+		changed = TRUE;
 	}
 
 	/* Check if it's a file that's currently being worked on.
 	 * If so, make that NULL so it gets canceled right away.
 	 */
-	if (directory->details->count_in_progress != NULL &&
-	    directory->details->count_in_progress->count_file == file) {
-		directory->details->count_in_progress->count_file = NULL;
+	count_state = directory_count_find_state (directory, file);
+	if (count_state != NULL) {
+		count_state->count_file = NULL;
 		changed = TRUE;
 	}
 	if (directory->details->deep_count_file == file) {
@@ -1553,13 +2407,14 @@ nautilus_async_destroying_file (NautilusFile *file)
 		directory->details->mime_list_in_progress->mime_list_file = NULL;
 		changed = TRUE;
 	}
-	if (directory->details->get_info_file == file) {
-		directory->details->get_info_file = NULL;
+	get_info_state = file_info_find_state (directory, file);
+	if (get_info_state != NULL) {
+		get_info_state->file = NULL;
 		changed = TRUE;
 	}
-	if (directory->details->link_info_read_state != NULL &&
-	    directory->details->link_info_read_state->file == file) {
-		directory->details->link_info_read_state->file = NULL;
+	link_info_state = link_info_find_state (directory, file);
+	if (link_info_state != NULL) {
+		link_info_state->file = NULL;
 		changed = TRUE;
 	}
 	if (directory->details->extension_info_file == file) {
@@ -1567,21 +2422,21 @@ nautilus_async_destroying_file (NautilusFile *file)
 		changed = TRUE;
 	}
 
-	if (directory->details->thumbnail_state != NULL &&
-	    directory->details->thumbnail_state->file ==  file) {
-		directory->details->thumbnail_state->file = NULL;
+	thumbnail_state = thumbnail_find_state (directory, file);
+	if (thumbnail_state != NULL) {
+		thumbnail_state->file = NULL;
 		changed = TRUE;
 	}
 	
-	if (directory->details->mount_state != NULL &&
-	    directory->details->mount_state->file ==  file) {
-		directory->details->mount_state->file = NULL;
+	mount_state = mount_find_state (directory, file);
+	if (mount_state != NULL) {
+		mount_state->file = NULL;
 		changed = TRUE;
 	}
 
-	if (directory->details->filesystem_info_state != NULL &&
-	    directory->details->filesystem_info_state->file == file) {
-		directory->details->filesystem_info_state->file = NULL;
+	filesystem_info_state = filesystem_info_find_state (directory, file);
+	if (filesystem_info_state != NULL) {
+		filesystem_info_state->file = NULL;
 		changed = TRUE;
 	}
 	
@@ -1608,10 +2463,20 @@ should_get_directory_count_now (NautilusFile *file)
 static gboolean
 lacks_info (NautilusFile *file)
 {
-	return !file->details->file_info_is_up_to_date
+	return (!file->details->file_info_is_up_to_date ||
+		file->details->file_info_is_partial)
 		&& !file->details->is_gone;
 }
 
+static gboolean
+should_get_file_info_now (NautilusFile *file)
+{
+	/* Partial info is completed by the second loading pass. */
+	return lacks_info (file)
+		&& !(file->details->file_info_is_partial &&
+		     file->details->directory->details->deferred_info_wanted);
+}
+
 static gboolean
 lacks_filesystem_info (NautilusFile *file)
 {
@@ -1656,14 +2521,14 @@ lacks_link_info (NautilusFile *file)
 static gboolean
 lacks_extension_info (NautilusFile *file)
 {
-	return file->details->pending_info_providers != NULL;
+	return NAUTILUS_FILE_PEEK (file, extension_details, pending_info_providers, NULL) != NULL;
 }
 
 static gboolean
 lacks_thumbnail (NautilusFile *file)
 {
 	return nautilus_file_should_show_thumbnail (file) &&
-		file->details->thumbnail_path != NULL &&
+		NAUTILUS_FILE_PEEK (file, thumbnail_details, path, NULL) != NULL &&
 		!file->details->thumbnail_is_up_to_date;
 }
 
@@ -1704,73 +2569,83 @@ has_problem (NautilusDirectory *directory, NautilusFile *file, FileCheck problem
 	return FALSE;
 }
 
-static gboolean
-request_is_satisfied (NautilusDirectory *directory,
-		      NautilusFile *file,
-		      Request request)
+/* Returns the first request type not satisfied yet, or
+ * REQUEST_TYPE_LAST if the request is satisfied.
+ */
+static RequestType
+request_get_unsatisfied_type (NautilusDirectory *directory,
+			      NautilusFile *file,
+			      Request request)
 {
 	if (REQUEST_WANTS_TYPE (request, REQUEST_FILE_LIST) &&
 	    !(directory->details->directory_loaded &&
 				    directory->details->directory_loaded_sent_notification)) {
-		return FALSE;
+		return REQUEST_FILE_LIST;
 	}
 
 	if (REQUEST_WANTS_TYPE (request, REQUEST_DIRECTORY_COUNT)) {
 		if (has_problem (directory, file, lacks_directory_count)) {
-			return FALSE;
+			return REQUEST_DIRECTORY_COUNT;
 		}
 	}
 
 	if (REQUEST_WANTS_TYPE (request, REQUEST_FILE_INFO)) {
 		if (has_problem (directory, file, lacks_info)) {
-			return FALSE;
+			return REQUEST_FILE_INFO;
 		}
 	}
 
 	if (REQUEST_WANTS_TYPE (request, REQUEST_FILESYSTEM_INFO)) {
 		if (has_problem (directory, file, lacks_filesystem_info)) {
-			return FALSE;
+			return REQUEST_FILESYSTEM_INFO;
 		}
 	}
 
 	if (REQUEST_WANTS_TYPE (request, REQUEST_DEEP_COUNT)) {
 		if (has_problem (directory, file, lacks_deep_count)) {
-			return FALSE;
+			return REQUEST_DEEP_COUNT;
 		}
 	}
 
 	if (REQUEST_WANTS_TYPE (request, REQUEST_THUMBNAIL)) {
 		if (has_problem (directory, file, lacks_thumbnail)) {
-			return FALSE;
+			return REQUEST_THUMBNAIL;
 		}
 	}
 	
 	if (REQUEST_WANTS_TYPE (request, REQUEST_MOUNT)) {
 		if (has_problem (directory, file, lacks_mount)) {
-			return FALSE;
+			return REQUEST_MOUNT;
 		}
 	}
 	
 	if (REQUEST_WANTS_TYPE (request, REQUEST_MIME_LIST)) {
 		if (has_problem (directory, file, lacks_mime_list)) {
-			return FALSE;
+			return REQUEST_MIME_LIST;
 		}
 	}
 
 	if (REQUEST_WANTS_TYPE (request, REQUEST_LINK_INFO)) {
 		if (has_problem (directory, file, lacks_link_info)) {
-			return FALSE;
+			return REQUEST_LINK_INFO;
 		}
 	}
 
-	return TRUE;
+	return REQUEST_TYPE_LAST;
+}
+
+static gboolean
+request_is_satisfied (NautilusDirectory *directory,
+		      NautilusFile *file,
+		      Request request)
+{
+	return request_get_unsatisfied_type (directory, file, request) == REQUEST_TYPE_LAST;
 }
 
 static gboolean
 call_ready_callbacks_at_idle (gpointer callback_data)
 {
 	NautilusDirectory *directory;
-	GList *node, *next;
 	ReadyCallback *callback;
 
 	directory = NAUTILUS_DIRECTORY (callback_data);
@@ -1778,28 +2653,16 @@ call_ready_callbacks_at_idle (gpointer callback_data)
 
 	nautilus_directory_ref (directory);
 	
-	callback = NULL;
-	while (1) {
-		/* Check if any callbacks are non-active and call them if they are. */
-		for (node = directory->details->call_when_ready_list;
-		     node != NULL; node = next) {
-			next = node->next;
-			callback = node->data;
-			if (!callback->active) {
-				/* Non-active, remove and call */
-				break;
-			}
-		}
-		if (node == NULL) {
-			break;
-		}
-
+	/* Call the non-active callbacks in the order they got ready. A
+	 * callback may cancel others, so take them one at a time.
+	 */
+	while ((callback = g_queue_peek_head (&directory->details->ready_callbacks)) != NULL) {
 		/* Callbacks are one-shots, so remove it now. */
-		remove_callback_link_keep_data (directory, node);
+		remove_callback_keep_data (directory, callback);
 		
 		/* Call the callback. */
 		ready_callback_call (directory, callback);
-		g_free (callback);
+		g_slice_free (ReadyCallback, callback);
 	}
 
 	nautilus_directory_async_state_changed (directory);
@@ -1818,64 +2681,141 @@ schedule_call_ready_callbacks (NautilusDirectory *directory)
 	}
 }
 
-/* Marks all callbacks that are ready as non-active and
- * calls them at idle time, unless they are removed
- * before then */
+/* Moves an active callback to the queue for the request type it
+ * still waits for, or marks it as non-active and queues it to be
+ * called at idle time if it is satisfied.
+ */
 static gboolean
-call_ready_callbacks (NautilusDirectory *directory)
+ready_callback_check (NautilusDirectory *directory,
+		      ReadyCallback *callback)
 {
-	gboolean found_any;
-	GList *node, *next;
-	ReadyCallback *callback;
+	GList *link;
 
-	found_any = FALSE;
-	
-	/* Check if any callbacks are satisifed and mark them for call them if they are. */
-	for (node = directory->details->call_when_ready_list;
-	     node != NULL; node = next) {
-		next = node->next;
-		callback = node->data;
-		if (callback->active &&
-		    request_is_satisfied (directory, callback->file, callback->request)) {
-			callback->active = FALSE;
-			found_any = TRUE;
-		}
-	}
-	
-	if (found_any) {
-		schedule_call_ready_callbacks (directory);
+	link = callback->waiting_link;
+	g_queue_unlink (&directory->details->waiting_callbacks[callback->waiting_for], link);
+
+	callback->waiting_for = request_get_unsatisfied_type
+		(directory, callback->file, callback->request);
+	if (callback->waiting_for != REQUEST_TYPE_LAST) {
+		g_queue_push_tail_link (&directory->details->waiting_callbacks[callback->waiting_for],
+					link);
+		return FALSE;
 	}
-	
-	return found_any;
+
+	g_list_free_1 (link);
+	callback->waiting_link = NULL;
+	callback->active = FALSE;
+	g_queue_push_tail (&directory->details->ready_callbacks, callback);
+	callback->ready_link = directory->details->ready_callbacks.tail;
+
+	return TRUE;
 }
 
-gboolean
-nautilus_directory_has_active_request_for_file (NautilusDirectory *directory,
-						NautilusFile *file)
+static gboolean
+check_file_callbacks (NautilusDirectory *directory,
+		      NautilusFile *file,
+		      Request changed)
 {
+	gboolean found_any;
 	GList *node;
 	ReadyCallback *callback;
-	Monitor *monitor;
 
-	for (node = directory->details->call_when_ready_list;
+	found_any = FALSE;
+	for (node = request_table_get (directory->details->call_when_ready_hash, file);
 	     node != NULL; node = node->next) {
 		callback = node->data;
-		if (callback->file == file ||
-		    callback->file == NULL) {
-			return TRUE;
+		if (callback->active &&
+		    REQUEST_WANTS_TYPE (changed, callback->waiting_for) &&
+		    ready_callback_check (directory, callback)) {
+			found_any = TRUE;
 		}
 	}
 
-	for (node = directory->details->monitor_list;
-	     node != NULL; node = node->next) {
-		monitor = node->data;
-		if (monitor->file == file ||
-		    monitor->file == NULL) {
-			return TRUE;
+	return found_any;
+}
+
+/* Marks all callbacks that are ready as non-active and
+ * calls them at idle time, unless they are removed
+ * before then. Only the callbacks waiting for a request
+ * that changed since the last time are checked.
+ */
+static gboolean
+call_ready_callbacks (NautilusDirectory *directory)
+{
+	gboolean found_any;
+	Request changed_requests, changed_for_all;
+	GHashTable *changed_files;
+	GHashTableIter iter;
+	gpointer file, changed;
+	GQueue *queue;
+	guint i, n;
+
+	found_any = FALSE;
+
+	/* Take the changes, checking may report new ones. */
+	changed_requests = directory->details->changed_requests;
+	changed_files = directory->details->changed_files;
+	directory->details->changed_requests = 0;
+	directory->details->changed_files = NULL;
+
+	/* New callbacks have not been checked yet. */
+	queue = &directory->details->waiting_callbacks[REQUEST_TYPE_LAST];
+	while (queue->head != NULL) {
+		if (ready_callback_check (directory, queue->head->data)) {
+			found_any = TRUE;
 		}
 	}
 
-	return FALSE;
+	for (i = 0; i < REQUEST_TYPE_LAST; i++) {
+		if (!REQUEST_WANTS_TYPE (changed_requests, i)) {
+			continue;
+		}
+		/* Callbacks still waiting go back to the tail, so only
+		 * look at the ones that were there to begin with.
+		 */
+		queue = &directory->details->waiting_callbacks[i];
+		for (n = queue->length; n > 0; n--) {
+			if (ready_callback_check (directory, queue->head->data)) {
+				found_any = TRUE;
+			}
+		}
+	}
+
+	if (changed_files != NULL) {
+		/* A file's change also matters to the callbacks for
+		 * all the files.
+		 */
+		changed_for_all = 0;
+		g_hash_table_iter_init (&iter, changed_files);
+		while (g_hash_table_iter_next (&iter, &file, &changed)) {
+			changed_for_all |= GPOINTER_TO_UINT (changed);
+			if (check_file_callbacks (directory, file,
+						  GPOINTER_TO_UINT (changed) & ~changed_requests)) {
+				found_any = TRUE;
+			}
+		}
+		if (check_file_callbacks (directory, NULL,
+					  changed_for_all & ~changed_requests)) {
+			found_any = TRUE;
+		}
+		g_hash_table_destroy (changed_files);
+	}
+	
+	if (found_any) {
+		schedule_call_ready_callbacks (directory);
+	}
+	
+	return found_any;
+}
+
+gboolean
+nautilus_directory_has_active_request_for_file (NautilusDirectory *directory,
+						NautilusFile *file)
+{
+	return request_table_get (directory->details->call_when_ready_hash, file) != NULL
+		|| request_table_get (directory->details->call_when_ready_hash, NULL) != NULL
+		|| request_table_get (directory->details->monitor_hash, file) != NULL
+		|| request_table_get (directory->details->monitor_hash, NULL) != NULL;
 }
 
 
@@ -1923,6 +2863,7 @@ directory_load_state_free (DirectoryLoadState *state)
 		}
 		g_object_unref (state->enumerator);
 	}
+	nautilus_local_enumerator_free (state->local_enumerator);
 
 	if (state->load_mime_list_hash != NULL) {
 		istr_set_destroy (state->load_mime_list_hash);
@@ -1932,6 +2873,76 @@ directory_load_state_free (DirectoryLoadState *state)
 	g_free (state);
 }
 
+static void
+free_file_info_list (gpointer data)
+{
+	g_list_free_full (data, g_object_unref);
+}
+
+static void
+next_files_thread (GTask *task,
+		   gpointer source_object,
+		   gpointer task_data,
+		   GCancellable *cancellable)
+{
+	GList *files, *l;
+	GError *error;
+
+	error = NULL;
+	if (task_data != NULL) {
+		files = nautilus_local_enumerator_next_files (task_data,
+							      DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+							      cancellable, &error);
+	} else {
+		files = g_file_enumerator_next_files (G_FILE_ENUMERATOR (source_object),
+						      DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+						      cancellable, &error);
+	}
+
+	if (files == NULL && error != NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+	g_clear_error (&error);
+
+	/* Do the CPU work of setting up the files here, rather than
+	 * in the main loop when they get added.
+	 */
+	for (l = files; l != NULL; l = l->next) {
+		nautilus_file_info_precompute (l->data);
+	}
+
+	g_task_return_pointer (task, files, free_file_info_list);
+}
+
+/* Like g_file_enumerator_next_files_async(), but also prepares the
+ * infos for nautilus_file_update_info() in the worker thread.
+ * Reads from @local_enumerator instead of @enumerator when it is set.
+ */
+static void
+next_files_precomputed_async (GFileEnumerator *enumerator,
+			      NautilusLocalEnumerator *local_enumerator,
+			      int io_priority,
+			      GCancellable *cancellable,
+			      GAsyncReadyCallback callback,
+			      gpointer user_data)
+{
+	GTask *task;
+
+	task = g_task_new (enumerator, cancellable, callback, user_data);
+	g_task_set_task_data (task, local_enumerator, NULL);
+	g_task_set_priority (task, io_priority);
+	g_task_run_in_thread (task, next_files_thread);
+	g_object_unref (task);
+}
+
+static GList *
+next_files_precomputed_finish (GAsyncResult *res,
+			       GError **error)
+{
+	return g_task_propagate_pointer (G_TASK (res), error);
+}
+
 static void
 more_files_callback (GObject *source_object,
 		     GAsyncResult *res,
@@ -1957,8 +2968,7 @@ more_files_callback (GObject *source_object,
 	g_assert (directory->details->directory_load_in_progress == state);
 
 	error = NULL;
-	files = g_file_enumerator_next_files_finish (state->enumerator,
-						     res, &error);
+	files = next_files_precomputed_finish (res, &error);
 
 	for (l = files; l != NULL; l = l->next) {
 		info = l->data;
@@ -1970,12 +2980,12 @@ more_files_callback (GObject *source_object,
 		directory_load_done (directory, error);
 		directory_load_state_free (state);
 	} else {
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_DEFAULT,
-						    state->cancellable,
-						    more_files_callback,
-						    state);
+		next_files_precomputed_async (state->enumerator,
+					      state->local_enumerator,
+					      G_PRIORITY_DEFAULT,
+					      state->cancellable,
+					      more_files_callback,
+					      state);
 	}
 
 	nautilus_directory_unref (directory);
@@ -2015,15 +3025,249 @@ enumerate_children_callback (GObject *source_object,
 		return;
 	} else {
 		state->enumerator = enumerator;
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_DEFAULT,
-						    state->cancellable,
-						    more_files_callback,
-						    state);
+		next_files_precomputed_async (state->enumerator,
+					      state->local_enumerator,
+					      G_PRIORITY_DEFAULT,
+					      state->cancellable,
+					      more_files_callback,
+					      state);
+	}
+}
+
+static void
+local_enumerator_open_thread (GTask *task,
+			      gpointer source_object,
+			      gpointer task_data,
+			      GCancellable *cancellable)
+{
+	NautilusLocalEnumerator *enumerator;
+	GError *error;
+
+	error = NULL;
+	enumerator = nautilus_local_enumerator_open (G_FILE (source_object),
+						     cancellable, &error);
+	if (enumerator == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+
+	g_task_return_pointer (task, enumerator,
+			       (GDestroyNotify) nautilus_local_enumerator_free);
+}
+
+static void
+local_enumerate_children_async (GFile *location,
+				int io_priority,
+				GCancellable *cancellable,
+				GAsyncReadyCallback callback,
+				gpointer user_data)
+{
+	GTask *task;
+
+	task = g_task_new (location, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+	g_task_run_in_thread (task, local_enumerator_open_thread);
+	g_object_unref (task);
+}
+
+static void
+local_enumerate_children_callback (GObject *source_object,
+				   GAsyncResult *res,
+				   gpointer user_data)
+{
+	DirectoryLoadState *state;
+	NautilusLocalEnumerator *enumerator;
+
+	state = user_data;
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		directory_load_state_free (state);
+		return;
+	}
+
+	enumerator = g_task_propagate_pointer (G_TASK (res), NULL);
+	if (enumerator == NULL) {
+		/* Let GIO try; it reports errors the way the rest
+		 * of the UI expects them.
+		 */
+		g_file_enumerate_children_async (G_FILE (source_object),
+						 NAUTILUS_FILE_FAST_ATTRIBUTES,
+						 0, /* flags */
+						 G_PRIORITY_DEFAULT, /* prio */
+						 state->cancellable,
+						 enumerate_children_callback,
+						 state);
+		return;
+	}
+
+	state->local_enumerator = enumerator;
+	next_files_precomputed_async (NULL,
+				      state->local_enumerator,
+				      G_PRIORITY_DEFAULT,
+				      state->cancellable,
+				      more_files_callback,
+				      state);
+}
+
+static void
+deferred_info_state_free (DeferredInfoState *state)
+{
+	if (state->enumerator) {
+		if (!g_file_enumerator_is_closed (state->enumerator)) {
+			g_file_enumerator_close_async (state->enumerator,
+						       0, NULL, NULL, NULL);
+		}
+		g_object_unref (state->enumerator);
+	}
+	g_object_unref (state->cancellable);
+	g_free (state);
+}
+
+static void
+deferred_info_done (NautilusDirectory *directory)
+{
+	directory->details->deferred_info_in_progress = NULL;
+	directory->details->deferred_info_wanted = FALSE;
+
+	async_job_end (directory, "deferred info");
+	nautilus_directory_async_state_changed (directory);
+}
+
+static void
+deferred_info_more_files_callback (GObject *source_object,
+				   GAsyncResult *res,
+				   gpointer user_data)
+{
+	DeferredInfoState *state;
+	NautilusDirectory *directory;
+	NautilusFile *file;
+	GList *files, *l, *changed_files;
+	GFileInfo *info;
+	const char *name;
+
+	state = user_data;
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		deferred_info_state_free (state);
+		return;
+	}
+
+	directory = nautilus_directory_ref (state->directory);
+
+	g_assert (directory->details->deferred_info_in_progress == state);
+
+	files = next_files_precomputed_finish (res, NULL);
+
+	changed_files = NULL;
+	for (l = files; l != NULL; l = l->next) {
+		info = l->data;
+		name = g_file_info_get_name (info);
+
+		/* Files that appeared since the first pass come in
+		 * through the monitor with full info already.
+		 */
+		file = name != NULL ? nautilus_directory_find_file_by_name (directory, name) : NULL;
+		if (file != NULL && file->details->file_info_is_partial) {
+			if (nautilus_file_update_info (file, info)) {
+				nautilus_file_ref (file);
+				changed_files = g_list_prepend (changed_files, file);
+			}
+			/* This was a full query, don't ask again for
+			 * whatever the backend did not give us.
+			 */
+			file->details->file_info_is_partial = FALSE;
+		}
+		g_object_unref (info);
+	}
+
+	nautilus_directory_emit_change_signals (directory, changed_files);
+	nautilus_file_list_free (changed_files);
+
+	if (files == NULL) {
+		deferred_info_done (directory);
+		deferred_info_state_free (state);
+	} else {
+		next_files_precomputed_async (state->enumerator,
+					      NULL,
+					      G_PRIORITY_LOW,
+					      state->cancellable,
+					      deferred_info_more_files_callback,
+					      state);
+		nautilus_directory_async_state_changed (directory);
+	}
+
+	g_list_free (files);
+
+	nautilus_directory_unref (directory);
+}
+
+static void
+deferred_info_enumerate_callback (GObject *source_object,
+				  GAsyncResult *res,
+				  gpointer user_data)
+{
+	DeferredInfoState *state;
+	GFileEnumerator *enumerator;
+
+	state = user_data;
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		deferred_info_state_free (state);
+		return;
+	}
+
+	enumerator = g_file_enumerate_children_finish (G_FILE (source_object),
+						       res, NULL);
+
+	if (enumerator == NULL) {
+		deferred_info_done (state->directory);
+		deferred_info_state_free (state);
+	} else {
+		state->enumerator = enumerator;
+		next_files_precomputed_async (state->enumerator,
+					      NULL,
+					      G_PRIORITY_LOW,
+					      state->cancellable,
+					      deferred_info_more_files_callback,
+					      state);
 	}
 }
 
+/* Second loading pass: read the expensive attributes for the files
+ * the first pass only got NAUTILUS_FILE_FAST_ATTRIBUTES for, updating
+ * them in place.
+ */
+static void
+deferred_info_start (NautilusDirectory *directory)
+{
+	DeferredInfoState *state;
+
+	if (!directory->details->deferred_info_wanted ||
+	    directory->details->deferred_info_in_progress != NULL) {
+		return;
+	}
+
+	if (!async_job_start (directory, "deferred info")) {
+		return;
+	}
+
+	state = g_new0 (DeferredInfoState, 1);
+	state->directory = directory;
+	state->cancellable = g_cancellable_new ();
+
+	directory->details->deferred_info_in_progress = state;
+
+	g_file_enumerate_children_async (directory->details->location,
+					 NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
+					 0, /* flags */
+					 G_PRIORITY_LOW, /* prio */
+					 state->cancellable,
+					 deferred_info_enumerate_callback,
+					 state);
+}
 
 /* Start monitoring the file list if it isn't already. */
 static void
@@ -2039,6 +3283,9 @@ start_monitoring_file_list (NautilusDirectory *directory)
 
 	if (directory->details->directory_loaded  ||
 	    directory->details->directory_load_in_progress != NULL) {
+		if (directory->details->directory_loaded_sent_notification) {
+			deferred_info_start (directory);
+		}
 		return;
 	}
 
@@ -2065,8 +3312,29 @@ start_monitoring_file_list (NautilusDirectory *directory)
 #endif
 	
 	directory->details->directory_load_in_progress = state;
+
+	/* The desktop needs the metadata (icon positions) of its files
+	 * before they get added, so load it in one go.
+	 */
+	directory->details->deferred_info_wanted =
+		!nautilus_is_desktop_directory (directory->details->location);
+
+	/* The fast attributes of local files can be read straight
+	 * from the kernel, skipping most of the GIO overhead.
+	 */
+	if (directory->details->deferred_info_wanted &&
+	    nautilus_local_enumerator_is_supported (directory->details->location)) {
+		local_enumerate_children_async (directory->details->location,
+						G_PRIORITY_DEFAULT,
+						state->cancellable,
+						local_enumerate_children_callback,
+						state);
+		return;
+	}
 	
 	g_file_enumerate_children_async (directory->details->location,
+					 directory->details->deferred_info_wanted ?
+					 NAUTILUS_FILE_FAST_ATTRIBUTES :
 					 NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
 					 0, /* flags */
 					 G_PRIORITY_DEFAULT, /* prio */
@@ -2206,16 +3474,20 @@ is_needy (NautilusFile *file,
 
 	directory = file->details->directory;
 	if (directory->details->call_when_ready_counters[request_type_wanted] > 0) {
-		for (node = directory->details->call_when_ready_list;
+		for (node = request_table_get (directory->details->call_when_ready_hash, file);
 		     node != NULL; node = node->next) {
 			callback = node->data;
 			if (callback->active &&
 			    REQUEST_WANTS_TYPE (callback->request, request_type_wanted)) {
-				if (callback->file == file) {
-					return TRUE;
-				}
-				if (callback->file == NULL
-				    && file != directory->details->as_file) {
+				return TRUE;
+			}
+		}
+		if (file != directory->details->as_file) {
+			for (node = request_table_get (directory->details->call_when_ready_hash, NULL);
+			     node != NULL; node = node->next) {
+				callback = node->data;
+				if (callback->active &&
+				    REQUEST_WANTS_TYPE (callback->request, request_type_wanted)) {
 					return TRUE;
 				}
 			}
@@ -2223,13 +3495,19 @@ is_needy (NautilusFile *file,
 	}
 	
 	if (directory->details->monitor_counters[request_type_wanted] > 0) {
-		for (node = directory->details->monitor_list;
+		for (node = request_table_get (directory->details->monitor_hash, file);
 		     node != NULL; node = node->next) {
 			monitor = node->data;
 			if (REQUEST_WANTS_TYPE (monitor->request, request_type_wanted)) {
-				if (monitor_includes_file (monitor, file)) {
-					return TRUE;
-				}
+				return TRUE;
+			}
+		}
+		for (node = request_table_get (directory->details->monitor_hash, NULL);
+		     node != NULL; node = node->next) {
+			monitor = node->data;
+			if (REQUEST_WANTS_TYPE (monitor->request, request_type_wanted) &&
+			    monitor_includes_file (monitor, file)) {
+				return TRUE;
 			}
 		}
 	}
@@ -2239,22 +3517,33 @@ is_needy (NautilusFile *file,
 static void
 directory_count_stop (NautilusDirectory *directory)
 {
+	GList *node, *next;
+	DirectoryCountState *state;
 	NautilusFile *file;
 
-	if (directory->details->count_in_progress != NULL) {
-		file = directory->details->count_in_progress->count_file;
+	for (node = directory->details->count_in_progress; node != NULL; node = next) {
+		next = node->next;
+		state = node->data;
+
+		file = state->count_file;
 		if (file != NULL) {
 			g_assert (NAUTILUS_IS_FILE (file));
 			g_assert (file->details->directory == directory);
 			if (is_needy (file,
 				      should_get_directory_count_now,
 				      REQUEST_DIRECTORY_COUNT)) {
-				return;
+				continue;
+			}
+			if (state->mime_list_hash != NULL &&
+			    is_needy (file,
+				      should_get_mime_list,
+				      REQUEST_MIME_LIST)) {
+				continue;
 			}
 		}
 
 		/* The count is not wanted, so stop it. */
-		directory_count_cancel (directory);
+		directory_count_cancel_one (directory, state);
 	}
 }
 
@@ -2275,12 +3564,36 @@ count_non_skipped_files (GList *list)
 	return count;
 }
 
+/* Counts of non-native directories take one job each. */
+static gboolean
+gio_count_job_start (NautilusDirectory *directory)
+{
+	if (directory->details->gio_count_jobs >= get_directory_job_limit (DIRECTORY_JOB_DIRECTORY_COUNT) ||
+	    !async_job_start (directory, "directory count")) {
+		return FALSE;
+	}
+	directory->details->gio_count_jobs++;
+	return TRUE;
+}
+
 static void
-count_children_done (NautilusDirectory *directory,
-		     NautilusFile *count_file,
-		     gboolean succeeded,
-		     int count)
+gio_count_job_end (NautilusDirectory *directory)
+{
+	g_assert (directory->details->gio_count_jobs > 0);
+
+	directory->details->gio_count_jobs--;
+	async_job_end (directory, "directory count");
+}
+
+static void
+count_children_set_result (NautilusDirectory *directory,
+			   DirectoryCountState *state,
+			   gboolean succeeded,
+			   int count)
 {
+	NautilusFile *count_file;
+
+	count_file = state->count_file;
 	g_assert (NAUTILUS_IS_FILE (count_file));
 
 	count_file->details->directory_count_is_up_to_date = TRUE;
@@ -2295,16 +3608,29 @@ count_children_done (NautilusDirectory *directory,
 		count_file->details->got_directory_count = TRUE;
 		count_file->details->directory_count = count;
 	}
-	directory->details->count_in_progress = NULL;
+	directory->details->count_in_progress =
+		g_list_remove (directory->details->count_in_progress, state);
+	mark_request_changed (directory, count_file,
+			      1 << REQUEST_DIRECTORY_COUNT);
 
 	/* Send file-changed even if count failed, so interested parties can
 	 * distinguish between unknowable and not-yet-known cases.
 	 */
+	nautilus_file_add_pending_changes (count_file, NAUTILUS_FILE_CHANGE_SIZE);
 	nautilus_file_changed (count_file);
+}
+
+static void
+count_children_done (NautilusDirectory *directory,
+		     DirectoryCountState *state,
+		     gboolean succeeded,
+		     int count)
+{
+	count_children_set_result (directory, state, succeeded, count);
 
 	/* Start up the next one. */
-	async_job_end (directory, "directory count");
-	nautilus_directory_async_state_changed (directory);
+	gio_count_job_end (directory);
+	async_service_loop (directory);
 }
 
 static void
@@ -2319,9 +3645,172 @@ directory_count_state_free (DirectoryCountState *state)
 	}
 	g_object_unref (state->cancellable);
 	nautilus_directory_unref (state->directory);
+	g_free (state->path);
+	if (state->mime_list_hash != NULL) {
+		istr_set_destroy (state->mime_list_hash);
+	}
 	g_free (state);
 }
 
+/* All the batched counts of a directory share one async job. */
+static gboolean
+batched_count_job_start (NautilusDirectory *directory)
+{
+	if (directory->details->batched_count_jobs >= get_directory_job_limit (DIRECTORY_JOB_BATCHED_COUNT)) {
+		return FALSE;
+	}
+	if (directory->details->batched_count_jobs == 0 &&
+	    !async_job_start (directory, "directory count")) {
+		return FALSE;
+	}
+	directory->details->batched_count_jobs++;
+	return TRUE;
+}
+
+static void
+batched_count_job_end (NautilusDirectory *directory)
+{
+	g_assert (directory->details->batched_count_jobs > 0);
+
+	directory->details->batched_count_jobs--;
+	if (directory->details->batched_count_jobs == 0) {
+		async_job_end (directory, "directory count");
+	}
+}
+
+static void
+batched_count_set_mime_list (DirectoryCountState *state)
+{
+	NautilusFile *file;
+
+	file = state->count_file;
+
+	file->details->mime_list_is_up_to_date = TRUE;
+	g_list_free_full (file->details->mime_list, g_free);
+	if (state->file_count < 0) {
+		file->details->mime_list_failed = TRUE;
+		file->details->got_mime_list = FALSE;
+		file->details->mime_list = NULL;
+	} else {
+		file->details->mime_list_failed = FALSE;
+		file->details->got_mime_list = TRUE;
+		file->details->mime_list = istr_set_get_as_list (state->mime_list_hash);
+	}
+	mark_request_changed (state->directory, file, 1 << REQUEST_MIME_LIST);
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_OTHER);
+}
+
+/* Hands the counts finished since the last time back to their
+ * directories, with one state change per directory.
+ */
+static gboolean
+batched_count_results_callback (gpointer data)
+{
+	GList *results, *directories, *node;
+	DirectoryCountState *state;
+	NautilusDirectory *directory;
+
+	G_LOCK (batched_count_results);
+	results = g_list_reverse (batched_count_results);
+	batched_count_results = NULL;
+	batched_count_results_idle_id = 0;
+	G_UNLOCK (batched_count_results);
+
+	directories = NULL;
+	for (node = results; node != NULL; node = node->next) {
+		state = node->data;
+		directory = state->directory;
+
+		if (!g_cancellable_is_cancelled (state->cancellable)) {
+			g_assert (g_list_find (directory->details->count_in_progress, state) != NULL);
+			if (state->mime_list_hash != NULL) {
+				batched_count_set_mime_list (state);
+			}
+			count_children_set_result (directory, state,
+						   state->file_count >= 0,
+						   MAX (state->file_count, 0));
+		}
+		batched_count_job_end (directory);
+
+		if (g_list_find (directories, directory) == NULL) {
+			directories = g_list_prepend (directories,
+						      nautilus_directory_ref (directory));
+		}
+		directory_count_state_free (state);
+	}
+	g_list_free (results);
+
+	for (node = directories; node != NULL; node = node->next) {
+		async_service_loop (node->data);
+	}
+	nautilus_directory_list_free (directories);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+batched_count_thread (gpointer data,
+		      gpointer user_data)
+{
+	DirectoryCountState *state;
+
+	state = data;
+
+	if (!g_cancellable_is_cancelled (state->cancellable)) {
+		state->file_count = nautilus_local_enumerator_count_children
+			(state->path, state->show_hidden_files, state->mime_list_hash);
+	}
+
+	G_LOCK (batched_count_results);
+	batched_count_results = g_list_prepend (batched_count_results, state);
+	if (batched_count_results_idle_id == 0) {
+		batched_count_results_idle_id =
+			g_idle_add (batched_count_results_callback, NULL);
+	}
+	G_UNLOCK (batched_count_results);
+}
+
+/* Counts the items of @file in the shared pool, and reads its MIME
+ * list in the same pass if that is wanted too. Takes @path.
+ */
+static gboolean
+batched_count_start (NautilusDirectory *directory,
+		     NautilusFile *file,
+		     char *path)
+{
+	DirectoryCountState *state;
+
+	if (!batched_count_job_start (directory)) {
+		g_free (path);
+		return FALSE;
+	}
+
+	state = g_new0 (DirectoryCountState, 1);
+	state->count_file = file;
+	state->directory = nautilus_directory_ref (directory);
+	state->cancellable = g_cancellable_new ();
+	state->path = path;
+	state->show_hidden_files = get_show_hidden_files ();
+	if (is_needy (file,
+		      should_get_mime_list,
+		      REQUEST_MIME_LIST)) {
+		state->mime_list_hash = istr_set_new ();
+	}
+
+	directory->details->count_in_progress =
+		g_list_prepend (directory->details->count_in_progress, state);
+
+	if (batched_count_pool == NULL) {
+		batched_count_pool = g_thread_pool_new (batched_count_thread, NULL,
+							MAX_BATCHED_COUNT_THREADS,
+							FALSE, NULL);
+	}
+
+	g_thread_pool_push (batched_count_pool, state, NULL);
+
+	return TRUE;
+}
+
 static void
 count_more_files_callback (GObject *source_object,
 			   GAsyncResult *res,
@@ -2338,7 +3827,7 @@ count_more_files_callback (GObject *source_object,
 	if (g_cancellable_is_cancelled (state->cancellable)) {
 		/* Operation was cancelled. Bail out */
 
-		async_job_end (directory, "directory count");
+		gio_count_job_end (directory);
 		nautilus_directory_async_state_changed (directory);
 		
 		directory_count_state_free (state);
@@ -2346,8 +3835,7 @@ count_more_files_callback (GObject *source_object,
 		return;
 	}
 
-	g_assert (directory->details->count_in_progress != NULL);
-	g_assert (directory->details->count_in_progress == state);
+	g_assert (g_list_find (directory->details->count_in_progress, state) != NULL);
 
 	error = NULL;
 	files = g_file_enumerator_next_files_finish (state->enumerator,
@@ -2356,7 +3844,7 @@ count_more_files_callback (GObject *source_object,
 	state->file_count += count_non_skipped_files (files);
 	
 	if (files == NULL) {
-		count_children_done (directory, state->count_file,
+		count_children_done (directory, state,
 				     TRUE, state->file_count);
 		directory_count_state_free (state);
 	} else {
@@ -2391,7 +3879,7 @@ count_children_callback (GObject *source_object,
 		/* Operation was cancelled. Bail out */
 		directory = state->directory;
 
-		async_job_end (directory, "directory count");
+		gio_count_job_end (directory);
 		nautilus_directory_async_state_changed (directory);
 		
 		directory_count_state_free (state);
@@ -2405,7 +3893,7 @@ count_children_callback (GObject *source_object,
 
 	if (enumerator == NULL) {
 		count_children_done (state->directory,
-				     state->count_file,
+				     state,
 				     FALSE, 0);
 		g_error_free (error);
 		directory_count_state_free (state);
@@ -2428,8 +3916,9 @@ directory_count_start (NautilusDirectory *directory,
 {
 	DirectoryCountState *state;
 	GFile *location;
+	char *path;
 
-	if (directory->details->count_in_progress != NULL) {
+	if (directory_count_find_state (directory, file) != NULL) {
 		*doing_io = TRUE;
 		return;
 	}
@@ -2446,11 +3935,26 @@ directory_count_start (NautilusDirectory *directory,
 		file->details->directory_count_failed = FALSE;
 		file->details->got_directory_count = FALSE;
 		
-		nautilus_directory_async_state_changed (directory);
+		mark_request_changed (directory, file, 1 << REQUEST_DIRECTORY_COUNT);
+		async_service_loop (directory);
 		return;
 	}
 
-	if (!async_job_start (directory, "directory count")) {
+	location = nautilus_file_get_location (file);
+	path = g_file_is_native (location) ? g_file_get_path (location) : NULL;
+
+	if (path != NULL) {
+		batched_count_start (directory, file, path);
+		g_object_unref (location);
+		return;
+	}
+
+	/* Elsewhere, reading the MIME list counts the items too. */
+	if (is_needy (file,
+		      should_get_mime_list,
+		      REQUEST_MIME_LIST) ||
+	    !gio_count_job_start (directory)) {
+		g_object_unref (location);
 		return;
 	}
 
@@ -2460,9 +3964,9 @@ directory_count_start (NautilusDirectory *directory,
 	state->directory = nautilus_directory_ref (directory);
 	state->cancellable = g_cancellable_new ();
 	
-	directory->details->count_in_progress = state;
-	
-	location = nautilus_file_get_location (file);
+	directory->details->count_in_progress =
+		g_list_prepend (directory->details->count_in_progress, state);
+
 #ifdef DEBUG_LOAD_DIRECTORY		
 	{
 		char *uri;
@@ -2484,252 +3988,518 @@ directory_count_start (NautilusDirectory *directory,
 	g_object_unref (location);
 }
 
-static inline gboolean
-seen_inode (DeepCountState *state,
-	    GFileInfo *info)
+static guint
+deep_count_inode_hash (gconstpointer key)
 {
-	guint64 inode, inode2;
-	guint i;
+	const DeepCountInode *inode = key;
 
-	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	return (guint) (inode->inode ^ (inode->inode >> 32) ^ (inode->device * 31));
+}
 
-	if (inode != 0) {
-		for (i = 0; i < state->seen_deep_count_inodes->len; i++) {
-			inode2 = g_array_index (state->seen_deep_count_inodes, guint64, i);
-			if (inode == inode2) {
-				return TRUE;
-			}
-		}
-	}
+static void
+deep_count_inode_free (gpointer data)
+{
+	g_slice_free (DeepCountInode, data);
+}
 
-	return FALSE;
+static gboolean
+deep_count_inode_equal (gconstpointer a,
+			gconstpointer b)
+{
+	const DeepCountInode *inode_a = a;
+	const DeepCountInode *inode_b = b;
+
+	return inode_a->inode == inode_b->inode &&
+		inode_a->device == inode_b->device;
 }
 
-static inline void
+/* Returns TRUE the first time a (device, inode) pair shows up, so that
+ * hard links only get their size counted once. Call with the lock held.
+ */
+static gboolean
 mark_inode_as_seen (DeepCountState *state,
 		    GFileInfo *info)
 {
-	guint64 inode;
+	DeepCountInode *inode;
+	guint64 inode_number;
 
-	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
-	if (inode != 0) {
-		g_array_append_val (state->seen_deep_count_inodes, inode);
+	inode_number = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	if (inode_number == 0) {
+		return TRUE;
 	}
+
+	inode = g_slice_new (DeepCountInode);
+	inode->inode = inode_number;
+	inode->device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+
+	return g_hash_table_add (state->seen_inodes, inode);
 }
 
+static void
+deep_counts_add (NautilusDeepCounts *counts,
+		 const NautilusDeepCounts *more)
+{
+	counts->directory_count += more->directory_count;
+	counts->file_count += more->file_count;
+	counts->unreadable_count += more->unreadable_count;
+	counts->size += more->size;
+}
+
+static guint64
+deep_count_get_mtime (GFileInfo *info)
+{
+	return g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+		+ g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+/* What the cache needs to know of a directory to look up its level. */
+#define DEEP_COUNT_NODE_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_ID_FILESYSTEM "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," \
+	G_FILE_ATTRIBUTE_UNIX_DEVICE "," \
+	G_FILE_ATTRIBUTE_UNIX_INODE
+
+/* @info has DEEP_COUNT_NODE_ATTRIBUTES, or is NULL if the directory
+ * could not be looked at; it is read then anyway.
+ */
+static DeepCountNode *
+deep_count_node_new (DeepCountState *state,
+		     DeepCountNode *parent,
+		     GFile *location,
+		     GFileInfo *info)
+{
+	DeepCountNode *node;
+
+	node = g_slice_new0 (DeepCountNode);
+	node->state = state;
+	node->parent = parent;
+	node->location = location;
+	if (info != NULL) {
+		node->mtime = deep_count_get_mtime (info);
+		node->device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+		node->inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	}
+	node->pending = 1; /* for its own listing */
+	if (parent != NULL) {
+		g_atomic_int_inc (&parent->pending);
+	}
+
+	return node;
+}
+
+static void
+deep_count_node_free (DeepCountNode *node)
+{
+	g_object_unref (node->location);
+	g_slice_free (DeepCountNode, node);
+}
+
+/* Called in a worker thread with the lock held. Adds the file to the
+ * totals and to the directory's own listing, and picks up
+ * subdirectories to descend into.
+ */
 static void
 deep_count_one (DeepCountState *state,
-		GFileInfo *info)
+		DeepCountNode *node,
+		GFileInfo *info,
+		DeepCountListing *listing,
+		GList **subdirectories)
 {
-	NautilusFile *file;
 	GFile *subdir;
-	gboolean is_seen_inode;
-	const char *fs_id;
+	gboolean is_new_inode;
+	const char *fs_id, *name;
+	goffset size;
 
-	if (should_skip_file (NULL, info)) {
+	if (!state->show_hidden_files &&
+	    (g_file_info_get_is_hidden (info) ||
+	     g_file_info_get_is_backup (info))) {
 		return;
 	}
 
-	is_seen_inode = seen_inode (state, info);
-	if (!is_seen_inode) {
-		mark_inode_as_seen (state, info);
-	}
+	name = g_file_info_get_name (info);
+	is_new_inode = mark_inode_as_seen (state, info);
 
-	file = state->directory->details->deep_count_file;
+	/* Count the size, each inode only once. */
+	size = 0;
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
+		size = g_file_info_get_size (info);
+	}
+	if (is_new_inode) {
+		state->counts.size += size;
+	}
 
 	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
 		/* Count the directory. */
-		file->details->deep_directory_count += 1;
+		state->counts.directory_count += 1;
+		listing->counts.directory_count += 1;
 
 		/* Record the fact that we have to descend into this directory. */
 		fs_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
 		if (g_strcmp0 (fs_id, state->fs_id) == 0) {
 			/* only if it is on the same filesystem */
-			subdir = g_file_get_child (state->deep_count_location, g_file_info_get_name (info));
-			state->deep_count_subdirectories = g_list_prepend
-				(state->deep_count_subdirectories, subdir);
+			subdir = g_file_get_child (node->location, name);
+			g_ptr_array_add (listing->subdirectories, g_strdup (name));
+			*subdirectories = g_list_prepend
+				(*subdirectories,
+				 deep_count_node_new (state, node, subdir, info));
+			return;
 		}
 	} else {
 		/* Even non-regular files count as files. */
-		file->details->deep_file_count += 1;
-	}
+		state->counts.file_count += 1;
+		listing->counts.file_count += 1;
 
-	/* Count the size. */
-	if (!is_seen_inode && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
-		file->details->deep_size += g_file_info_get_size (info);
+		if (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK) > 1) {
+			g_ptr_array_add (listing->hard_links, g_strdup (name));
+			return;
+		}
 	}
+
+	g_ptr_array_add (listing->files, g_strdup (name));
+	listing->counts.size += size;
 }
 
 static void
 deep_count_state_free (DeepCountState *state)
 {
-	if (state->enumerator) {
-		if (!g_file_enumerator_is_closed (state->enumerator)) {
-			g_file_enumerator_close_async (state->enumerator,
-						       0, NULL, NULL, NULL);
-		}
-		g_object_unref (state->enumerator);
+	if (state->progress_timeout_id != 0) {
+		g_source_remove (state->progress_timeout_id);
 	}
 	g_object_unref (state->cancellable);
-	if (state->deep_count_location) {
-		g_object_unref (state->deep_count_location);
-	}
-	g_list_free_full (state->deep_count_subdirectories, g_object_unref);
-	g_array_free (state->seen_deep_count_inodes, TRUE);
+	g_hash_table_destroy (state->seen_inodes);
+	g_mutex_clear (&state->lock);
 	g_free (state->fs_id);
 	g_free (state);
 }
 
 static void
-deep_count_next_dir (DeepCountState *state)
+deep_count_update_file (DeepCountState *state,
+			NautilusFile *file)
 {
-	GFile *location;
+	NautilusDeepCounts *counts;
+
+	counts = nautilus_file_ensure_deep_counts (file);
+
+	g_mutex_lock (&state->lock);
+	*counts = state->counts;
+	g_mutex_unlock (&state->lock);
+}
+
+static gboolean
+deep_count_progress_callback (gpointer user_data)
+{
+	DeepCountState *state;
 	NautilusFile *file;
+
+	state = user_data;
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. */
+		state->progress_timeout_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	file = state->directory->details->deep_count_file;
+	if (file != NULL) {
+		deep_count_update_file (state, file);
+		nautilus_file_updated_deep_count_in_progress (file);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+deep_count_done_callback (gpointer user_data)
+{
+	DeepCountState *state;
 	NautilusDirectory *directory;
-	gboolean done;
+	NautilusFile *file;
 
+	state = user_data;
 	directory = state->directory;
-	
-	g_object_unref (state->deep_count_location);
-	state->deep_count_location = NULL;
 
-	done = FALSE;
+	if (directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		deep_count_state_free (state);
+		return G_SOURCE_REMOVE;
+	}
+
+	g_assert (directory->details->deep_count_in_progress == state);
+
 	file = directory->details->deep_count_file;
-	
-	if (state->deep_count_subdirectories != NULL) {
-		/* Work on a new directory. */
-		location = state->deep_count_subdirectories->data;
-		state->deep_count_subdirectories = g_list_remove
-			(state->deep_count_subdirectories, location);
-		deep_count_load (state, location);
-		g_object_unref (location);
-	} else {
+	if (file != NULL) {
+		deep_count_update_file (state, file);
 		file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
-		directory->details->deep_count_file = NULL;
-		directory->details->deep_count_in_progress = NULL;
-		deep_count_state_free (state);
-		done = TRUE;
+		mark_request_changed (directory, file, 1 << REQUEST_DEEP_COUNT);
+		nautilus_file_ref (file);
 	}
-	
-	nautilus_file_updated_deep_count_in_progress (file);
+	directory->details->deep_count_file = NULL;
+	directory->details->deep_count_in_progress = NULL;
+	deep_count_state_free (state);
 
-	if (done) {
+	if (file != NULL) {
+		nautilus_file_updated_deep_count_in_progress (file);
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_SIZE);
 		nautilus_file_changed (file);
-		async_job_end (directory, "deep count");
-		nautilus_directory_async_state_changed (directory);
+		nautilus_file_unref (file);
 	}
+	async_job_end (directory, "deep count");
+	async_service_loop (directory);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Frees the directories that are done, up to one that still has work
+ * pending. The root being done ends the count.
+ */
+static void
+deep_count_node_finish (DeepCountState *state,
+			DeepCountNode *node)
+{
+	DeepCountNode *parent;
+
+	while (node != NULL && g_atomic_int_dec_and_test (&node->pending)) {
+		parent = node->parent;
+		if (parent == NULL) {
+			g_idle_add (deep_count_done_callback, state);
+		}
+
+		deep_count_node_free (node);
+		node = parent;
+	}
+}
+
+/* Called in a worker thread. Looks at the files of @names in @node
+ * again, adding their infos to @infos. Returns FALSE if one of them is
+ * gone.
+ */
+static gboolean
+deep_count_stat_files (DeepCountState *state,
+		       DeepCountNode *node,
+		       char **names,
+		       GList **infos)
+{
+	GFile *child;
+	GFileInfo *info;
+	int i;
+
+	for (i = 0; names[i] != NULL; i++) {
+		child = g_file_get_child (node->location, names[i]);
+		info = g_file_query_info (child,
+					  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+					  G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+					  G_FILE_ATTRIBUTE_UNIX_INODE ","
+					  G_FILE_ATTRIBUTE_UNIX_NLINK,
+					  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+					  state->cancellable,
+					  NULL);
+		g_object_unref (child);
+		if (info == NULL) {
+			return FALSE;
+		}
+		*infos = g_list_prepend (*infos, info);
+	}
+
+	return TRUE;
 }
 
-static void
-deep_count_more_files_callback (GObject *source_object,
-				GAsyncResult *res,
-				gpointer user_data)
+/* Called in a worker thread. Adds the directory's level from the cache
+ * and queues its subdirectories, each of which gets checked against
+ * its own modification time in turn. Returns FALSE if the directory
+ * has to be read.
+ */
+static gboolean
+deep_count_add_cached_level (DeepCountState *state,
+			     DeepCountNode *node)
 {
-	DeepCountState *state;
-	NautilusDirectory *directory;
-	GList *files, *l;
+	NautilusDeepCountLevel level;
 	GFileInfo *info;
+	GFile *subdir;
+	GList *subdirectories, *infos, *l;
+	goffset size;
+	gboolean valid;
+	int i;
 
-	state = user_data;
-
-	if (state->directory == NULL) {
-		/* Operation was cancelled. Bail out */
-		deep_count_state_free (state);
-		return;
+	if (!nautilus_deep_count_cache_lookup (node->location,
+					       node->device, node->inode, node->mtime,
+					       state->show_hidden_files,
+					       &level)) {
+		return FALSE;
 	}
 
-	directory = nautilus_directory_ref (state->directory);
-	
-	g_assert (directory->details->deep_count_in_progress != NULL);
-	g_assert (directory->details->deep_count_in_progress == state);
+	size = level.sizes_trusted ? level.counts.size : 0;
 
-	files = g_file_enumerator_next_files_finish (state->enumerator,
-						     res, NULL);
+	/* Removing a subdirectory changes the mtime of the level, but
+	 * mounting something over one does not. The subdirectories'
+	 * own sizes are not part of the level, they change with what
+	 * the subdirectories hold.
+	 */
+	valid = TRUE;
+	subdirectories = NULL;
+	for (i = 0; valid && level.subdirectories[i] != NULL; i++) {
+		subdir = g_file_get_child (node->location, level.subdirectories[i]);
+		info = g_file_query_info (subdir,
+					  DEEP_COUNT_NODE_ATTRIBUTES ","
+					  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+					  state->cancellable,
+					  NULL);
+		valid = info != NULL &&
+			g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY &&
+			g_strcmp0 (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM),
+				   state->fs_id) == 0;
+		if (valid) {
+			size += g_file_info_get_size (info);
+			subdirectories = g_list_prepend (subdirectories,
+							 deep_count_node_new (state, NULL, subdir, info));
+		} else {
+			g_object_unref (subdir);
+		}
+		g_clear_object (&info);
+	}
 
-	for (l = files; l != NULL; l = l->next)	{
-		info = l->data;
-		deep_count_one (state, info);
-		g_object_unref (info);
+	/* Hard-linked files are looked at every time so that each inode
+	 * is counted once. Without a monitor, files may have been
+	 * rewritten in place, so their sizes are looked at again too.
+	 */
+	infos = NULL;
+	valid = valid &&
+		deep_count_stat_files (state, node, level.hard_links, &infos) &&
+		(level.sizes_trusted ||
+		 deep_count_stat_files (state, node, level.files, &infos));
+
+	if (!valid) {
+		g_list_free_full (subdirectories, (GDestroyNotify) deep_count_node_free);
+		g_list_free_full (infos, g_object_unref);
+		nautilus_deep_count_level_clear (&level);
+		return FALSE;
 	}
-	
-	if (files == NULL) {
-		g_file_enumerator_close_async (state->enumerator, 0, NULL, NULL, NULL);
-		g_object_unref (state->enumerator);
-		state->enumerator = NULL;
-		
-		deep_count_next_dir (state);
-	} else {
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_LOW,
-						    state->cancellable,
-						    deep_count_more_files_callback,
-						    state);
+
+	g_mutex_lock (&state->lock);
+	for (l = infos; l != NULL; l = l->next) {
+		if (g_file_info_get_attribute_uint32 (l->data, G_FILE_ATTRIBUTE_UNIX_NLINK) <= 1 ||
+		    mark_inode_as_seen (state, l->data)) {
+			size += g_file_info_get_size (l->data);
+		}
 	}
+	level.counts.size = size;
+	deep_counts_add (&state->counts, &level.counts);
+	g_mutex_unlock (&state->lock);
 
-	g_list_free (files);
+	g_list_free_full (infos, g_object_unref);
+	nautilus_deep_count_level_clear (&level);
 
-	nautilus_directory_unref (directory);
+	for (l = subdirectories; l != NULL; l = l->next) {
+		((DeepCountNode *) l->data)->parent = node;
+		g_atomic_int_inc (&node->pending);
+		g_thread_pool_push (deep_count_pool, l->data, NULL);
+	}
+	g_list_free (subdirectories);
+
+	return TRUE;
+}
+
+static char **
+deep_count_names_steal (GPtrArray *names)
+{
+	g_ptr_array_add (names, NULL);
+	return (char **) g_ptr_array_free (names, FALSE);
 }
 
+/* Called in a worker thread. Reads the directory, keeping its level
+ * in the cache if the whole listing could be read.
+ */
 static void
-deep_count_callback (GObject *source_object,
-		     GAsyncResult *res,
-		     gpointer user_data)
+deep_count_read_level (DeepCountState *state,
+		       DeepCountNode *node)
 {
-	DeepCountState *state;
 	GFileEnumerator *enumerator;
-	NautilusFile *file;
-
-	state = user_data;
+	GList *files, *subdirectories, *l;
+	DeepCountListing listing;
+	NautilusDeepCountLevel level;
+	GError *error;
 
-	if (state->directory == NULL) {
-		/* Operation was cancelled. Bail out */
-		deep_count_state_free (state);
+	enumerator = g_file_enumerate_children (node->location,
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+						G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+						G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
+						G_FILE_ATTRIBUTE_UNIX_NLINK ","
+						DEEP_COUNT_NODE_ATTRIBUTES,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						state->cancellable,
+						NULL);
+	if (enumerator == NULL) {
+		g_mutex_lock (&state->lock);
+		state->counts.unreadable_count += 1;
+		g_mutex_unlock (&state->lock);
 		return;
 	}
 
-	file = state->directory->details->deep_count_file;
+	memset (&listing.counts, 0, sizeof (listing.counts));
+	listing.subdirectories = g_ptr_array_new_with_free_func (g_free);
+	listing.files = g_ptr_array_new_with_free_func (g_free);
+	listing.hard_links = g_ptr_array_new_with_free_func (g_free);
+	error = NULL;
 
-	enumerator = g_file_enumerate_children_finish  (G_FILE (source_object),	res, NULL);
-	
-	if (enumerator == NULL) {
-		file->details->deep_unreadable_count += 1;
-		
-		deep_count_next_dir (state);
-	} else {
-		state->enumerator = enumerator;
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_LOW,
-						    state->cancellable,
-						    deep_count_more_files_callback,
-						    state);
+	while ((files = g_file_enumerator_next_files (enumerator,
+						      DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+						      state->cancellable,
+						      &error)) != NULL) {
+		subdirectories = NULL;
+		g_mutex_lock (&state->lock);
+		for (l = files; l != NULL; l = l->next) {
+			deep_count_one (state, node, l->data, &listing, &subdirectories);
+		}
+		g_mutex_unlock (&state->lock);
+		g_list_free_full (files, g_object_unref);
+
+		for (l = subdirectories; l != NULL; l = l->next) {
+			g_thread_pool_push (deep_count_pool, l->data, NULL);
+		}
+		g_list_free (subdirectories);
 	}
-}
 
+	level.counts = listing.counts;
+	level.subdirectories = deep_count_names_steal (listing.subdirectories);
+	level.files = deep_count_names_steal (listing.files);
+	level.hard_links = deep_count_names_steal (listing.hard_links);
+	level.sizes_trusted = FALSE; /* decided by the cache */
+	if (error == NULL && !g_cancellable_is_cancelled (state->cancellable)) {
+		nautilus_deep_count_cache_store (node->location,
+						 node->device, node->inode, node->mtime,
+						 state->show_hidden_files, &level);
+	}
+	nautilus_deep_count_level_clear (&level);
+	g_clear_error (&error);
+
+	g_file_enumerator_close (enumerator, NULL, NULL);
+	g_object_unref (enumerator);
+}
 
+/* Runs in the shared thread pool, one directory per call.
+ * Subdirectories go back into the pool as they are found, so every
+ * worker stays busy however the trees are shaped.
+ */
 static void
-deep_count_load (DeepCountState *state, GFile *location)
+deep_count_directory_thread (gpointer data,
+			     gpointer user_data)
 {
-	state->deep_count_location = g_object_ref (location);
+	DeepCountNode *node;
+	DeepCountState *state;
 
-#ifdef DEBUG_LOAD_DIRECTORY		
-	g_message ("load_directory called to get deep file count for %p", location);
-#endif	
-	g_file_enumerate_children_async (state->deep_count_location,
-					 G_FILE_ATTRIBUTE_STANDARD_NAME ","
-					 G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-					 G_FILE_ATTRIBUTE_STANDARD_SIZE ","
-					 G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
-					 G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
-					 G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
-					 G_FILE_ATTRIBUTE_UNIX_INODE,
-					 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, /* flags */
-					 G_PRIORITY_LOW, /* prio */
-					 state->cancellable,
-					 deep_count_callback,
-					 state);
+	node = data;
+	state = node->state;
+
+	if (!g_cancellable_is_cancelled (state->cancellable) &&
+	    !deep_count_add_cached_level (state, node) &&
+	    !g_cancellable_is_cancelled (state->cancellable)) {
+		deep_count_read_level (state, node);
+	}
+
+	deep_count_node_finish (state, node);
 }
 
 static void
@@ -2768,9 +4538,30 @@ deep_count_got_info (GObject *source_object,
 	if (info != NULL) {
 		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
 		state->fs_id = g_strdup (id);
-		g_object_unref (info);
 	}
-	deep_count_load (state, file);
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		g_clear_object (&info);
+		deep_count_state_free (state);
+		return;
+	}
+
+#ifdef DEBUG_LOAD_DIRECTORY
+	g_message ("load_directory called to get deep file count for %p", file);
+#endif
+	if (deep_count_pool == NULL) {
+		deep_count_pool = g_thread_pool_new (deep_count_directory_thread, NULL,
+						     CLAMP (g_get_num_processors (), 2, MAX_DEEP_COUNT_THREADS),
+						     FALSE, NULL);
+	}
+	state->progress_timeout_id =
+		g_timeout_add (DEEP_COUNT_PROGRESS_INTERVAL_MSEC,
+			       deep_count_progress_callback, state);
+	g_thread_pool_push (deep_count_pool,
+			    deep_count_node_new (state, NULL, g_object_ref (file), info),
+			    NULL);
+	g_clear_object (&info);
 }
 
 static void
@@ -2796,7 +4587,8 @@ deep_count_start (NautilusDirectory *directory,
 	if (!nautilus_file_is_directory (file)) {
 		file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
 
-		nautilus_directory_async_state_changed (directory);
+		mark_request_changed (directory, file, 1 << REQUEST_DEEP_COUNT);
+		async_service_loop (directory);
 		return;
 	}
 
@@ -2806,23 +4598,24 @@ deep_count_start (NautilusDirectory *directory,
 
 	/* Start counting. */
 	file->details->deep_counts_status = NAUTILUS_REQUEST_IN_PROGRESS;
-	file->details->deep_directory_count = 0;
-	file->details->deep_file_count = 0;
-	file->details->deep_unreadable_count = 0;
-	file->details->deep_size = 0;
+	memset (nautilus_file_ensure_deep_counts (file), 0, sizeof (NautilusDeepCounts));
 	directory->details->deep_count_file = file;
 
 	state = g_new0 (DeepCountState, 1);
 	state->directory = directory;
 	state->cancellable = g_cancellable_new ();
-	state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
+	state->show_hidden_files = get_show_hidden_files ();
+	state->seen_inodes = g_hash_table_new_full (deep_count_inode_hash,
+						    deep_count_inode_equal,
+						    deep_count_inode_free, NULL);
+	g_mutex_init (&state->lock);
 	state->fs_id = NULL;
 
 	directory->details->deep_count_in_progress = state;
 	
 	location = nautilus_file_get_location (file);
 	g_file_query_info_async (location,
-				 G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+				 DEEP_COUNT_NODE_ATTRIBUTES,
 				 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 				 G_PRIORITY_DEFAULT,
 				 NULL,
@@ -2883,12 +4676,21 @@ mime_list_done (MimeListState *state, gboolean success)
 	
 	file->details->mime_list_is_up_to_date = TRUE;
 	g_list_free_full (file->details->mime_list, g_free);
-	if (success) {
+	if (!success) {
 		file->details->mime_list_failed = TRUE;
 		file->details->mime_list = NULL;
 	} else {
 		file->details->got_mime_list = TRUE;
 		file->details->mime_list = istr_set_get_as_list	(state->mime_list_hash);
+
+		/* The item count came along for free. */
+		if (lacks_directory_count (file) &&
+		    directory_count_find_state (directory, file) == NULL) {
+			file->details->directory_count_is_up_to_date = TRUE;
+			file->details->directory_count_failed = FALSE;
+			file->details->got_directory_count = TRUE;
+			file->details->directory_count = state->file_count;
+		}
 	}
 	directory->details->mime_list_in_progress = NULL;
 
@@ -2896,11 +4698,14 @@ mime_list_done (MimeListState *state, gboolean success)
 	 * failed, so interested parties can distinguish between
 	 * unknowable and not-yet-known cases.
 	 */
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_OTHER);
 	nautilus_file_changed (file);
 
 	/* Start up the next one. */
 	async_job_end (directory, "MIME list");
-	nautilus_directory_async_state_changed (directory);
+	mark_request_changed (directory, file,
+			      (1 << REQUEST_MIME_LIST) | (1 << REQUEST_DIRECTORY_COUNT));
+	async_service_loop (directory);
 }
 
 static void
@@ -2910,10 +4715,11 @@ mime_list_one (MimeListState *state,
 	const char *mime_type;
 	
 	if (should_skip_file (NULL, info)) {
-		g_object_unref (info);
 		return;
 	}
 
+	state->file_count += 1;
+
 	mime_type = g_file_info_get_content_type (info);
 	if (mime_type != NULL) {
 		istr_set_insert (state->mime_list_hash, mime_type);
@@ -2960,7 +4766,7 @@ mime_list_callback (GObject *source_object,
 	}
 
 	if (files == NULL) {
-		mime_list_done (state, error != NULL);
+		mime_list_done (state, error == NULL);
 		mime_list_state_free (state);
 	} else {
 		g_file_enumerator_next_files_async (state->enumerator,
@@ -3030,14 +4836,10 @@ mime_list_start (NautilusDirectory *directory,
 {
 	MimeListState *state;
 	GFile *location;
+	char *path;
 
 	mime_list_stop (directory);
 
-	if (directory->details->mime_list_in_progress != NULL) {
-		*doing_io = TRUE;
-		return;
-	}
-
 	/* Figure out which file to get a mime list for. */
 	if (!is_needy (file,
 		       should_get_mime_list,
@@ -3052,11 +4854,30 @@ mime_list_start (NautilusDirectory *directory,
 		file->details->got_mime_list = FALSE;
 		file->details->mime_list_is_up_to_date = TRUE;
 
-		nautilus_directory_async_state_changed (directory);
+		mark_request_changed (directory, file, 1 << REQUEST_MIME_LIST);
+		async_service_loop (directory);
+		return;
+	}
+
+	/* Local directories get their MIME list from the batched count
+	 * pass, along with the item count. A pass that is already running
+	 * without the MIME list is followed by another one.
+	 */
+	location = nautilus_file_get_location (file);
+	path = g_file_is_native (location) ? g_file_get_path (location) : NULL;
+	if (path != NULL) {
+		if (directory_count_find_state (directory, file) == NULL) {
+			batched_count_start (directory, file, path);
+		} else {
+			g_free (path);
+		}
+		g_object_unref (location);
 		return;
 	}
 
-	if (!async_job_start (directory, "MIME list")) {
+	if (directory->details->mime_list_in_progress != NULL ||
+	    !async_job_start (directory, "MIME list")) {
+		g_object_unref (location);
 		return;
 	}
 
@@ -3069,7 +4890,6 @@ mime_list_start (NautilusDirectory *directory,
 
 	directory->details->mime_list_in_progress = state;
 
-	location = nautilus_file_get_location (file);
 #ifdef DEBUG_LOAD_DIRECTORY		
 	{
 		char *uri;
@@ -3080,7 +4900,10 @@ mime_list_start (NautilusDirectory *directory,
 #endif	
 	
 	g_file_enumerate_children_async (location,
-					 G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+					 G_FILE_ATTRIBUTE_STANDARD_NAME ","
+					 G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
+					 G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+					 G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP,
 					 0, /* flags */
 					 G_PRIORITY_LOW, /* prio */
 					 state->cancellable,
@@ -3117,11 +4940,11 @@ query_info_callback (GObject *source_object,
 	
 	directory = nautilus_directory_ref (state->directory);
 
-	get_info_file = directory->details->get_info_file;
+	get_info_file = state->file;
 	g_assert (NAUTILUS_IS_FILE (get_info_file));
 
-	directory->details->get_info_file = NULL;
-	directory->details->get_info_in_progress = NULL;
+	directory->details->get_info_in_progress =
+		g_list_remove (directory->details->get_info_in_progress, state);
 	
 	/* ref here because we might be removing the last ref when we
 	 * mark the file gone below, but we need to keep a ref at
@@ -3143,14 +4966,17 @@ query_info_callback (GObject *source_object,
 		get_info_file->details->get_info_error = error;
 	} else {
 		nautilus_file_update_info (get_info_file, info);
+		get_info_file->details->file_info_is_partial = FALSE;
 		g_object_unref (info);
 	}
 
+	/* The other lacks_* checks look at the info as well. */
+	mark_request_changed (directory, get_info_file, REQUEST_ALL);
 	nautilus_file_changed (get_info_file);
 	nautilus_file_unref (get_info_file);
 
 	async_job_end (directory, "file info");
-	nautilus_directory_async_state_changed (directory);
+	async_service_loop (directory);
 
 	nautilus_directory_unref (directory);
 
@@ -3160,20 +4986,25 @@ query_info_callback (GObject *source_object,
 static void
 file_info_stop (NautilusDirectory *directory)
 {
+	GList *node, *next;
+	GetInfoState *state;
 	NautilusFile *file;
 
-	if (directory->details->get_info_in_progress != NULL) {
-		file = directory->details->get_info_file;
+	for (node = directory->details->get_info_in_progress; node != NULL; node = next) {
+		next = node->next;
+		state = node->data;
+
+		file = state->file;
 		if (file != NULL) {
 			g_assert (NAUTILUS_IS_FILE (file));
 			g_assert (file->details->directory == directory);
-			if (is_needy (file, lacks_info, REQUEST_FILE_INFO)) {
-				return;
+			if (is_needy (file, should_get_file_info_now, REQUEST_FILE_INFO)) {
+				continue;
 			}
 		}
 
 		/* The info is not wanted, so stop it. */
-		file_info_cancel (directory);
+		file_info_cancel_one (directory, state);
 	}
 }
 
@@ -3185,23 +5016,24 @@ file_info_start (NautilusDirectory *directory,
 	GFile *location;
 	GetInfoState *state;
 	
-	file_info_stop (directory);
-
-	if (directory->details->get_info_in_progress != NULL) {
+	if (file_info_find_state (directory, file) != NULL) {
 		*doing_io = TRUE;
 		return;
 	}
 
-	if (!is_needy (file, lacks_info, REQUEST_FILE_INFO)) {
+	if (!is_needy (file, should_get_file_info_now, REQUEST_FILE_INFO)) {
 		return;
 	}
 	*doing_io = TRUE;
 
+	if (g_list_length (directory->details->get_info_in_progress) >= get_directory_job_limit (DIRECTORY_JOB_FILE_INFO)) {
+		return;
+	}
+
 	if (!async_job_start (directory, "file info")) {
 		return;
 	}
 
-	directory->details->get_info_file = file;
 	file->details->get_info_failed = FALSE;
 	if (file->details->get_info_error) {
 		g_error_free (file->details->get_info_error);
@@ -3210,9 +5042,11 @@ file_info_start (NautilusDirectory *directory,
 
 	state = g_new (GetInfoState, 1);
 	state->directory = directory;
+	state->file = file;
 	state->cancellable = g_cancellable_new ();
 
-	directory->details->get_info_in_progress = state;
+	directory->details->get_info_in_progress =
+		g_list_prepend (directory->details->get_info_in_progress, state);
 	
 	location = nautilus_file_get_location (file);
 	g_file_query_info_async (location,
@@ -3286,29 +5120,34 @@ link_info_done (NautilusDirectory *directory,
 	file->details->is_foreign_link = is_foreign;
 	file->details->is_trusted_link = is_trusted;
 	
-	nautilus_directory_async_state_changed (directory);
+	mark_request_changed (directory, file, 1 << REQUEST_LINK_INFO);
+	async_service_loop (directory);
 }
 
 static void
 link_info_stop (NautilusDirectory *directory)
 {
+	GList *node, *next;
+	LinkInfoReadState *state;
 	NautilusFile *file;
 
-	if (directory->details->link_info_read_state != NULL) {
-		file = directory->details->link_info_read_state->file;
+	for (node = directory->details->link_info_read_states; node != NULL; node = next) {
+		next = node->next;
+		state = node->data;
 
+		file = state->file;
 		if (file != NULL) {
 			g_assert (NAUTILUS_IS_FILE (file));
 			g_assert (file->details->directory == directory);
 			if (is_needy (file,
 				      lacks_link_info,
 				      REQUEST_LINK_INFO)) {
-				return;
+				continue;
 			}
 		}
 
 		/* The link info is not wanted, so stop it. */
-		link_info_cancel (directory);
+		link_info_cancel_one (directory, state);
 	}
 }
 
@@ -3344,6 +5183,7 @@ link_info_got_data (NautilusDirectory *directory,
 
 	nautilus_file_ref (file);
 	link_info_done (directory, file, uri, name, icon, is_launcher, is_foreign);
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_NAME | NAUTILUS_FILE_CHANGE_ICON);
 	nautilus_file_changed (file);
 	nautilus_file_unref (file);
 	
@@ -3390,7 +5230,8 @@ link_info_nautilus_link_read_callback (GObject *source_object,
 					      &file_contents, &file_size,
 					      NULL, NULL);
 
-	state->directory->details->link_info_read_state = NULL;
+	state->directory->details->link_info_read_states =
+		g_list_remove (state->directory->details->link_info_read_states, state);
 	async_job_end (state->directory, "link info");
 	
 	link_info_got_data (state->directory, state->file, result, file_size, file_contents);
@@ -3413,7 +5254,7 @@ link_info_start (NautilusDirectory *directory,
 	gboolean nautilus_style_link;
 	LinkInfoReadState *state;
 	
-	if (directory->details->link_info_read_state != NULL) {
+	if (link_info_find_state (directory, file) != NULL) {
 		*doing_io = TRUE;
 		return;
 	}
@@ -3433,7 +5274,8 @@ link_info_start (NautilusDirectory *directory,
 	if (!nautilus_style_link) {
 		link_info_done (directory, file, NULL, NULL, NULL, FALSE, FALSE);
 	} else {
-		if (!async_job_start (directory, "link info")) {
+		if (g_list_length (directory->details->link_info_read_states) >= get_directory_job_limit (DIRECTORY_JOB_LINK_INFO) ||
+		    !async_job_start (directory, "link info")) {
 			g_object_unref (location);
 			return;
 		}
@@ -3443,7 +5285,8 @@ link_info_start (NautilusDirectory *directory,
 		state->file = file;
 		state->cancellable = g_cancellable_new ();
 		
-		directory->details->link_info_read_state = state;
+		directory->details->link_info_read_states =
+			g_list_prepend (directory->details->link_info_read_states, state);
 
 		g_file_load_contents_async (location,
 					    state->cancellable,
@@ -3459,19 +5302,15 @@ thumbnail_done (NautilusDirectory *directory,
 		GdkPixbuf *pixbuf,
 		gboolean tried_original)
 {
+	NautilusFileThumbnailDetails *thumbnail;
 	const char *thumb_mtime_str;
 	time_t thumb_mtime = 0;
 	
+	thumbnail = nautilus_file_ensure_thumbnail_details (file);
 	file->details->thumbnail_is_up_to_date = TRUE;
 	file->details->thumbnail_tried_original  = tried_original;
-	if (file->details->thumbnail) {
-		g_object_unref (file->details->thumbnail);
-		file->details->thumbnail = NULL;
-	}
-	if (file->details->scaled_thumbnail) {
-		g_object_unref (file->details->scaled_thumbnail);
-		file->details->scaled_thumbnail = NULL;
-	}
+	g_clear_object (&thumbnail->pixbuf);
+	g_clear_object (&thumbnail->scaled_pixbuf);
 
 	if (pixbuf) {
 		if (tried_original) {
@@ -3485,37 +5324,42 @@ thumbnail_done (NautilusDirectory *directory,
 		
 		if (thumb_mtime == 0 ||
 		    thumb_mtime == file->details->mtime) {
-			file->details->thumbnail = g_object_ref (pixbuf);
-			file->details->thumbnail_mtime = thumb_mtime;
+			thumbnail->pixbuf = g_object_ref (pixbuf);
+			thumbnail->mtime = thumb_mtime;
 		} else {
-			g_free (file->details->thumbnail_path);
-			file->details->thumbnail_path = NULL;
+			g_free (thumbnail->path);
+			thumbnail->path = NULL;
 		}
 	}
 	
-	nautilus_directory_async_state_changed (directory);
+	mark_request_changed (directory, file, 1 << REQUEST_THUMBNAIL);
+	async_service_loop (directory);
 }
 
 static void
 thumbnail_stop (NautilusDirectory *directory)
 {
+	GList *node, *next;
+	ThumbnailState *state;
 	NautilusFile *file;
 
-	if (directory->details->thumbnail_state != NULL) {
-		file = directory->details->thumbnail_state->file;
+	for (node = directory->details->thumbnail_states; node != NULL; node = next) {
+		next = node->next;
+		state = node->data;
 
+		file = state->file;
 		if (file != NULL) {
 			g_assert (NAUTILUS_IS_FILE (file));
 			g_assert (file->details->directory == directory);
 			if (is_needy (file,
 				      lacks_thumbnail,
 				      REQUEST_THUMBNAIL)) {
-				return;
+				continue;
 			}
 		}
 
-		/* The link info is not wanted, so stop it. */
-		thumbnail_cancel (directory);
+		/* The thumbnail is not wanted, so stop it. */
+		thumbnail_cancel_one (directory, state);
 	}
 }
 
@@ -3529,6 +5373,7 @@ thumbnail_got_pixbuf (NautilusDirectory *directory,
 
 	nautilus_file_ref (file);
 	thumbnail_done (directory, file, pixbuf, tried_original);
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_ICON);
 	nautilus_file_changed (file);
 	nautilus_file_unref (file);
 	
@@ -3652,14 +5497,15 @@ thumbnail_read_callback (GObject *source_object,
 	if (pixbuf == NULL && state->trying_original) {
 		state->trying_original = FALSE;
 
-		location = g_file_new_for_path (state->file->details->thumbnail_path);
+		location = g_file_new_for_path (state->file->details->thumbnail_details->path);
 		g_file_load_contents_async (location,
 					    state->cancellable,
 					    thumbnail_read_callback,
 					    state);
 		g_object_unref (location);
 	} else {
-		state->directory->details->thumbnail_state = NULL;
+		state->directory->details->thumbnail_states =
+			g_list_remove (state->directory->details->thumbnail_states, state);
 		async_job_end (state->directory, "thumbnail");
 		
 		thumbnail_got_pixbuf (state->directory, state->file, pixbuf, state->tried_original);
@@ -3678,7 +5524,7 @@ thumbnail_start (NautilusDirectory *directory,
 	GFile *location;
 	ThumbnailState *state;
 
-	if (directory->details->thumbnail_state != NULL) {
+	if (thumbnail_find_state (directory, file) != NULL) {
 		*doing_io = TRUE;
 		return;
 	}
@@ -3690,6 +5536,10 @@ thumbnail_start (NautilusDirectory *directory,
 	}
 	*doing_io = TRUE;
 
+	if (g_list_length (directory->details->thumbnail_states) >= get_directory_job_limit (DIRECTORY_JOB_THUMBNAIL)) {
+		return;
+	}
+
 	if (!async_job_start (directory, "thumbnail")) {
 		return;
 	}
@@ -3704,10 +5554,11 @@ thumbnail_start (NautilusDirectory *directory,
 		state->trying_original = TRUE;
 		location = nautilus_file_get_location (file);
 	} else {
-		location = g_file_new_for_path (file->details->thumbnail_path);
+		location = g_file_new_for_path (file->details->thumbnail_details->path);
 	}
 	
-	directory->details->thumbnail_state = state;
+	directory->details->thumbnail_states =
+		g_list_prepend (directory->details->thumbnail_states, state);
 
 	g_file_load_contents_async (location,
 				    state->cancellable,
@@ -3719,23 +5570,27 @@ thumbnail_start (NautilusDirectory *directory,
 static void
 mount_stop (NautilusDirectory *directory)
 {
+	GList *node, *next;
+	MountState *state;
 	NautilusFile *file;
 
-	if (directory->details->mount_state != NULL) {
-		file = directory->details->mount_state->file;
+	for (node = directory->details->mount_states; node != NULL; node = next) {
+		next = node->next;
+		state = node->data;
 
+		file = state->file;
 		if (file != NULL) {
 			g_assert (NAUTILUS_IS_FILE (file));
 			g_assert (file->details->directory == directory);
 			if (is_needy (file,
 				      lacks_mount,
 				      REQUEST_MOUNT)) {
-				return;
+				continue;
 			}
 		}
 
-		/* The link info is not wanted, so stop it. */
-		mount_cancel (directory);
+		/* The mount is not wanted, so stop it. */
+		mount_cancel_one (directory, state);
 	}
 }
 
@@ -3754,7 +5609,8 @@ got_mount (MountState *state, GMount *mount)
 	
 	directory = nautilus_directory_ref (state->directory);
 
-	state->directory->details->mount_state = NULL;
+	state->directory->details->mount_states =
+		g_list_remove (state->directory->details->mount_states, state);
 	async_job_end (state->directory, "mount");
 	
 	file = nautilus_file_ref (state->file);
@@ -3762,7 +5618,9 @@ got_mount (MountState *state, GMount *mount)
 	file->details->mount_is_up_to_date = TRUE;
 	nautilus_file_set_mount (file, mount);
 
-	nautilus_directory_async_state_changed (directory);
+	mark_request_changed (directory, file, 1 << REQUEST_MOUNT);
+	async_service_loop (directory);
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_ICON | NAUTILUS_FILE_CHANGE_OTHER);
 	nautilus_file_changed (file);
 	
 	nautilus_file_unref (file);
@@ -3853,7 +5711,7 @@ mount_start (NautilusDirectory *directory,
 	GFile *location;
 	MountState *state;
 	
-	if (directory->details->mount_state != NULL) {
+	if (mount_find_state (directory, file) != NULL) {
 		*doing_io = TRUE;
 		return;
 	}
@@ -3865,6 +5723,10 @@ mount_start (NautilusDirectory *directory,
 	}
 	*doing_io = TRUE;
 
+	if (g_list_length (directory->details->mount_states) >= get_directory_job_limit (DIRECTORY_JOB_MOUNT)) {
+		return;
+	}
+
 	if (!async_job_start (directory, "mount")) {
 		return;
 	}
@@ -3876,7 +5738,8 @@ mount_start (NautilusDirectory *directory,
 
 	location = nautilus_file_get_location (file);
 	
-	directory->details->mount_state = state;
+	directory->details->mount_states =
+		g_list_prepend (directory->details->mount_states, state);
 
 	if (file->details->type == G_FILE_TYPE_MOUNTABLE) {
 		GFile *target;
@@ -3904,37 +5767,30 @@ mount_start (NautilusDirectory *directory,
 	g_object_unref (location);
 }
 
-static void
-filesystem_info_cancel (NautilusDirectory *directory)
-{
-	if (directory->details->filesystem_info_state != NULL) {
-		g_cancellable_cancel (directory->details->filesystem_info_state->cancellable);
-		directory->details->filesystem_info_state->directory = NULL;
-		directory->details->filesystem_info_state = NULL;
-		async_job_end (directory, "filesystem info");
-	}
-}
-
 static void
 filesystem_info_stop (NautilusDirectory *directory)
 {
+	GList *node, *next;
+	FilesystemInfoState *state;
 	NautilusFile *file;
 
-	if (directory->details->filesystem_info_state != NULL) {
-		file = directory->details->filesystem_info_state->file;
+	for (node = directory->details->filesystem_info_states; node != NULL; node = next) {
+		next = node->next;
+		state = node->data;
 
+		file = state->file;
 		if (file != NULL) {
 			g_assert (NAUTILUS_IS_FILE (file));
 			g_assert (file->details->directory == directory);
 			if (is_needy (file,
 				      lacks_filesystem_info,
 				      REQUEST_FILESYSTEM_INFO)) {
-				return;
+				continue;
 			}
 		}
 
 		/* The filesystem info is not wanted, so stop it. */
-		filesystem_info_cancel (directory);
+		filesystem_info_cancel_one (directory, state);
 	}
 }
 
@@ -3956,7 +5812,8 @@ got_filesystem_info (FilesystemInfoState *state, GFileInfo *info)
 
 	directory = nautilus_directory_ref (state->directory);
 
-	state->directory->details->filesystem_info_state = NULL;
+	state->directory->details->filesystem_info_states =
+		g_list_remove (state->directory->details->filesystem_info_states, state);
 	async_job_end (state->directory, "filesystem info");
 	
 	file = nautilus_file_ref (state->file);
@@ -3974,7 +5831,9 @@ got_filesystem_info (FilesystemInfoState *state, GFileInfo *info)
                 }
 	}
 	
-	nautilus_directory_async_state_changed (directory);
+	mark_request_changed (directory, file, 1 << REQUEST_FILESYSTEM_INFO);
+	async_service_loop (directory);
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_OTHER);
 	nautilus_file_changed (file);
 	
 	nautilus_file_unref (file);
@@ -4016,7 +5875,7 @@ filesystem_info_start (NautilusDirectory *directory,
 	GFile *location;
 	FilesystemInfoState *state;
 
-	if (directory->details->filesystem_info_state != NULL) {
+	if (filesystem_info_find_state (directory, file) != NULL) {
 		*doing_io = TRUE;
 		return;
 	}
@@ -4028,6 +5887,10 @@ filesystem_info_start (NautilusDirectory *directory,
 	}
 	*doing_io = TRUE;
 
+	if (g_list_length (directory->details->filesystem_info_states) >= get_directory_job_limit (DIRECTORY_JOB_FILESYSTEM_INFO)) {
+		return;
+	}
+
 	if (!async_job_start (directory, "filesystem info")) {
 		return;
 	}
@@ -4039,7 +5902,8 @@ filesystem_info_start (NautilusDirectory *directory,
 
 	location = nautilus_file_get_location (file);
 	
-	directory->details->filesystem_info_state = state;
+	directory->details->filesystem_info_states =
+		g_list_prepend (directory->details->filesystem_info_states, state);
 
 	g_file_query_filesystem_info_async (location,
 					    G_FILE_ATTRIBUTE_FILESYSTEM_READONLY ","
@@ -4098,14 +5962,17 @@ finish_info_provider (NautilusDirectory *directory,
 		      NautilusFile *file,
 		      NautilusInfoProvider *provider)
 {
-	file->details->pending_info_providers = 
-		g_list_remove  (file->details->pending_info_providers,
+	NautilusFileExtensionDetails *extension;
+
+	extension = nautilus_file_ensure_extension_details (file);
+	extension->pending_info_providers = 
+		g_list_remove  (extension->pending_info_providers,
 				provider);
 	g_object_unref (provider);
 
 	nautilus_directory_async_state_changed (directory);
 
-	if (file->details->pending_info_providers == NULL) {
+	if (extension->pending_info_providers == NULL) {
 		nautilus_file_info_providers_done (file);
 	}
 }
@@ -4184,7 +6051,7 @@ extension_info_start (NautilusDirectory *directory,
 		return;
 	}
 
-	provider = file->details->pending_info_providers->data;
+	provider = file->details->extension_details->pending_info_providers->data;
 
 	update_complete = g_cclosure_new (G_CALLBACK (info_provider_callback),
 					  directory,
@@ -4211,10 +6078,27 @@ extension_info_start (NautilusDirectory *directory,
 	}
 }
 
+/* Is any attribute of this file being fetched right now? */
+static gboolean
+file_has_io_in_progress (NautilusDirectory *directory,
+			 NautilusFile *file)
+{
+	return file_info_find_state (directory, file) != NULL
+		|| link_info_find_state (directory, file) != NULL
+		|| directory_count_find_state (directory, file) != NULL
+		|| thumbnail_find_state (directory, file) != NULL
+		|| mount_find_state (directory, file) != NULL
+		|| filesystem_info_find_state (directory, file) != NULL
+		|| directory->details->deep_count_file == file
+		|| (directory->details->mime_list_in_progress != NULL &&
+		    directory->details->mime_list_in_progress->mime_list_file == file)
+		|| directory->details->extension_info_file == file;
+}
+
 static void
 start_or_stop_io (NautilusDirectory *directory)
 {
-	NautilusFile *file;
+	NautilusFile *file, *next;
 	gboolean doing_io;
 
 	/* Start or stop reading files. */
@@ -4231,25 +6115,37 @@ start_or_stop_io (NautilusDirectory *directory)
 	thumbnail_stop (directory);
 	filesystem_info_stop (directory);
 
-	doing_io = FALSE;
-	/* Take files that are all done off the queue. */
-	while (!nautilus_file_queue_is_empty (directory->details->high_priority_queue)) {
-		file = nautilus_file_queue_head (directory->details->high_priority_queue);
+	/* Take files that are all done off the queue. Files whose
+	 * attributes are being fetched stay in it, but don't hold up
+	 * the ones behind them until we run out of slots.
+	 */
+	file = nautilus_file_queue_head (directory->details->high_priority_queue);
+	while (file != NULL) {
+		doing_io = FALSE;
 
 		/* Start getting attributes if possible */
 		file_info_start (directory, file, &doing_io);
 		link_info_start (directory, file, &doing_io);
 
-		if (doing_io) {
+		if (doing_io && !file_has_io_in_progress (directory, file)) {
 			return;
 		}
 
-		move_file_to_low_priority_queue (directory, file);
+		next = nautilus_file_queue_next (directory->details->high_priority_queue, file);
+		if (!doing_io) {
+			move_file_to_low_priority_queue (directory, file);
+		}
+		file = next;
+	}
+
+	if (!nautilus_file_queue_is_empty (directory->details->high_priority_queue)) {
+		return;
 	}
 
 	/* High priority queue must be empty */
-	while (!nautilus_file_queue_is_empty (directory->details->low_priority_queue)) {
-		file = nautilus_file_queue_head (directory->details->low_priority_queue);
+	file = nautilus_file_queue_head (directory->details->low_priority_queue);
+	while (file != NULL) {
+		doing_io = FALSE;
 
 		/* Start getting attributes if possible */
 		mount_start (directory, file, &doing_io);
@@ -4259,11 +6155,19 @@ start_or_stop_io (NautilusDirectory *directory)
 		thumbnail_start (directory, file, &doing_io);
 		filesystem_info_start (directory, file, &doing_io);
 
-		if (doing_io) {
+		if (doing_io && !file_has_io_in_progress (directory, file)) {
 			return;
 		}
 
-		move_file_to_extension_queue (directory, file);
+		next = nautilus_file_queue_next (directory->details->low_priority_queue, file);
+		if (!doing_io) {
+			move_file_to_extension_queue (directory, file);
+		}
+		file = next;
+	}
+
+	if (!nautilus_file_queue_is_empty (directory->details->low_priority_queue)) {
+		return;
 	}
 
 	/* Low priority queue must be empty */
@@ -4271,6 +6175,7 @@ start_or_stop_io (NautilusDirectory *directory)
 		file = nautilus_file_queue_head (directory->details->extension_queue);
 
 		/* Start getting attributes if possible */
+		doing_io = FALSE;
 		extension_info_start (directory, file, &doing_io);
 		if (doing_io) {
 			return;
@@ -4280,11 +6185,35 @@ start_or_stop_io (NautilusDirectory *directory)
 	}
 }
 
-/* Call this when the monitor or call when ready list changes,
- * or when some I/O is completed.
+/* Records that @request changed for @file, or for all the files if
+ * @file is NULL, so the next state change checks the callbacks
+ * waiting for it.
  */
-void
-nautilus_directory_async_state_changed (NautilusDirectory *directory)
+static void
+mark_request_changed (NautilusDirectory *directory,
+		      NautilusFile *file,
+		      Request request)
+{
+	gpointer changed;
+
+	if (file == NULL) {
+		directory->details->changed_requests |= request;
+		return;
+	}
+
+	if (directory->details->changed_files == NULL) {
+		directory->details->changed_files = g_hash_table_new (NULL, NULL);
+	}
+	changed = g_hash_table_lookup (directory->details->changed_files, file);
+	g_hash_table_insert (directory->details->changed_files, file,
+			     GUINT_TO_POINTER (GPOINTER_TO_UINT (changed) | request));
+}
+
+/* Like nautilus_directory_async_state_changed, for I/O completions that
+ * already marked what they changed with mark_request_changed.
+ */
+static void
+async_service_loop (NautilusDirectory *directory)
 {
 	/* Check if any callbacks are satisfied and call them if they
 	 * are. Do this last so that any changes done in start or stop
@@ -4314,6 +6243,17 @@ nautilus_directory_async_state_changed (NautilusDirectory *directory)
 	async_job_wake_up ();
 }
 
+/* Call this when the monitor or call when ready list changes,
+ * or when some I/O is completed.
+ */
+void
+nautilus_directory_async_state_changed (NautilusDirectory *directory)
+{
+	/* Anything may have changed, check all the callbacks. */
+	mark_request_changed (directory, NULL, REQUEST_ALL);
+	async_service_loop (directory);
+}
+
 void
 nautilus_directory_cancel (NautilusDirectory *directory)
 {
@@ -4331,9 +6271,7 @@ nautilus_directory_cancel (NautilusDirectory *directory)
 	filesystem_info_cancel (directory);
 
 	/* We aren't waiting for anything any more. */
-	if (waiting_directories != NULL) {
-		g_hash_table_remove (waiting_directories, directory);
-	}
+	async_job_forget (directory);
 
 	/* Check if any directories should wake up. */
 	async_job_wake_up ();
@@ -4343,9 +6281,11 @@ static void
 cancel_directory_count_for_file (NautilusDirectory *directory,
 				 NautilusFile      *file)
 {
-	if (directory->details->count_in_progress != NULL &&
-	    directory->details->count_in_progress->count_file == file) {
-		directory_count_cancel (directory);
+	DirectoryCountState *state;
+
+	state = directory_count_find_state (directory, file);
+	if (state != NULL) {
+		directory_count_cancel_one (directory, state);
 	}
 }
 
@@ -4372,8 +6312,11 @@ static void
 cancel_file_info_for_file (NautilusDirectory *directory,
 			   NautilusFile      *file)
 {
-	if (directory->details->get_info_file == file) {
-		file_info_cancel (directory);
+	GetInfoState *state;
+
+	state = file_info_find_state (directory, file);
+	if (state != NULL) {
+		file_info_cancel_one (directory, state);
 	}
 }
 
@@ -4381,9 +6324,11 @@ static void
 cancel_thumbnail_for_file (NautilusDirectory *directory,
 			   NautilusFile      *file)
 {
-	if (directory->details->thumbnail_state != NULL &&
-	    directory->details->thumbnail_state->file == file) {
-		thumbnail_cancel (directory);
+	ThumbnailState *state;
+
+	state = thumbnail_find_state (directory, file);
+	if (state != NULL) {
+		thumbnail_cancel_one (directory, state);
 	}
 }
 
@@ -4391,9 +6336,11 @@ static void
 cancel_mount_for_file (NautilusDirectory *directory,
 			   NautilusFile      *file)
 {
-	if (directory->details->mount_state != NULL &&
-	    directory->details->mount_state->file == file) {
-		mount_cancel (directory);
+	MountState *state;
+
+	state = mount_find_state (directory, file);
+	if (state != NULL) {
+		mount_cancel_one (directory, state);
 	}
 }
 
@@ -4401,9 +6348,11 @@ static void
 cancel_filesystem_info_for_file (NautilusDirectory *directory,
 				 NautilusFile      *file)
 {
-	if (directory->details->filesystem_info_state != NULL &&
-	    directory->details->filesystem_info_state->file == file) {
-		filesystem_info_cancel (directory);
+	FilesystemInfoState *state;
+
+	state = filesystem_info_find_state (directory, file);
+	if (state != NULL) {
+		filesystem_info_cancel_one (directory, state);
 	}
 }
 
@@ -4411,9 +6360,11 @@ static void
 cancel_link_info_for_file (NautilusDirectory *directory,
 			   NautilusFile      *file)
 {
-	if (directory->details->link_info_read_state != NULL &&
-	    directory->details->link_info_read_state->file == file) {
-		link_info_cancel (directory);
+	LinkInfoReadState *state;
+
+	state = link_info_find_state (directory, file);
+	if (state != NULL) {
+		link_info_cancel_one (directory, state);
 	}
 }
 
@@ -33,6 +33,7 @@ typedef struct LinkInfoReadState LinkInfoReadState;
 typedef struct TopLeftTextReadState TopLeftTextReadState;
 typedef struct FileMonitors FileMonitors;
 typedef struct DirectoryLoadState DirectoryLoadState;
+typedef struct DeferredInfoState DeferredInfoState;
 typedef struct DirectoryCountState DirectoryCountState;
 typedef struct DeepCountState DeepCountState;
 typedef struct GetInfoState GetInfoState;
@@ -78,12 +79,25 @@ struct NautilusDirectoryDetails
 	NautilusFileQueue *low_priority_queue;
 	NautilusFileQueue *extension_queue;
 
-	/* These lists are going to be pretty short.  If we think they
-	 * are going to get big, we can use hash tables instead.
+	/* Ready callbacks and monitors by the file they are for, NULL
+	 * meaning the whole directory. Each value is a GList.
 	 */
-	GList *call_when_ready_list;
+	GHashTable *call_when_ready_hash;
+	/* The same ready callbacks by (file, callback, data), each value
+	 * a GList of the ones with that key, at most one of them active.
+	 * Created with the first callback.
+	 */
+	GHashTable *call_when_ready_keys;
+	GQueue ready_callbacks; /* triggered callbacks, to be called at idle */
+	/* Active callbacks by the request type they wait for, the last
+	 * queue holding the ones not checked yet. A state change only
+	 * checks the callbacks waiting for what changed.
+	 */
+	GQueue waiting_callbacks[REQUEST_TYPE_LAST + 1];
+	Request changed_requests; /* changed for all files */
+	GHashTable *changed_files; /* NautilusFile -> changed Request */
 	RequestCounter call_when_ready_counters;
-	GList *monitor_list;
+	GHashTable *monitor_hash;
 	RequestCounter monitor_counters;
 	guint call_ready_idle_id;
 
@@ -98,34 +112,42 @@ struct NautilusDirectoryDetails
 	gboolean directory_loaded_sent_notification;
 	DirectoryLoadState *directory_load_in_progress;
 
+	/* Second pass over the directory, reading the attributes the
+	 * first one left out (see NAUTILUS_FILE_FAST_ATTRIBUTES).
+	 */
+	gboolean deferred_info_wanted;
+	DeferredInfoState *deferred_info_in_progress;
+
 	GList *pending_file_info; /* list of GnomeVFSFileInfo's that are pending */
+	GList *dequeue_pending_file_info; /* the ones left over from the last time slice, in order */
 	int confirmed_file_count;
         guint dequeue_pending_idle_id;
 
 	GList *new_files_in_progress; /* list of NewFilesState * */
 
-	DirectoryCountState *count_in_progress;
+	GList *count_in_progress; /* list of DirectoryCountState * */
+	int batched_count_jobs; /* counts running in the shared pool */
+	int gio_count_jobs; /* counts running as GIO enumerations */
 
 	NautilusFile *deep_count_file;
 	DeepCountState *deep_count_in_progress;
 
 	MimeListState *mime_list_in_progress;
 
-	NautilusFile *get_info_file;
-	GetInfoState *get_info_in_progress;
+	GList *get_info_in_progress; /* list of GetInfoState * */
 
 	NautilusFile *extension_info_file;
 	NautilusInfoProvider *extension_info_provider;
 	NautilusOperationHandle *extension_info_in_progress;
 	guint extension_info_idle;
 
-	ThumbnailState *thumbnail_state;
+	GList *thumbnail_states; /* list of ThumbnailState * */
 
-	MountState *mount_state;
+	GList *mount_states; /* list of MountState * */
 
-	FilesystemInfoState *filesystem_info_state;
+	GList *filesystem_info_states; /* list of FilesystemInfoState * */
 	
-	LinkInfoReadState *link_info_read_state;
+	GList *link_info_read_states; /* list of LinkInfoReadState * */
 
 	GList *file_operations_in_progress; /* list of FileOperation * */
 };
@@ -173,6 +195,7 @@ void               nautilus_directory_schedule_dequeue_pending        (NautilusD
 void               nautilus_directory_stop_monitoring_file_list       (NautilusDirectory         *directory);
 void               nautilus_directory_cancel                          (NautilusDirectory         *directory);
 void               nautilus_async_destroying_file                     (NautilusFile              *file);
+void               nautilus_directory_free_requests                   (NautilusDirectory         *directory);
 void               nautilus_directory_force_reload_internal           (NautilusDirectory         *directory,
 								       NautilusFileAttributes     file_attributes);
 void               nautilus_directory_cancel_loading_file_attributes  (NautilusDirectory         *directory,
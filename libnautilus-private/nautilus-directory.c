@@ -23,6 +23,7 @@
 #include <config.h>
 #include "nautilus-directory-private.h"
 
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-notify.h"
 #include "nautilus-file-attributes.h"
 #include "nautilus-file-private.h"
@@ -57,6 +58,22 @@ static GParamSpec *properties[NUM_PROPERTIES] = { NULL, };
 
 static GHashTable *directories;
 
+/* Every cached directory is also kept in a trie keyed by the
+ * components of its URI, so that the directories inside a moved
+ * or renamed container can be found without walking the whole
+ * directories hash table.
+ */
+typedef struct LocationTrieNode LocationTrieNode;
+
+struct LocationTrieNode {
+	LocationTrieNode *parent;
+	char *component;
+	GHashTable *children;
+	NautilusDirectory *directory;
+};
+
+static LocationTrieNode *location_trie;
+
 static void               nautilus_directory_finalize         (GObject                *object);
 static NautilusDirectory *nautilus_directory_new              (GFile                  *location);
 static GList *            real_get_file_list                  (NautilusDirectory      *directory);
@@ -66,6 +83,140 @@ static void               set_directory_location              (NautilusDirectory
 
 G_DEFINE_TYPE (NautilusDirectory, nautilus_directory, G_TYPE_OBJECT);
 
+static char **
+location_trie_split (GFile *location)
+{
+	char *uri;
+	char **components;
+	char **src, **dest;
+
+	uri = g_file_get_uri (location);
+	components = g_strsplit (uri, "/", -1);
+	g_free (uri);
+
+	/* Drop the empty components produced by "scheme://" and by
+	 * trailing or doubled slashes.
+	 */
+	for (src = dest = components; *src != NULL; src++) {
+		if (**src == '\0') {
+			g_free (*src);
+		} else {
+			*dest++ = *src;
+		}
+	}
+	*dest = NULL;
+
+	return components;
+}
+
+static LocationTrieNode *
+location_trie_node_new (LocationTrieNode *parent,
+			const char *component)
+{
+	LocationTrieNode *node;
+
+	node = g_slice_new0 (LocationTrieNode);
+	node->parent = parent;
+	node->component = g_strdup (component);
+
+	return node;
+}
+
+static LocationTrieNode *
+location_trie_lookup (GFile *location,
+		      gboolean create)
+{
+	LocationTrieNode *node, *child;
+	char **components;
+	int i;
+
+	if (location_trie == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		location_trie = location_trie_node_new (NULL, NULL);
+	}
+
+	components = location_trie_split (location);
+
+	node = location_trie;
+	for (i = 0; node != NULL && components[i] != NULL; i++) {
+		child = NULL;
+		if (node->children != NULL) {
+			child = g_hash_table_lookup (node->children, components[i]);
+		}
+
+		if (child == NULL && create) {
+			if (node->children == NULL) {
+				node->children = g_hash_table_new (g_str_hash, g_str_equal);
+			}
+			child = location_trie_node_new (node, components[i]);
+			g_hash_table_insert (node->children, child->component, child);
+		}
+
+		node = child;
+	}
+
+	g_strfreev (components);
+
+	return node;
+}
+
+static void
+location_trie_add (NautilusDirectory *directory)
+{
+	LocationTrieNode *node;
+
+	node = location_trie_lookup (directory->details->location, TRUE);
+	node->directory = directory;
+}
+
+static void
+location_trie_remove (NautilusDirectory *directory)
+{
+	LocationTrieNode *node, *parent;
+
+	node = location_trie_lookup (directory->details->location, FALSE);
+	if (node == NULL || node->directory != directory) {
+		return;
+	}
+	node->directory = NULL;
+
+	/* Prune the branch back up to the first node still in use. */
+	while (node->parent != NULL &&
+	       node->directory == NULL &&
+	       (node->children == NULL || g_hash_table_size (node->children) == 0)) {
+		parent = node->parent;
+		g_hash_table_remove (parent->children, node->component);
+		if (node->children != NULL) {
+			g_hash_table_destroy (node->children);
+		}
+		g_free (node->component);
+		g_slice_free (LocationTrieNode, node);
+		node = parent;
+	}
+}
+
+static void
+location_trie_collect (LocationTrieNode *node,
+		       GList **directories_out)
+{
+	GHashTableIter iter;
+	LocationTrieNode *child;
+
+	if (node->directory != NULL) {
+		*directories_out = g_list_prepend (*directories_out,
+						   nautilus_directory_ref (node->directory));
+	}
+
+	if (node->children != NULL) {
+		g_hash_table_iter_init (&iter, node->children);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &child)) {
+			location_trie_collect (child, directories_out);
+		}
+	}
+}
+
 static void
 nautilus_directory_set_property (GObject *object,
 				 guint property_id,
@@ -165,6 +316,8 @@ nautilus_directory_init (NautilusDirectory *directory)
 {
 	directory->details = G_TYPE_INSTANCE_GET_PRIVATE ((directory), NAUTILUS_TYPE_DIRECTORY, NautilusDirectoryDetails);
 	directory->details->file_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	directory->details->call_when_ready_hash = g_hash_table_new (NULL, NULL);
+	directory->details->monitor_hash = g_hash_table_new (NULL, NULL);
 	directory->details->high_priority_queue = nautilus_file_queue_new ();
 	directory->details->low_priority_queue = nautilus_file_queue_new ();
 	directory->details->extension_queue = nautilus_file_queue_new ();
@@ -203,17 +356,21 @@ nautilus_directory_finalize (GObject *object)
 	directory = NAUTILUS_DIRECTORY (object);
 
 	g_hash_table_remove (directories, directory->details->location);
+	location_trie_remove (directory);
 
 	nautilus_directory_cancel (directory);
 	g_assert (directory->details->count_in_progress == NULL);
 
-	if (directory->details->monitor_list != NULL) {
-		g_warning ("destroying a NautilusDirectory while it's being monitored");
-		g_list_free_full (directory->details->monitor_list, g_free);
+	nautilus_directory_free_requests (directory);
+	g_hash_table_destroy (directory->details->monitor_hash);
+	g_hash_table_destroy (directory->details->call_when_ready_hash);
+	if (directory->details->changed_files != NULL) {
+		g_hash_table_destroy (directory->details->changed_files);
 	}
 
 	if (directory->details->monitor != NULL) {
 		nautilus_monitor_cancel (directory->details->monitor);
+		nautilus_deep_count_cache_set_monitored (directory->details->location, FALSE);
 	}
 
 	if (directory->details->dequeue_pending_idle_id != 0) {
@@ -238,6 +395,7 @@ nautilus_directory_finalize (GObject *object)
 	g_assert (directory->details->count_in_progress == NULL);
 	g_assert (directory->details->dequeue_pending_idle_id == 0);
 	g_list_free_full (directory->details->pending_file_info, g_object_unref);
+	g_list_free_full (directory->details->dequeue_pending_file_info, g_object_unref);
 
 	G_OBJECT_CLASS (nautilus_directory_parent_class)->finalize (object);
 }
@@ -391,6 +549,7 @@ nautilus_directory_get_internal (GFile *location, gboolean create)
 		g_hash_table_insert (directories,
 				     directory->details->location,
 				     directory);
+		location_trie_add (directory);
 	}
 
 	return directory;
@@ -965,6 +1124,8 @@ nautilus_directory_notify_files_added (GList *files)
 	/* Make a list of parent directories that will need their counts updated. */
 	parent_directories = g_hash_table_new (NULL, NULL);
 
+	nautilus_deep_count_cache_invalidate (files);
+
 	for (p = files; p != NULL; p = p->next) {
 		location = p->data;
 
@@ -1043,6 +1204,8 @@ nautilus_directory_notify_files_changed (GList *files)
 	/* Make a list of changed files in each directory. */
 	changed_lists = g_hash_table_new (NULL, NULL);
 
+	nautilus_deep_count_cache_invalidate (files);
+
 	/* Go through all the notifications. */
 	for (node = files; node != NULL; node = node->next) {
 		location = node->data;
@@ -1084,6 +1247,8 @@ nautilus_directory_notify_files_removed (GList *files)
 	/* Make a list of parent directories that will need their counts updated. */
 	parent_directories = g_hash_table_new (NULL, NULL);
 
+	nautilus_deep_count_cache_invalidate (files);
+
 	/* Go through all the notifications. */
 	for (p = files; p != NULL; p = p->next) {
 		location = p->data;
@@ -1140,59 +1305,70 @@ change_directory_location (NautilusDirectory *directory,
 
 	g_hash_table_remove (directories,
 			     directory->details->location);
+	location_trie_remove (directory);
+
+	if (directory->details->monitor != NULL) {
+		nautilus_deep_count_cache_set_monitored (directory->details->location, FALSE);
+		nautilus_deep_count_cache_set_monitored (new_location, TRUE);
+	}
 
 	set_directory_location (directory, new_location);
 
 	g_hash_table_insert (directories,
 			     directory->details->location,
 			     directory);
+	location_trie_add (directory);
 }
 
-typedef struct {
-	GFile *container;
-	GList *directories;
-} CollectData;
-
-static void
-collect_directories_by_container (gpointer key, gpointer value, gpointer callback_data)
+static GList *
+collect_directories_by_container (GFile *container)
 {
+	LocationTrieNode *node;
+	GList *candidates, *result, *l;
 	NautilusDirectory *directory;
-	CollectData *collect_data;
-	GFile *location;
 
-	location = (GFile *) key;
-	directory = NAUTILUS_DIRECTORY (value);
-	collect_data = (CollectData *) callback_data;
+	node = location_trie_lookup (container, FALSE);
+	if (node == NULL) {
+		return NULL;
+	}
 
-	if (g_file_has_prefix (location, collect_data->container) ||
-	    g_file_equal (collect_data->container, location)) {
-		nautilus_directory_ref (directory);
-		collect_data->directories =
-			g_list_prepend (collect_data->directories,
-					directory);
+	candidates = NULL;
+	location_trie_collect (node, &candidates);
+
+	/* The trie matches on URI components; confirm each candidate
+	 * with GIO so that the result is exactly what a prefix check
+	 * over every directory would have produced.
+	 */
+	result = NULL;
+	for (l = candidates; l != NULL; l = l->next) {
+		directory = NAUTILUS_DIRECTORY (l->data);
+		if (g_file_has_prefix (directory->details->location, container) ||
+		    g_file_equal (container, directory->details->location)) {
+			result = g_list_prepend (result, directory);
+		} else {
+			nautilus_directory_unref (directory);
+		}
 	}
+	g_list_free (candidates);
+
+	return result;
 }
 
 static GList *
 nautilus_directory_moved_internal (GFile *old_location,
 				   GFile *new_location)
 {
-	CollectData collection;
+	GList *collection;
 	NautilusDirectory *directory;
 	GList *node, *affected_files;
 	GFile *new_directory_location;
 	char *relative_path;
 
-	collection.container = old_location;
-	collection.directories = NULL;
-
-	g_hash_table_foreach (directories,
-			      collect_directories_by_container,
-			      &collection);
+	collection = collect_directories_by_container (old_location);
 
 	affected_files = NULL;
 
-	for (node = collection.directories; node != NULL; node = node->next) {
+	for (node = collection; node != NULL; node = node->next) {
 		directory = NAUTILUS_DIRECTORY (node->data);
 		new_directory_location = NULL;
 
@@ -1226,7 +1402,7 @@ nautilus_directory_moved_internal (GFile *old_location,
 		nautilus_directory_unref (directory);
 	}
 
-	g_list_free (collection.directories);
+	g_list_free (collection);
 
 	return affected_files;
 }
@@ -1265,7 +1441,7 @@ nautilus_directory_moved (const char *old_uri,
 void
 nautilus_directory_notify_files_moved (GList *file_pairs)
 {
-	GList *p, *affected_files, *node;
+	GList *p, *affected_files, *node, *locations;
 	GFilePair *pair;
 	NautilusFile *file;
 	NautilusDirectory *old_directory, *new_directory;
@@ -1287,6 +1463,15 @@ nautilus_directory_notify_files_moved (GList *file_pairs)
 
 	cancel_attributes = nautilus_file_get_all_attributes ();
 
+	locations = NULL;
+	for (p = file_pairs; p != NULL; p = p->next) {
+		pair = p->data;
+		locations = g_list_prepend (locations, pair->from);
+		locations = g_list_prepend (locations, pair->to);
+	}
+	nautilus_deep_count_cache_invalidate (locations);
+	g_list_free (locations);
+
 	for (p = file_pairs; p != NULL; p = p->next) {
 		pair = p->data;
 		from_location = pair->from;
@@ -30,7 +30,8 @@ typedef enum {
 	CHANGE_FILE_REMOVED,
 	CHANGE_FILE_MOVED,
 	CHANGE_POSITION_SET,
-	CHANGE_POSITION_REMOVE
+	CHANGE_POSITION_REMOVE,
+	CHANGE_CANCELLED
 } NautilusFileChangeKind;
 
 typedef struct {
@@ -41,9 +42,32 @@ typedef struct {
 	int screen;
 } NautilusFileChange;
 
+/* Producers (usually file operation threads) append to the tail of
+ * the queue and the main loop takes the whole backlog in one go.
+ *
+ * While an added or changed event is still waiting in the queue it is
+ * also recorded in the pending hash table, keyed by location, so that
+ * later events for the same file can be folded into it:
+ *
+ *   added   + added    -> added
+ *   added   + changed  -> added
+ *   changed + changed  -> changed
+ *   changed + added    -> added
+ *   added   + removed  -> removed
+ *   changed + removed  -> removed
+ *
+ * A move is a barrier: pending events for both of its locations are
+ * left alone and no longer coalesced with anything queued after it.
+ *
+ * Changes for the files of a held directory (one whose monitor reports
+ * a storm of events) go to a queue of their own instead, so that
+ * consuming the changes of other directories does not drain them. They
+ * are handed over when the directory is flushed or released.
+ */
 typedef struct {
-	GList *head;
-	GList *tail;
+	GQueue changes;
+	GHashTable *pending;
+	GHashTable *held; /* directory GFile -> GQueue of changes */
 	GMutex mutex;
 } NautilusFileChangesQueue;
 
@@ -53,6 +77,10 @@ nautilus_file_changes_queue_new (void)
 	NautilusFileChangesQueue *result;
 
 	result = g_new0 (NautilusFileChangesQueue, 1);
+	g_queue_init (&result->changes);
+	result->pending = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+	result->held = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+					      g_object_unref, NULL);
 	g_mutex_init (&result->mutex);
 
 	return result;
@@ -70,16 +98,93 @@ nautilus_file_changes_queue_get (void)
 	return file_changes_queue;
 }
 
+static void
+nautilus_file_changes_queue_forget_pending (NautilusFileChangesQueue *queue,
+					    GFile *location)
+{
+	if (location != NULL) {
+		g_hash_table_remove (queue->pending, location);
+	}
+}
+
+static GQueue *
+nautilus_file_changes_queue_get_held (NautilusFileChangesQueue *queue,
+				      GFile *location)
+{
+	GFile *parent;
+	GQueue *held;
+
+	if (location == NULL || g_hash_table_size (queue->held) == 0) {
+		return NULL;
+	}
+
+	parent = g_file_get_parent (location);
+	if (parent == NULL) {
+		return NULL;
+	}
+	held = g_hash_table_lookup (queue->held, parent);
+	g_object_unref (parent);
+
+	return held;
+}
+
 static void
 nautilus_file_changes_queue_add_common (NautilusFileChangesQueue *queue, 
 	NautilusFileChange *new_item)
 {
-	/* enqueue the new queue item while locking down the list */
+	NautilusFileChange *pending;
+	GQueue *held;
+
+	/* enqueue the new queue item while locking down the queue */
 	g_mutex_lock (&queue->mutex);
 
-	queue->head = g_list_prepend (queue->head, new_item);
-	if (queue->tail == NULL)
-		queue->tail = queue->head;
+	pending = NULL;
+	if (new_item->kind == CHANGE_FILE_ADDED ||
+	    new_item->kind == CHANGE_FILE_CHANGED ||
+	    new_item->kind == CHANGE_FILE_REMOVED) {
+		pending = g_hash_table_lookup (queue->pending, new_item->from);
+	}
+
+	switch (new_item->kind) {
+	case CHANGE_FILE_ADDED:
+	case CHANGE_FILE_CHANGED:
+		if (pending != NULL &&
+		    (pending->kind == CHANGE_FILE_ADDED ||
+		     new_item->kind == CHANGE_FILE_CHANGED)) {
+			/* The queued event already covers this one. */
+			g_mutex_unlock (&queue->mutex);
+			g_object_unref (new_item->from);
+			g_slice_free (NautilusFileChange, new_item);
+			return;
+		}
+		if (pending != NULL) {
+			/* A queued change followed by an add. */
+			pending->kind = CHANGE_CANCELLED;
+		}
+		g_hash_table_replace (queue->pending, new_item->from, new_item);
+		break;
+
+	case CHANGE_FILE_REMOVED:
+		if (pending != NULL) {
+			pending->kind = CHANGE_CANCELLED;
+			g_hash_table_remove (queue->pending, new_item->from);
+		}
+		break;
+
+	case CHANGE_FILE_MOVED:
+		nautilus_file_changes_queue_forget_pending (queue, new_item->from);
+		nautilus_file_changes_queue_forget_pending (queue, new_item->to);
+		break;
+
+	default:
+		break;
+	}
+
+	held = nautilus_file_changes_queue_get_held (queue, new_item->from);
+	if (held == NULL) {
+		held = nautilus_file_changes_queue_get_held (queue, new_item->to);
+	}
+	g_queue_push_tail (held != NULL ? held : &queue->changes, new_item);
 
 	g_mutex_unlock (&queue->mutex);
 }
@@ -92,7 +197,7 @@ nautilus_file_changes_queue_file_added (GFile *location)
 
 	queue = nautilus_file_changes_queue_get();
 
-	new_item = g_new0 (NautilusFileChange, 1);
+	new_item = g_slice_new0 (NautilusFileChange);
 	new_item->kind = CHANGE_FILE_ADDED;
 	new_item->from = g_object_ref (location);
 	nautilus_file_changes_queue_add_common (queue, new_item);
@@ -106,7 +211,7 @@ nautilus_file_changes_queue_file_changed (GFile *location)
 
 	queue = nautilus_file_changes_queue_get();
 
-	new_item = g_new0 (NautilusFileChange, 1);
+	new_item = g_slice_new0 (NautilusFileChange);
 	new_item->kind = CHANGE_FILE_CHANGED;
 	new_item->from = g_object_ref (location);
 	nautilus_file_changes_queue_add_common (queue, new_item);
@@ -120,7 +225,7 @@ nautilus_file_changes_queue_file_removed (GFile *location)
 
 	queue = nautilus_file_changes_queue_get();
 
-	new_item = g_new0 (NautilusFileChange, 1);
+	new_item = g_slice_new0 (NautilusFileChange);
 	new_item->kind = CHANGE_FILE_REMOVED;
 	new_item->from = g_object_ref (location);
 	nautilus_file_changes_queue_add_common (queue, new_item);
@@ -135,7 +240,7 @@ nautilus_file_changes_queue_file_moved (GFile *from,
 
 	queue = nautilus_file_changes_queue_get ();
 
-	new_item = g_new (NautilusFileChange, 1);
+	new_item = g_slice_new0 (NautilusFileChange);
 	new_item->kind = CHANGE_FILE_MOVED;
 	new_item->from = g_object_ref (from);
 	new_item->to = g_object_ref (to);
@@ -152,7 +257,7 @@ nautilus_file_changes_queue_schedule_position_set (GFile *location,
 
 	queue = nautilus_file_changes_queue_get ();
 
-	new_item = g_new (NautilusFileChange, 1);
+	new_item = g_slice_new0 (NautilusFileChange);
 	new_item->kind = CHANGE_POSITION_SET;
 	new_item->from = g_object_ref (location);
 	new_item->point = point;
@@ -168,37 +273,83 @@ nautilus_file_changes_queue_schedule_position_remove (GFile *location)
 
 	queue = nautilus_file_changes_queue_get ();
 
-	new_item = g_new (NautilusFileChange, 1);
+	new_item = g_slice_new0 (NautilusFileChange);
 	new_item->kind = CHANGE_POSITION_REMOVE;
 	new_item->from = g_object_ref (location);
 	nautilus_file_changes_queue_add_common (queue, new_item);
 }
 
-static NautilusFileChange *
-nautilus_file_changes_queue_get_change (NautilusFileChangesQueue *queue)
+void
+nautilus_file_changes_queue_hold_directory (GFile *location)
 {
-	GList *new_tail;
-	NautilusFileChange *result;
+	NautilusFileChangesQueue *queue;
 
-	g_assert (queue != NULL);
-	
-	/* dequeue the tail item while locking down the list */
-	g_mutex_lock (&queue->mutex);
+	queue = nautilus_file_changes_queue_get ();
 
-	if (queue->tail == NULL) {
-		result = NULL;
-	} else {
-		new_tail = queue->tail->prev;
-		result = queue->tail->data;
-		queue->head = g_list_remove_link (queue->head,
-						  queue->tail);
-		g_list_free_1 (queue->tail);
-		queue->tail = new_tail;
+	g_mutex_lock (&queue->mutex);
+	if (g_hash_table_lookup (queue->held, location) == NULL) {
+		g_hash_table_insert (queue->held, g_object_ref (location),
+				     g_queue_new ());
 	}
+	g_mutex_unlock (&queue->mutex);
+}
+
+static void
+nautilus_file_changes_queue_hand_over (GFile *location,
+				       gboolean release)
+{
+	NautilusFileChangesQueue *queue;
+	GQueue *held;
+	GList *link;
 
+	queue = nautilus_file_changes_queue_get ();
+
+	g_mutex_lock (&queue->mutex);
+	held = g_hash_table_lookup (queue->held, location);
+	if (held != NULL) {
+		while ((link = g_queue_pop_head_link (held)) != NULL) {
+			g_queue_push_tail_link (&queue->changes, link);
+		}
+		if (release) {
+			g_hash_table_remove (queue->held, location);
+			g_queue_free (held);
+		}
+	}
 	g_mutex_unlock (&queue->mutex);
+}
 
-	return result;
+/* Moves the changes held for the directory to the main queue, to be
+ * picked up by the next nautilus_file_changes_consume_changes(). The
+ * directory stays held.
+ */
+void
+nautilus_file_changes_queue_flush_directory (GFile *location)
+{
+	nautilus_file_changes_queue_hand_over (location, FALSE);
+}
+
+void
+nautilus_file_changes_queue_release_directory (GFile *location)
+{
+	nautilus_file_changes_queue_hand_over (location, TRUE);
+}
+
+/* Take every queued change at once, so that producers only contend
+ * with the consumer for a single lock per batch.
+ */
+static void
+nautilus_file_changes_queue_steal_changes (NautilusFileChangesQueue *queue,
+					   GQueue *batch)
+{
+	g_assert (queue != NULL);
+
+	g_mutex_lock (&queue->mutex);
+
+	*batch = queue->changes;
+	g_queue_init (&queue->changes);
+	g_hash_table_remove_all (queue->pending);
+
+	g_mutex_unlock (&queue->mutex);
 }
 
 enum {
@@ -251,6 +402,7 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 	NautilusFileChangesQueuePosition *position_set;
 	guint chunk_count;
 	NautilusFileChangesQueue *queue;
+	GQueue batch;
 	gboolean flush_needed;
 	
 
@@ -261,6 +413,7 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 	position_set_requests = NULL;
 
 	queue = nautilus_file_changes_queue_get();
+	g_queue_init (&batch);
 		
 	/* Consume changes from the queue, stuffing them into one of three lists,
 	 * keep doing it while the changes are of the same kind, then send them off.
@@ -268,7 +421,19 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 	 * arrived.
 	 */
 	for (chunk_count = 0; ; chunk_count++) {
-		change = nautilus_file_changes_queue_get_change (queue);
+		change = g_queue_pop_head (&batch);
+		if (change == NULL) {
+			/* pick up anything queued since the last batch */
+			nautilus_file_changes_queue_steal_changes (queue, &batch);
+			change = g_queue_pop_head (&batch);
+		}
+
+		if (change != NULL && change->kind == CHANGE_CANCELLED) {
+			/* folded into a later change for the same file */
+			g_object_unref (change->from);
+			g_slice_free (NautilusFileChange, change);
+			continue;
+		}
 
 		/* figure out if we need to flush the pending changes that we collected sofar */
 
@@ -389,6 +554,6 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 			break;
 		}
 
-		g_free (change);
+		g_slice_free (NautilusFileChange, change);
 	}	
 }
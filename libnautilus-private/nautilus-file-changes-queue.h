@@ -34,6 +34,10 @@ void nautilus_file_changes_queue_schedule_position_set           (GFile      *lo
 								  int         screen);
 void nautilus_file_changes_queue_schedule_position_remove        (GFile      *location);
 
+void nautilus_file_changes_queue_hold_directory                  (GFile      *location);
+void nautilus_file_changes_queue_flush_directory                 (GFile      *location);
+void nautilus_file_changes_queue_release_directory               (GFile      *location);
+
 void nautilus_file_changes_consume_changes                       (gboolean    consume_all);
 
 
@@ -23,6 +23,7 @@
 #ifndef NAUTILUS_FILE_PRIVATE_H
 #define NAUTILUS_FILE_PRIVATE_H
 
+#include <libnautilus-private/nautilus-deep-count-cache.h>
 #include <libnautilus-private/nautilus-directory.h>
 #include <libnautilus-private/nautilus-file.h>
 #include <libnautilus-private/nautilus-monitor.h>
@@ -33,6 +34,14 @@
 #define NAUTILUS_FILE_DEFAULT_ATTRIBUTES				\
 	"standard::*,access::*,mountable::*,time::*,unix::*,owner::*,selinux::*,thumbnail::*,id::filesystem,trash::orig-path,trash::deletion-date,metadata::*"
 
+/* Cheap subset used for the first pass over a directory, so the view
+ * can be populated before the expensive attributes (sniffed content
+ * type, thumbnails, SELinux context, metadata) have been read. Those
+ * are filled in afterwards by a second pass with the default set.
+ */
+#define NAUTILUS_FILE_FAST_ATTRIBUTES					\
+	"standard::name,standard::display-name,standard::edit-name,standard::type,standard::size,standard::is-hidden,standard::is-backup,standard::is-symlink,standard::symlink-target,standard::fast-content-type,time::modified,unix::mode,unix::is-mountpoint"
+
 /* These are in the typical sort order. Known things come first, then
  * things where we can't know, finally things where we don't yet know.
  */
@@ -42,6 +51,61 @@ typedef enum {
 	UNKNOWN
 } Knowledge;
 
+/* Groups of fields that only a minority of files ever use. Each group
+ * is allocated the first time one of its fields is set, with the
+ * nautilus_file_ensure_* functions, and stays NULL otherwise; read
+ * them with NAUTILUS_FILE_PEEK so a missing group gives the default.
+ */
+typedef struct {
+	char *path;
+	GdkPixbuf *pixbuf;
+	time_t mtime;
+
+	GdkPixbuf *scaled_pixbuf;
+	double scale;
+} NautilusFileThumbnailDetails;
+
+typedef struct {
+	/* NautilusInfoProviders that need to be run for this file */
+	GList *pending_info_providers;
+
+	/* Emblems provided by extensions */
+	GList *emblems;
+	GList *pending_emblems;
+
+	/* Attributes provided by extensions */
+	GHashTable *attributes;
+	GHashTable *pending_attributes;
+} NautilusFileExtensionDetails;
+
+typedef struct {
+	/* File operations in progress; there are normally only a few. */
+	GList *operations_in_progress;
+
+	char *trash_orig_path;
+	time_t trash_time; /* 0 is unknown */
+
+	/* Mount for mountpoint or the references GMount for a "mountable" */
+	GMount *mount;
+
+	gdouble search_relevance;
+
+	guint64 free_space; /* (guint)-1 for unknown */
+	time_t free_space_read; /* The time free_space was updated, or 0 for never */
+} NautilusFileRareDetails;
+
+/* Number of string attributes a file keeps its sort value for, so that
+ * views sorting by different attributes don't evict each other. */
+#define NAUTILUS_FILE_SORT_VALUES 3
+
+typedef struct {
+	GQuark attribute;
+	char *value;
+} NautilusFileSortValue;
+
+#define NAUTILUS_FILE_PEEK(file, group, field, unset) \
+	((file)->details->group != NULL ? (file)->details->group->field : (unset))
+
 struct NautilusFileDetails
 {
 	NautilusDirectory *directory;
@@ -82,19 +146,11 @@ struct NautilusFileDetails
 	
 	guint directory_count;
 
-	guint deep_directory_count;
-	guint deep_file_count;
-	guint deep_unreadable_count;
-	goffset deep_size;
+	NautilusDeepCounts *deep_counts;
 
 	GIcon *icon;
 	
-	char *thumbnail_path;
-	GdkPixbuf *thumbnail;
-	time_t thumbnail_mtime;
-
-	GdkPixbuf *scaled_thumbnail;
-	double thumbnail_scale;
+	NautilusFileThumbnailDetails *thumbnail_details;
 
 	GList *mime_list; /* If this is a directory, the list of MIME types in it. */
 
@@ -107,30 +163,28 @@ struct NautilusFileDetails
 	 */
 	eel_ref_str filesystem_id;
 
-	char *trash_orig_path;
+	NautilusFileExtensionDetails *extension_details;
 
-	/* The following is for file operations in progress. Since
-	 * there are normally only a few of these, we can move them to
-	 * a separate hash table or something if required to keep the
-	 * file objects small.
-	 */
-	GList *operations_in_progress;
+	GHashTable *metadata;
 
-	/* NautilusInfoProviders that need to be run for this file */
-	GList *pending_info_providers;
+	/* Values of the last string attributes the file was sorted by,
+	 * most recent first, kept until the file changes. Unused slots
+	 * have attribute 0. */
+	NautilusFileSortValue sort_values[NAUTILUS_FILE_SORT_VALUES];
 
-	/* Emblems provided by extensions */
-	GList *extension_emblems;
-	GList *pending_extension_emblems;
+	/* Collation key of the type string when sorting by type; it's
+	 * shared by all files of the same type and only valid while
+	 * type_sort_key_generation matches the global one. */
+	const char *type_sort_key;
+	guint type_sort_key_generation;
 
-	/* Attributes provided by extensions */
-	GHashTable *extension_attributes;
-	GHashTable *pending_extension_attributes;
+	NautilusFileRareDetails *rare_details;
 
-	GHashTable *metadata;
-
-	/* Mount for mountpoint or the references GMount for a "mountable" */
-	GMount *mount;
+	/* Bumped on each "changed" signal. pending_changes collects what
+	 * changed since the last one, last_changes is what it reported. */
+	guint generation;
+	NautilusFileChangeFlags pending_changes;
+	NautilusFileChangeFlags last_changes;
 	
 	/* boolean fields: bitfield to save space, since there can be
            many NautilusFile objects. */
@@ -147,6 +201,8 @@ struct NautilusFileDetails
 	eel_boolean_bit got_file_info                 : 1;
 	eel_boolean_bit get_info_failed               : 1;
 	eel_boolean_bit file_info_is_up_to_date       : 1;
+	/* Only the NAUTILUS_FILE_FAST_ATTRIBUTES are known so far. */
+	eel_boolean_bit file_info_is_partial          : 1;
 	
 	eel_boolean_bit got_directory_count           : 1;
 	eel_boolean_bit directory_count_failed        : 1;
@@ -204,13 +260,6 @@ struct NautilusFileDetails
 	eel_boolean_bit filesystem_use_preview        : 2; /* GFilesystemPreviewType */
 	eel_boolean_bit filesystem_info_is_up_to_date : 1;
         eel_ref_str     filesystem_type;
-
-	time_t trash_time; /* 0 is unknown */
-
-	gdouble search_relevance;
-
-	guint64 free_space; /* (guint)-1 for unknown */
-	time_t free_space_read; /* The time free_space was updated, or 0 for never */
 };
 
 typedef struct {
@@ -229,19 +278,39 @@ NautilusFile *nautilus_file_new_from_info                  (NautilusDirectory
 							    GFileInfo              *info);
 void          nautilus_file_emit_changed                   (NautilusFile           *file);
 void          nautilus_file_mark_gone                      (NautilusFile           *file);
+void          nautilus_file_add_pending_changes            (NautilusFile           *file,
+							    NautilusFileChangeFlags changes);
 
 gboolean      nautilus_file_get_date                       (NautilusFile           *file,
 							    NautilusDateType        date_type,
 							    time_t                 *date);
 void          nautilus_file_updated_deep_count_in_progress (NautilusFile           *file);
 
+NautilusDeepCounts           *nautilus_file_ensure_deep_counts       (NautilusFile *file);
+NautilusFileThumbnailDetails *nautilus_file_ensure_thumbnail_details (NautilusFile *file);
+NautilusFileExtensionDetails *nautilus_file_ensure_extension_details (NautilusFile *file);
+NautilusFileRareDetails      *nautilus_file_ensure_rare_details      (NautilusFile *file);
+
 
 void          nautilus_file_clear_info                     (NautilusFile           *file);
+/* Free the sort keys; they're computed again when next needed. */
+void          nautilus_file_forget_collation_keys          (NautilusFile           *file);
+/* Compute the parts of the file state that only depend on the info
+ * (interned strings, name collation key, metadata) ahead of time; they're
+ * picked up by nautilus_file_update_info. Safe to call from any thread
+ * as long as nothing else uses the info meanwhile.
+ */
+void          nautilus_file_info_precompute                (GFileInfo              *info);
 /* Compare file's state with a fresh file info struct, return FALSE if
  * no change, update file and return TRUE if the file info contains
  * new state.  */
 gboolean      nautilus_file_update_info                    (NautilusFile           *file,
 							    GFileInfo              *info);
+/* Same for partial info from a reload of a file that has complete
+ * info: only the first-pass attributes are taken, the file is left
+ * partial for the second pass. */
+gboolean      nautilus_file_update_fast_info               (NautilusFile           *file,
+							    GFileInfo              *info);
 gboolean      nautilus_file_update_name                    (NautilusFile           *file,
 							    const char             *name);
 gboolean      nautilus_file_update_metadata_from_info      (NautilusFile           *file,
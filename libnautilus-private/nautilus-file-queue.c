@@ -116,6 +116,21 @@ nautilus_file_queue_head (NautilusFileQueue *queue)
 	return NAUTILUS_FILE (queue->head->data);
 }
 
+NautilusFile *
+nautilus_file_queue_next (NautilusFileQueue *queue,
+			  NautilusFile      *file)
+{
+	GList *link;
+
+	link = g_hash_table_lookup (queue->item_to_link_map, file);
+
+	if (link == NULL || link->next == NULL) {
+		return NULL;
+	}
+
+	return NAUTILUS_FILE (link->next->data);
+}
+
 gboolean
 nautilus_file_queue_is_empty (NautilusFileQueue *queue)
 {
@@ -63,6 +63,7 @@
 #include <libxml/parser.h>
 #include <pwd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
@@ -78,6 +79,13 @@
 /* Time in seconds to cache getpwuid results */
 #define GETPWUID_CACHE_TIME (5*60)
 
+/* Collation keys are computed when first needed for sorting. Below this
+ * many missing keys in a list, computing them in the calling thread is
+ * cheaper than handing them to the pool in chunks of this size.
+ */
+#define COLLATION_KEY_BATCH_MIN 512
+#define COLLATION_KEY_CHUNK_SIZE 128
+
 #define ICON_NAME_THUMBNAIL_LOADING   "image-loading"
 
 #undef NAUTILUS_FILE_DEBUG_REF
@@ -168,13 +176,121 @@ static gboolean update_info_and_name                         (NautilusFile
 							      GFileInfo             *info);
 static const char * nautilus_file_peek_display_name (NautilusFile *file);
 static const char * nautilus_file_peek_display_name_collation_key (NautilusFile *file);
+static const char * nautilus_file_peek_directory_name_collation_key (NautilusFile *file);
 static void file_mount_unmounted (GMount *mount,  gpointer data);
 static void metadata_hash_free (GHashTable *hash);
+static void forget_sort_attribute_values (NautilusFile *file);
+
+/* What nautilus_file_info_precompute() attaches to a GFileInfo. */
+typedef struct {
+	eel_ref_str owner;
+	eel_ref_str owner_real;
+	eel_ref_str group;
+	eel_ref_str mime_type;
+	eel_ref_str filesystem_id;
+	char *display_name_collation_key;
+	GHashTable *metadata;
+} FileInfoPrecomputed;
+
+#define FILE_INFO_PRECOMPUTED_KEY "nautilus-file-info-precomputed"
 
 G_DEFINE_TYPE_WITH_CODE (NautilusFile, nautilus_file, G_TYPE_OBJECT,
 			 G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_FILE_INFO,
 						nautilus_file_info_iface_init));
 
+/* Live files and the memory their side structs use, for the debug
+ * output below. Files are only created and destroyed in the main thread.
+ */
+static guint live_file_count;
+static gsize side_details_size;
+
+static void
+add_side_details_size (gsize size)
+{
+	side_details_size += size;
+}
+
+NautilusDeepCounts *
+nautilus_file_ensure_deep_counts (NautilusFile *file)
+{
+	if (file->details->deep_counts == NULL) {
+		file->details->deep_counts = g_slice_new0 (NautilusDeepCounts);
+		add_side_details_size (sizeof (NautilusDeepCounts));
+	}
+
+	return file->details->deep_counts;
+}
+
+NautilusFileThumbnailDetails *
+nautilus_file_ensure_thumbnail_details (NautilusFile *file)
+{
+	if (file->details->thumbnail_details == NULL) {
+		file->details->thumbnail_details = g_slice_new0 (NautilusFileThumbnailDetails);
+		add_side_details_size (sizeof (NautilusFileThumbnailDetails));
+	}
+
+	return file->details->thumbnail_details;
+}
+
+NautilusFileExtensionDetails *
+nautilus_file_ensure_extension_details (NautilusFile *file)
+{
+	if (file->details->extension_details == NULL) {
+		file->details->extension_details = g_slice_new0 (NautilusFileExtensionDetails);
+		add_side_details_size (sizeof (NautilusFileExtensionDetails));
+	}
+
+	return file->details->extension_details;
+}
+
+NautilusFileRareDetails *
+nautilus_file_ensure_rare_details (NautilusFile *file)
+{
+	if (file->details->rare_details == NULL) {
+		file->details->rare_details = g_slice_new0 (NautilusFileRareDetails);
+		file->details->rare_details->free_space = -1;
+		add_side_details_size (sizeof (NautilusFileRareDetails));
+	}
+
+	return file->details->rare_details;
+}
+
+static GMount *
+peek_mount (NautilusFile *file)
+{
+	return NAUTILUS_FILE_PEEK (file, rare_details, mount, NULL);
+}
+
+static void
+thumbnail_details_free (NautilusFileThumbnailDetails *thumbnail)
+{
+	g_free (thumbnail->path);
+	g_clear_object (&thumbnail->pixbuf);
+	g_clear_object (&thumbnail->scaled_pixbuf);
+	g_slice_free (NautilusFileThumbnailDetails, thumbnail);
+
+	side_details_size -= sizeof (NautilusFileThumbnailDetails);
+}
+
+static void
+extension_details_free (NautilusFileExtensionDetails *extension)
+{
+	g_list_free_full (extension->pending_emblems, g_free);
+	g_list_free_full (extension->emblems, g_free);
+	g_list_free_full (extension->pending_info_providers, g_object_unref);
+
+	if (extension->pending_attributes) {
+		g_hash_table_destroy (extension->pending_attributes);
+	}
+	
+	if (extension->attributes) {
+		g_hash_table_destroy (extension->attributes);
+	}
+	g_slice_free (NautilusFileExtensionDetails, extension);
+
+	side_details_size -= sizeof (NautilusFileExtensionDetails);
+}
+
 static void
 nautilus_file_init (NautilusFile *file)
 {
@@ -183,7 +299,16 @@ nautilus_file_init (NautilusFile *file)
 	nautilus_file_clear_info (file);
 	nautilus_file_invalidate_extension_info_internal (file);
 
-	file->details->free_space = -1;
+	live_file_count++;
+	if (live_file_count % 1000 == 0) {
+		guint hits, misses, unique_strings;
+
+		eel_ref_str_get_unique_statistics (&hits, &misses, &unique_strings);
+		DEBUG ("%u files, %" G_GSIZE_FORMAT " bytes each plus %" G_GSIZE_FORMAT " bytes of side details on average",
+		       live_file_count, sizeof (NautilusFileDetails), side_details_size / live_file_count);
+		DEBUG ("%u unique strings, %u lookups found an existing one, %u added one",
+		       unique_strings, hits, misses);
+	}
 }
 
 static GObject*
@@ -252,8 +377,9 @@ nautilus_file_set_display_name (NautilusFile *file,
 			file->details->display_name = eel_ref_str_new (display_name);
 		}
 		
+		/* Recomputed the next time we sort by name. */
 		g_free (file->details->display_name_collation_key);
-		file->details->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+		file->details->display_name_collation_key = NULL;
 	}
 
 	if (g_strcmp0 (eel_ref_str_peek (file->details->edit_name), edit_name) != 0) {
@@ -400,16 +526,136 @@ get_metadata_from_info (GFileInfo *info)
 	return metadata;
 }
 
+/* Info from the first directory loading pass only carries the
+ * fast content type; the real one comes with the second pass.
+ */
+static gboolean
+file_info_is_partial (GFileInfo *info)
+{
+	return !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE) &&
+		g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+}
+
+static const char *
+get_mime_type_from_info (GFileInfo *info)
+{
+	if (file_info_is_partial (info)) {
+		return g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+	}
+
+	return g_file_info_get_content_type (info);
+}
+
+static char *
+get_owner_from_info (GFileInfo *info)
+{
+	const char *owner;
+
+	owner = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER);
+	if (owner == NULL && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_UID)) {
+		return g_strdup_printf ("%d", (int) g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID));
+	}
+
+	return g_strdup (owner);
+}
+
+static char *
+get_group_from_info (GFileInfo *info)
+{
+	const char *group;
+
+	group = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP);
+	if (group == NULL && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_GID)) {
+		return g_strdup_printf ("%d", (int) g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID));
+	}
+
+	return g_strdup (group);
+}
+
+static void
+file_info_precomputed_free (FileInfoPrecomputed *precomputed)
+{
+	eel_ref_str_unref (precomputed->owner);
+	eel_ref_str_unref (precomputed->owner_real);
+	eel_ref_str_unref (precomputed->group);
+	eel_ref_str_unref (precomputed->mime_type);
+	eel_ref_str_unref (precomputed->filesystem_id);
+	g_free (precomputed->display_name_collation_key);
+	if (precomputed->metadata != NULL) {
+		metadata_hash_free (precomputed->metadata);
+	}
+	g_free (precomputed);
+}
+
+void
+nautilus_file_info_precompute (GFileInfo *info)
+{
+	FileInfoPrecomputed *precomputed;
+	const char *display_name;
+	char *owner, *group;
+
+	precomputed = g_new0 (FileInfoPrecomputed, 1);
+
+	owner = get_owner_from_info (info);
+	group = get_group_from_info (info);
+	precomputed->owner = eel_ref_str_get_unique (owner);
+	precomputed->group = eel_ref_str_get_unique (group);
+	g_free (owner);
+	g_free (group);
+
+	precomputed->owner_real = eel_ref_str_get_unique
+		(g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER_REAL));
+	precomputed->mime_type = eel_ref_str_get_unique
+		(get_mime_type_from_info (info));
+	precomputed->filesystem_id = eel_ref_str_get_unique
+		(g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM));
+
+	display_name = g_file_info_get_display_name (info);
+	if (display_name != NULL) {
+		precomputed->display_name_collation_key =
+			g_utf8_collate_key_for_filename (display_name, -1);
+	}
+
+	if (g_file_info_has_namespace (info, "metadata")) {
+		precomputed->metadata = get_metadata_from_info (info);
+	}
+
+	g_object_set_data_full (G_OBJECT (info), FILE_INFO_PRECOMPUTED_KEY,
+				precomputed,
+				(GDestroyNotify) file_info_precomputed_free);
+}
+
+/* Use the interned string prepared along with the info, if it's the
+ * right one.
+ */
+static eel_ref_str
+get_unique_string (const char *string,
+		   eel_ref_str precomputed)
+{
+	if (precomputed != NULL && g_strcmp0 (string, precomputed) == 0) {
+		return eel_ref_str_ref (precomputed);
+	}
+
+	return eel_ref_str_get_unique (string);
+}
+
 gboolean
 nautilus_file_update_metadata_from_info (NautilusFile *file,
 					 GFileInfo *info)
 {
+	FileInfoPrecomputed *precomputed;
 	gboolean changed = FALSE;
 
 	if (g_file_info_has_namespace (info, "metadata")) {
 		GHashTable *metadata;
 
-		metadata = get_metadata_from_info (info);
+		precomputed = g_object_get_data (G_OBJECT (info), FILE_INFO_PRECOMPUTED_KEY);
+		if (precomputed != NULL && precomputed->metadata != NULL) {
+			metadata = precomputed->metadata;
+			precomputed->metadata = NULL;
+		} else {
+			metadata = get_metadata_from_info (info);
+		}
 		if (!metadata_hash_equal (metadata,
 					  file->details->metadata)) {
 			changed = TRUE;
@@ -429,6 +675,7 @@ void
 nautilus_file_clear_info (NautilusFile *file)
 {
 	file->details->got_file_info = FALSE;
+	file->details->file_info_is_partial = FALSE;
 	if (file->details->get_info_error) {
 		g_error_free (file->details->get_info_error);
 		file->details->get_info_error = NULL;
@@ -452,8 +699,10 @@ nautilus_file_clear_info (NautilusFile *file)
 		file->details->icon = NULL;
 	}
 
-	g_free (file->details->thumbnail_path);
-	file->details->thumbnail_path = NULL;
+	if (file->details->thumbnail_details != NULL) {
+		g_free (file->details->thumbnail_details->path);
+		file->details->thumbnail_details->path = NULL;
+	}
 	file->details->thumbnailing_failed = FALSE;
 	
 	file->details->is_launcher = FALSE;
@@ -485,7 +734,9 @@ nautilus_file_clear_info (NautilusFile *file)
 	file->details->sort_order = 0;
 	file->details->mtime = 0;
 	file->details->atime = 0;
-	file->details->trash_time = 0;
+	if (file->details->rare_details != NULL) {
+		file->details->rare_details->trash_time = 0;
+	}
 	g_free (file->details->symlink_name);
 	file->details->symlink_name = NULL;
 	eel_ref_str_unref (file->details->mime_type);
@@ -511,16 +762,11 @@ void
 nautilus_file_set_directory (NautilusFile *file,
 			     NautilusDirectory *directory)
 {
-	char *parent_uri;
-
 	g_clear_object (&file->details->directory);
 	g_free (file->details->directory_name_collation_key);
+	file->details->directory_name_collation_key = NULL;
 
 	file->details->directory = nautilus_directory_ref (directory);
-
-	parent_uri = nautilus_file_get_parent_uri (file);
-	file->details->directory_name_collation_key = g_utf8_collate_key_for_filename (parent_uri, -1);
-	g_free (parent_uri);
 }
 
 static NautilusFile *
@@ -778,7 +1024,7 @@ finalize (GObject *object)
 
 	file = NAUTILUS_FILE (object);
 
-	g_assert (file->details->operations_in_progress == NULL);
+	g_assert (NAUTILUS_FILE_PEEK (file, rare_details, operations_in_progress, NULL) == NULL);
 
 	if (file->details->is_thumbnailing) {
 		uri = nautilus_file_get_uri (file);
@@ -813,8 +1059,8 @@ finalize (GObject *object)
 	if (file->details->icon) {
 		g_object_unref (file->details->icon);
 	}
-	g_free (file->details->thumbnail_path);
 	g_free (file->details->symlink_name);
+	forget_sort_attribute_values (file);
 	eel_ref_str_unref (file->details->mime_type);
 	eel_ref_str_unref (file->details->owner);
 	eel_ref_str_unref (file->details->owner_real);
@@ -824,40 +1070,41 @@ finalize (GObject *object)
 	g_free (file->details->activation_uri);
 	g_clear_object (&file->details->custom_icon);
 
-	if (file->details->thumbnail) {
-		g_object_unref (file->details->thumbnail);
+	if (file->details->thumbnail_details != NULL) {
+		thumbnail_details_free (file->details->thumbnail_details);
 	}
-	if (file->details->scaled_thumbnail) {
-		g_object_unref (file->details->scaled_thumbnail);
+
+	if (file->details->rare_details != NULL) {
+		if (file->details->rare_details->mount) {
+			g_signal_handlers_disconnect_by_func (file->details->rare_details->mount, file_mount_unmounted, file);
+			g_object_unref (file->details->rare_details->mount);
+		}
+		g_free (file->details->rare_details->trash_orig_path);
+		g_slice_free (NautilusFileRareDetails, file->details->rare_details);
+		side_details_size -= sizeof (NautilusFileRareDetails);
 	}
 
-	if (file->details->mount) {
-		g_signal_handlers_disconnect_by_func (file->details->mount, file_mount_unmounted, file);
-		g_object_unref (file->details->mount);
+	if (file->details->deep_counts != NULL) {
+		g_slice_free (NautilusDeepCounts, file->details->deep_counts);
+		side_details_size -= sizeof (NautilusDeepCounts);
 	}
 
 	eel_ref_str_unref (file->details->filesystem_id);
 	eel_ref_str_unref (file->details->filesystem_type);
         file->details->filesystem_type = NULL;
-	g_free (file->details->trash_orig_path);
 
 	g_list_free_full (file->details->mime_list, g_free);
-	g_list_free_full (file->details->pending_extension_emblems, g_free);
-	g_list_free_full (file->details->extension_emblems, g_free);
-	g_list_free_full (file->details->pending_info_providers, g_object_unref);
 
-	if (file->details->pending_extension_attributes) {
-		g_hash_table_destroy (file->details->pending_extension_attributes);
-	}
-	
-	if (file->details->extension_attributes) {
-		g_hash_table_destroy (file->details->extension_attributes);
+	if (file->details->extension_details != NULL) {
+		extension_details_free (file->details->extension_details);
 	}
 
 	if (file->details->metadata) {
 		metadata_hash_free (file->details->metadata);
 	}
 
+	live_file_count--;
+
 	G_OBJECT_CLASS (nautilus_file_parent_class)->finalize (object);
 }
 
@@ -1045,8 +1292,8 @@ nautilus_file_can_unmount (NautilusFile *file)
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), FALSE);
 
 	return file->details->can_unmount ||
-		(file->details->mount != NULL &&
-		 g_mount_can_unmount (file->details->mount));
+		(peek_mount (file) != NULL &&
+		 g_mount_can_unmount (peek_mount (file)));
 }
 	
 gboolean
@@ -1055,8 +1302,8 @@ nautilus_file_can_eject (NautilusFile *file)
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), FALSE);
 
 	return file->details->can_eject ||
-		(file->details->mount != NULL &&
-		 g_mount_can_eject (file->details->mount));
+		(peek_mount (file) != NULL &&
+		 g_mount_can_eject (peek_mount (file)));
 }
 
 gboolean
@@ -1074,8 +1321,8 @@ nautilus_file_can_start (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_can_start (drive);
 			g_object_unref (drive);
@@ -1101,8 +1348,8 @@ nautilus_file_can_start_degraded (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_can_start_degraded (drive);
 			g_object_unref (drive);
@@ -1128,8 +1375,8 @@ nautilus_file_can_poll_for_media (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_can_poll_for_media (drive);
 			g_object_unref (drive);
@@ -1155,8 +1402,8 @@ nautilus_file_is_media_check_automatic (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_is_media_check_automatic (drive);
 			g_object_unref (drive);
@@ -1183,8 +1430,8 @@ nautilus_file_can_stop (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_can_stop (drive);
 			g_object_unref (drive);
@@ -1207,8 +1454,8 @@ nautilus_file_get_start_stop_type (NautilusFile *file)
 	if (ret != G_DRIVE_START_STOP_TYPE_UNKNOWN)
 		goto out;
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_get_start_stop_type (drive);
 			g_object_unref (drive);
@@ -1282,13 +1529,13 @@ nautilus_file_unmount (NautilusFile                   *file,
 				g_error_free (error);
 			}
 		}
-	} else if (file->details->mount != NULL &&
-		   g_mount_can_unmount (file->details->mount)) {
+	} else if (peek_mount (file) != NULL &&
+		   g_mount_can_unmount (peek_mount (file))) {
 		data = g_new0 (UnmountData, 1);
 		data->file = nautilus_file_ref (file);
 		data->callback = callback;
 		data->callback_data = callback_data;
-		nautilus_file_operations_unmount_mount_full (NULL, file->details->mount, NULL, FALSE, TRUE, unmount_done, data);
+		nautilus_file_operations_unmount_mount_full (NULL, peek_mount (file), NULL, FALSE, TRUE, unmount_done, data);
 	} else if (callback) {
 		callback (file, NULL, NULL, callback_data);
 	}
@@ -1316,13 +1563,13 @@ nautilus_file_eject (NautilusFile                   *file,
 				g_error_free (error);
 			}
 		}
-	} else if (file->details->mount != NULL &&
-		   g_mount_can_eject (file->details->mount)) {
+	} else if (peek_mount (file) != NULL &&
+		   g_mount_can_eject (peek_mount (file))) {
 		data = g_new0 (UnmountData, 1);
 		data->file = nautilus_file_ref (file);
 		data->callback = callback;
 		data->callback_data = callback_data;
-		nautilus_file_operations_unmount_mount_full (NULL, file->details->mount, NULL, TRUE, TRUE, unmount_done, data);
+		nautilus_file_operations_unmount_mount_full (NULL, peek_mount (file), NULL, TRUE, TRUE, unmount_done, data);
 	} else if (callback) {
 		callback (file, NULL, NULL, callback_data);
 	}
@@ -1405,8 +1652,8 @@ nautilus_file_stop (NautilusFile                   *file,
 		GDrive *drive;
 
 		drive = NULL;
-		if (file->details->mount != NULL)
-			drive = g_mount_get_drive (file->details->mount);
+		if (peek_mount (file) != NULL)
+			drive = g_mount_get_drive (peek_mount (file));
 
 		if (drive != NULL && g_drive_can_stop (drive)) {
 			NautilusFileOperation *op;
@@ -1446,9 +1693,9 @@ nautilus_file_poll_for_media (NautilusFile *file)
 		if (NAUTILUS_FILE_GET_CLASS (file)->stop != NULL) {
 			NAUTILUS_FILE_GET_CLASS (file)->poll_for_media (file);
 		}
-	} else if (file->details->mount != NULL) {
+	} else if (peek_mount (file) != NULL) {
 		GDrive *drive;
-		drive = g_mount_get_drive (file->details->mount);
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			g_drive_poll_for_media (drive,
 						NULL,  /* cancellable */
@@ -1649,6 +1896,7 @@ nautilus_file_operation_new (NautilusFile *file,
 			     gpointer callback_data)
 {
 	NautilusFileOperation *op;
+	NautilusFileRareDetails *rare;
 
 	op = g_new0 (NautilusFileOperation, 1);
 	op->file = nautilus_file_ref (file);
@@ -1656,8 +1904,9 @@ nautilus_file_operation_new (NautilusFile *file,
 	op->callback_data = callback_data;
 	op->cancellable = g_cancellable_new ();
 
-	op->file->details->operations_in_progress = g_list_prepend
-		(op->file->details->operations_in_progress, op);
+	rare = nautilus_file_ensure_rare_details (file);
+	rare->operations_in_progress = g_list_prepend
+		(rare->operations_in_progress, op);
 
 	return op;
 }
@@ -1665,8 +1914,11 @@ nautilus_file_operation_new (NautilusFile *file,
 static void
 nautilus_file_operation_remove (NautilusFileOperation *op)
 {
-	op->file->details->operations_in_progress = g_list_remove
-		(op->file->details->operations_in_progress, op);
+	NautilusFileRareDetails *rare;
+
+	rare = op->file->details->rare_details;
+	rare->operations_in_progress = g_list_remove
+		(rare->operations_in_progress, op);
 }
 
 void
@@ -1859,6 +2111,7 @@ nautilus_file_rename (NautilusFile *file,
 		 * see the "reverting" to the old name as "changing
 		 * back".
 		 */
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_NAME);
 		nautilus_file_changed (file);
 		error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
 				     _("File not found"));
@@ -1887,6 +2140,7 @@ nautilus_file_rename (NautilusFile *file,
 		 * see the "reverting" to the old name as "changing
 		 * back".
 		 */
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_NAME);
 		nautilus_file_changed (file);
 		error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
 				     _("Toplevel files cannot be renamed"));
@@ -1996,7 +2250,7 @@ nautilus_file_rename_in_progress (NautilusFile *file)
 	GList *node;
 	NautilusFileOperation *op;
 
-	for (node = file->details->operations_in_progress; node != NULL; node = node->next) {
+	for (node = NAUTILUS_FILE_PEEK (file, rare_details, operations_in_progress, NULL); node != NULL; node = node->next) {
 		op = node->data;
 		if (op->is_rename) {
 			return TRUE;
@@ -2013,7 +2267,7 @@ nautilus_file_cancel (NautilusFile *file,
 	GList *node, *next;
 	NautilusFileOperation *op;
 
-	for (node = file->details->operations_in_progress; node != NULL; node = next) {
+	for (node = NAUTILUS_FILE_PEEK (file, rare_details, operations_in_progress, NULL); node != NULL; node = next) {
 		next = node->next;
 		op = node->data;
 
@@ -2116,7 +2370,7 @@ update_info_internal (NautilusFile *file,
 		      gboolean update_name)
 {
 	GList *node;
-	gboolean changed;
+	NautilusFileChangeFlags changes;
 	gboolean is_symlink, is_hidden, is_mountpoint;
 	gboolean has_permissions;
 	guint32 permissions;
@@ -2139,8 +2393,9 @@ update_info_internal (NautilusFile *file,
 	const char *description;
 	const char *filesystem_id;
 	const char *trash_orig_path;
-	const char *group, *owner, *owner_real;
-	gboolean free_owner, free_group;
+	const char *owner_real;
+	char *owner, *group;
+	FileInfoPrecomputed *precomputed;
 	
 	if (file->details->is_gone) {
 		return FALSE;
@@ -2152,6 +2407,9 @@ update_info_internal (NautilusFile *file,
 	}
 
 	file->details->file_info_is_up_to_date = TRUE;
+	file->details->file_info_is_partial = file_info_is_partial (info);
+
+	precomputed = g_object_get_data (G_OBJECT (info), FILE_INFO_PRECOMPUTED_KEY);
 
 	/* FIXME bugzilla.gnome.org 42044: Need to let links that
 	 * point to the old name know that the file has been renamed.
@@ -2159,22 +2417,32 @@ update_info_internal (NautilusFile *file,
 
 	remove_from_link_hash_table (file);
 
-	changed = FALSE;
+	changes = 0;
 
 	if (!file->details->got_file_info) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_ALL;
 	}
 	file->details->got_file_info = TRUE;
 
-	changed |= nautilus_file_set_display_name (file,
-						  g_file_info_get_display_name (info),
-						  g_file_info_get_edit_name (info),
-						  FALSE);
+	if (nautilus_file_set_display_name (file,
+					    g_file_info_get_display_name (info),
+					    g_file_info_get_edit_name (info),
+					    FALSE)) {
+		changes |= NAUTILUS_FILE_CHANGE_NAME;
+	}
+	if (file->details->display_name_collation_key == NULL &&
+	    precomputed != NULL &&
+	    precomputed->display_name_collation_key != NULL &&
+	    g_strcmp0 (eel_ref_str_peek (file->details->display_name),
+		       g_file_info_get_display_name (info)) == 0) {
+		file->details->display_name_collation_key = precomputed->display_name_collation_key;
+		precomputed->display_name_collation_key = NULL;
+	}
 
-	mime_type = g_file_info_get_content_type (info);
+	mime_type = get_mime_type_from_info (info);
 	file_type = g_file_info_get_file_type (info);
 	if (file->details->type != file_type) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_MIME_TYPE | NAUTILUS_FILE_CHANGE_ICON;
 	}
 	file->details->type = file_type;
 
@@ -2185,7 +2453,7 @@ update_info_internal (NautilusFile *file,
 			if (file->details->activation_uri) {
 				g_free (file->details->activation_uri);
 				file->details->activation_uri = NULL;
-				changed = TRUE;
+				changes |= NAUTILUS_FILE_CHANGE_OTHER;
 			}
 		} else {
 			old_activation_uri = file->details->activation_uri;
@@ -2194,30 +2462,30 @@ update_info_internal (NautilusFile *file,
 			if (old_activation_uri) {
 				if (strcmp (old_activation_uri,
 					    file->details->activation_uri) != 0) {
-					changed = TRUE;
+					changes |= NAUTILUS_FILE_CHANGE_OTHER;
 				}
 				g_free (old_activation_uri);
 			} else {
-				changed = TRUE;
+				changes |= NAUTILUS_FILE_CHANGE_OTHER;
 			}
 		}
 	}
 	
 	is_symlink = g_file_info_get_is_symlink (info);
 	if (file->details->is_symlink != is_symlink) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_ICON | NAUTILUS_FILE_CHANGE_OTHER;
 	}
 	file->details->is_symlink = is_symlink;
 
 	is_hidden = g_file_info_get_is_hidden (info) || g_file_info_get_is_backup (info);
 	if (file->details->is_hidden != is_hidden) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
 	}
 	file->details->is_hidden = is_hidden;
 
 	is_mountpoint = g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_UNIX_IS_MOUNTPOINT);
 	if (file->details->is_mountpoint != is_mountpoint) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
 	}
 	file->details->is_mountpoint = is_mountpoint;
 
@@ -2225,7 +2493,7 @@ update_info_internal (NautilusFile *file,
 	permissions = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);;
 	if (file->details->has_permissions != has_permissions ||
 	    file->details->permissions != permissions) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON;
 	}
 	file->details->has_permissions = has_permissions;
 	file->details->permissions = permissions;
@@ -2321,7 +2589,7 @@ update_info_internal (NautilusFile *file,
 	    file->details->start_stop_type != start_stop_type ||
 	    file->details->can_poll_for_media != can_poll_for_media ||
 	    file->details->is_media_check_automatic != is_media_check_automatic) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON;
 	}
 	
 	file->details->can_read = can_read;
@@ -2340,72 +2608,61 @@ update_info_internal (NautilusFile *file,
 	file->details->can_poll_for_media = can_poll_for_media;
 	file->details->is_media_check_automatic = is_media_check_automatic;
 
-	free_owner = FALSE;
-	owner = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER);
+	owner = get_owner_from_info (info);
 	owner_real = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER_REAL);
-	free_group = FALSE;
-	group = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP);
+	group = get_group_from_info (info);
 	
 	uid = -1;
 	gid = -1;
 	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_UID)) {
 		uid = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID);
-		if (owner == NULL) {
-			free_owner = TRUE;
-			owner = g_strdup_printf ("%d", uid);
-		}
 	}
 	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_GID)) {
 		gid = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID);
-		if (group == NULL) {
-			free_group = TRUE;
-			group = g_strdup_printf ("%d", gid);
-		}
 	}
 	if (file->details->uid != uid ||
 	    file->details->gid != gid) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON;
 	}
 	file->details->uid = uid;
 	file->details->gid = gid;
 
 	if (g_strcmp0 (eel_ref_str_peek (file->details->owner), owner) != 0) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON;
 		eel_ref_str_unref (file->details->owner);
-		file->details->owner = eel_ref_str_get_unique (owner);
+		file->details->owner = get_unique_string
+			(owner, precomputed != NULL ? precomputed->owner : NULL);
 	}
 	
 	if (g_strcmp0 (eel_ref_str_peek (file->details->owner_real), owner_real) != 0) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON;
 		eel_ref_str_unref (file->details->owner_real);
-		file->details->owner_real = eel_ref_str_get_unique (owner_real);
+		file->details->owner_real = get_unique_string
+			(owner_real, precomputed != NULL ? precomputed->owner_real : NULL);
 	}
 	
 	if (g_strcmp0 (eel_ref_str_peek (file->details->group), group) != 0) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON;
 		eel_ref_str_unref (file->details->group);
-		file->details->group = eel_ref_str_get_unique (group);
+		file->details->group = get_unique_string
+			(group, precomputed != NULL ? precomputed->group : NULL);
 	}
 
-	if (free_owner) {
-		g_free ((char *)owner);
-	}
-	if (free_group) {
-		g_free ((char *)group);
-	}
+	g_free (owner);
+	g_free (group);
 	
 	size = -1;
 	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
 		size = g_file_info_get_size (info);
 	}
 	if (file->details->size != size) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_SIZE;
 	}
 	file->details->size = size;
 
 	sort_order = g_file_info_get_sort_order (info);
 	if (file->details->sort_order != sort_order) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
 	}
 	file->details->sort_order = sort_order;
 	
@@ -2413,78 +2670,94 @@ update_info_internal (NautilusFile *file,
 	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
 	if (file->details->atime != atime ||
 	    file->details->mtime != mtime) {
-		if (file->details->thumbnail == NULL) {
+		if (NAUTILUS_FILE_PEEK (file, thumbnail_details, pixbuf, NULL) == NULL) {
 			file->details->thumbnail_is_up_to_date = FALSE;
 		}
 
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_TIMES;
 	}
 	file->details->atime = atime;
 	file->details->mtime = mtime;
 
-	if (file->details->thumbnail != NULL &&
-	    file->details->thumbnail_mtime != 0 &&
-	    file->details->thumbnail_mtime != mtime) {
+	if (NAUTILUS_FILE_PEEK (file, thumbnail_details, pixbuf, NULL) != NULL &&
+	    file->details->thumbnail_details->mtime != 0 &&
+	    file->details->thumbnail_details->mtime != mtime) {
 		file->details->thumbnail_is_up_to_date = FALSE;
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_ICON;
 	}
 
-	icon = g_file_info_get_icon (info);
-	if (!g_icon_equal (icon, file->details->icon)) {
-		changed = TRUE;
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_ICON)) {
+		icon = g_object_ref (g_file_info_get_icon (info));
+	} else if (mime_type != NULL) {
+		/* Partial info has no icon, guess one from the fast
+		 * content type until the full info arrives.
+		 */
+		icon = g_content_type_get_icon (mime_type);
+	} else {
+		icon = NULL;
+	}
+	if (icon != NULL && !g_icon_equal (icon, file->details->icon)) {
+		changes |= NAUTILUS_FILE_CHANGE_ICON;
 
 		if (file->details->icon) {
 			g_object_unref (file->details->icon);
 		}
 		file->details->icon = g_object_ref (icon);
 	}
+	if (icon != NULL) {
+		g_object_unref (icon);
+	}
 
 	thumbnail_path =  g_file_info_get_attribute_byte_string (info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH);
-	if (g_strcmp0 (file->details->thumbnail_path, thumbnail_path) != 0) {
-		changed = TRUE;
-		g_free (file->details->thumbnail_path);
-		file->details->thumbnail_path = g_strdup (thumbnail_path);
+	if (g_strcmp0 (NAUTILUS_FILE_PEEK (file, thumbnail_details, path, NULL), thumbnail_path) != 0) {
+		NautilusFileThumbnailDetails *thumbnail;
+
+		changes |= NAUTILUS_FILE_CHANGE_ICON;
+		thumbnail = nautilus_file_ensure_thumbnail_details (file);
+		g_free (thumbnail->path);
+		thumbnail->path = g_strdup (thumbnail_path);
 	}
 
 	thumbnailing_failed =  g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED);
 	if (file->details->thumbnailing_failed != thumbnailing_failed) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_ICON;
 		file->details->thumbnailing_failed = thumbnailing_failed;
 	}
 	
 	symlink_name = g_file_info_get_symlink_target (info);
 	if (g_strcmp0 (file->details->symlink_name, symlink_name) != 0) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
 		g_free (file->details->symlink_name);
 		file->details->symlink_name = g_strdup (symlink_name);
 	}
 
-	mime_type = g_file_info_get_content_type (info);
 	if (g_strcmp0 (eel_ref_str_peek (file->details->mime_type), mime_type) != 0) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_MIME_TYPE | NAUTILUS_FILE_CHANGE_ICON;
 		eel_ref_str_unref (file->details->mime_type);
-		file->details->mime_type = eel_ref_str_get_unique (mime_type);
+		file->details->mime_type = get_unique_string
+			(mime_type, precomputed != NULL ? precomputed->mime_type : NULL);
 	}
 	
 	selinux_context = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_SELINUX_CONTEXT);
 	if (g_strcmp0 (file->details->selinux_context, selinux_context) != 0) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_PERMISSIONS;
 		g_free (file->details->selinux_context);
 		file->details->selinux_context = g_strdup (selinux_context);
 	}
 	
 	description = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_DESCRIPTION);
 	if (g_strcmp0 (file->details->description, description) != 0) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
 		g_free (file->details->description);
 		file->details->description = g_strdup (description);
 	}
 
 	filesystem_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
 	if (g_strcmp0 (eel_ref_str_peek (file->details->filesystem_id), filesystem_id) != 0) {
-		changed = TRUE;
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
 		eel_ref_str_unref (file->details->filesystem_id);
-		file->details->filesystem_id = eel_ref_str_get_unique (filesystem_id);
+		file->details->filesystem_id = get_unique_string
+			(filesystem_id, precomputed != NULL ? precomputed->filesystem_id : NULL);
 	}
 
 	trash_time = 0;
@@ -2493,26 +2766,31 @@ update_info_internal (NautilusFile *file,
 		g_time_val_from_iso8601 (time_string, &g_trash_time);
 		trash_time = g_trash_time.tv_sec;
 	}
-	if (file->details->trash_time != trash_time) {
-		changed = TRUE;
-		file->details->trash_time = trash_time;
+	if (NAUTILUS_FILE_PEEK (file, rare_details, trash_time, 0) != trash_time) {
+		changes |= NAUTILUS_FILE_CHANGE_TIMES;
+		nautilus_file_ensure_rare_details (file)->trash_time = trash_time;
 	}
 
 	trash_orig_path = g_file_info_get_attribute_byte_string (info, "trash::orig-path");
-	if (g_strcmp0 (file->details->trash_orig_path, trash_orig_path) != 0) {
-		changed = TRUE;
-		g_free (file->details->trash_orig_path);
-		file->details->trash_orig_path = g_strdup (trash_orig_path);
+	if (g_strcmp0 (NAUTILUS_FILE_PEEK (file, rare_details, trash_orig_path, NULL), trash_orig_path) != 0) {
+		NautilusFileRareDetails *rare;
+
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
+		rare = nautilus_file_ensure_rare_details (file);
+		g_free (rare->trash_orig_path);
+		rare->trash_orig_path = g_strdup (trash_orig_path);
 	}
 
-	changed |=
-		nautilus_file_update_metadata_from_info (file, info);
+	/* metadata may carry a custom icon */
+	if (nautilus_file_update_metadata_from_info (file, info)) {
+		changes |= NAUTILUS_FILE_CHANGE_ICON | NAUTILUS_FILE_CHANGE_OTHER;
+	}
 
 	if (update_name) {
 		name = g_file_info_get_name (info);
 		if (file->details->name == NULL ||
 		    strcmp (eel_ref_str_peek (file->details->name), name) != 0) {
-			changed = TRUE;
+			changes |= NAUTILUS_FILE_CHANGE_NAME;
 
 			node = nautilus_directory_begin_file_name_change
 				(file->details->directory, file);
@@ -2539,13 +2817,15 @@ update_info_internal (NautilusFile *file,
 		}
 	}
 
-	if (changed) {
+	if (changes != 0) {
 		add_to_link_hash_table (file);
 		
 		update_links_if_target (file);
 	}
 
-	return changed;
+	nautilus_file_add_pending_changes (file, changes);
+
+	return changes != 0;
 }
 
 static gboolean
@@ -2562,6 +2842,117 @@ nautilus_file_update_info (NautilusFile *file,
 	return update_info_internal (file, info, FALSE);
 }
 
+/* Apply the first-pass attributes of a partial info to a file that
+ * already has complete info. Everything only the full query knows
+ * (content type, icon, owner, access rights, thumbnail, metadata) is
+ * kept until the second pass replaces it.
+ */
+gboolean
+nautilus_file_update_fast_info (NautilusFile *file,
+				GFileInfo *info)
+{
+	NautilusFileChangeFlags changes;
+	gboolean is_symlink, is_hidden, is_mountpoint;
+	gboolean has_permissions;
+	guint32 permissions;
+	GFileType file_type;
+	const char *symlink_name;
+	goffset size;
+	time_t mtime;
+
+	if (file->details->is_gone) {
+		return FALSE;
+	}
+
+	if (info == NULL) {
+		nautilus_file_mark_gone (file);
+		return TRUE;
+	}
+
+	file->details->file_info_is_up_to_date = TRUE;
+	file->details->file_info_is_partial = TRUE;
+
+	remove_from_link_hash_table (file);
+
+	changes = 0;
+
+	if (nautilus_file_set_display_name (file,
+					    g_file_info_get_display_name (info),
+					    g_file_info_get_edit_name (info),
+					    FALSE)) {
+		changes |= NAUTILUS_FILE_CHANGE_NAME;
+	}
+
+	file_type = g_file_info_get_file_type (info);
+	if (file->details->type != file_type) {
+		changes |= NAUTILUS_FILE_CHANGE_MIME_TYPE | NAUTILUS_FILE_CHANGE_ICON;
+	}
+	file->details->type = file_type;
+
+	is_symlink = g_file_info_get_is_symlink (info);
+	if (file->details->is_symlink != is_symlink) {
+		changes |= NAUTILUS_FILE_CHANGE_ICON | NAUTILUS_FILE_CHANGE_OTHER;
+	}
+	file->details->is_symlink = is_symlink;
+
+	symlink_name = g_file_info_get_symlink_target (info);
+	if (g_strcmp0 (file->details->symlink_name, symlink_name) != 0) {
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
+		g_free (file->details->symlink_name);
+		file->details->symlink_name = g_strdup (symlink_name);
+	}
+
+	is_hidden = g_file_info_get_is_hidden (info) || g_file_info_get_is_backup (info);
+	if (file->details->is_hidden != is_hidden) {
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
+	}
+	file->details->is_hidden = is_hidden;
+
+	is_mountpoint = g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_UNIX_IS_MOUNTPOINT);
+	if (file->details->is_mountpoint != is_mountpoint) {
+		changes |= NAUTILUS_FILE_CHANGE_OTHER;
+	}
+	file->details->is_mountpoint = is_mountpoint;
+
+	has_permissions = g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_MODE);
+	permissions = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);
+	if (file->details->has_permissions != has_permissions ||
+	    file->details->permissions != permissions) {
+		changes |= NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON;
+	}
+	file->details->has_permissions = has_permissions;
+	file->details->permissions = permissions;
+
+	size = -1;
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
+		size = g_file_info_get_size (info);
+	}
+	if (file->details->size != size) {
+		changes |= NAUTILUS_FILE_CHANGE_SIZE;
+	}
+	file->details->size = size;
+
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	if (file->details->mtime != mtime) {
+		/* The thumbnail is regenerated once the full info
+		 * reports the new thumbnail path.
+		 */
+		file->details->thumbnail_is_up_to_date = FALSE;
+		changes |= NAUTILUS_FILE_CHANGE_TIMES;
+	}
+	file->details->mtime = mtime;
+
+	if (changes != 0) {
+		add_to_link_hash_table (file);
+
+		update_links_if_target (file);
+	}
+
+	nautilus_file_add_pending_changes (file, changes);
+
+	return changes != 0;
+}
+
 static gboolean
 update_name_internal (NautilusFile *file,
 		      const char *name,
@@ -2743,7 +3134,7 @@ get_time (NautilusFile *file,
 		time = file->details->atime;
 		break;
 	case NAUTILUS_DATE_TYPE_TRASHED:
-		time = file->details->trash_time;
+		time = NAUTILUS_FILE_PEEK (file, rare_details, trash_time, 0);
 		break;
 	default:
 		g_assert_not_reached ();
@@ -2905,8 +3296,8 @@ compare_by_display_name (NautilusFile *file_1, NautilusFile *file_2)
 static int
 compare_by_directory_name (NautilusFile *file_1, NautilusFile *file_2)
 {
-	return strcmp (file_1->details->directory_name_collation_key,
-		       file_2->details->directory_name_collation_key);
+	return strcmp (nautilus_file_peek_directory_name_collation_key (file_1),
+		       nautilus_file_peek_directory_name_collation_key (file_2));
 }
 
 static GList *
@@ -2943,19 +3334,124 @@ prepend_automatic_keywords (NautilusFile *file,
 	return names;
 }
 
+/* The type string only depends on the MIME type and on whether the file
+ * is executable or a symbolic link, so its collation key is kept per
+ * MIME type for each combination of the two. Files point at the key of
+ * their type, so files of the same type share the same pointer. Clearing
+ * the keys bumps the generation, which invalidates those pointers.
+ * Main thread only.
+ */
+enum {
+	TYPE_SORT_KEY_EXECUTABLE = 1 << 0,
+	TYPE_SORT_KEY_LINK = 1 << 1,
+	TYPE_SORT_KEY_VARIANTS = 1 << 2
+};
+
+typedef struct {
+	char *keys[TYPE_SORT_KEY_VARIANTS];
+	guint known : TYPE_SORT_KEY_VARIANTS;
+} TypeSortKeys;
+
+static GHashTable *type_sort_keys = NULL;
+static char *broken_link_sort_key = NULL;
+static guint type_sort_keys_generation = 1;
+
+static void
+type_sort_keys_free (TypeSortKeys *keys)
+{
+	int i;
+
+	for (i = 0; i < TYPE_SORT_KEY_VARIANTS; i++) {
+		g_free (keys->keys[i]);
+	}
+	g_free (keys);
+}
+
+static void
+clear_type_sort_keys (void)
+{
+	if (type_sort_keys != NULL) {
+		g_hash_table_remove_all (type_sort_keys);
+	}
+	g_clear_pointer (&broken_link_sort_key, g_free);
+	type_sort_keys_generation++;
+}
+
+static const char *
+lookup_type_sort_key (NautilusFile *file)
+{
+	TypeSortKeys *keys;
+	const char *mime_type;
+	char *type_string;
+	int variant;
+
+	if (nautilus_file_is_broken_symbolic_link (file)) {
+		if (broken_link_sort_key == NULL) {
+			broken_link_sort_key = g_utf8_collate_key (_("Link (broken)"), -1);
+		}
+		return broken_link_sort_key;
+	}
+
+	if (type_sort_keys == NULL) {
+		type_sort_keys = g_hash_table_new_full (g_str_hash, g_str_equal,
+							g_free, (GDestroyNotify) type_sort_keys_free);
+	}
+
+	mime_type = eel_ref_str_peek (file->details->mime_type);
+	if (mime_type == NULL) {
+		mime_type = "";
+	}
+
+	keys = g_hash_table_lookup (type_sort_keys, mime_type);
+	if (keys == NULL) {
+		keys = g_new0 (TypeSortKeys, 1);
+		g_hash_table_insert (type_sort_keys, g_strdup (mime_type), keys);
+	}
+
+	variant = 0;
+	if (nautilus_file_is_executable (file)) {
+		variant |= TYPE_SORT_KEY_EXECUTABLE;
+	}
+	if (nautilus_file_is_symbolic_link (file)) {
+		variant |= TYPE_SORT_KEY_LINK;
+	}
+
+	if (!(keys->known & (1 << variant))) {
+		type_string = nautilus_file_get_type_as_string (file);
+		if (type_string != NULL) {
+			keys->keys[variant] = g_utf8_collate_key (type_string, -1);
+			g_free (type_string);
+		}
+		keys->known |= 1 << variant;
+	}
+
+	return keys->keys[variant];
+}
+
+/* Returns the collation key of the file's type string, or NULL if it
+ * has none. Only reads the file once the key was looked up for it.
+ */
+static const char *
+get_type_sort_key (NautilusFile *file)
+{
+	if (file->details->type_sort_key_generation != type_sort_keys_generation) {
+		file->details->type_sort_key = lookup_type_sort_key (file);
+		file->details->type_sort_key_generation = type_sort_keys_generation;
+	}
+
+	return file->details->type_sort_key;
+}
+
 static int
 compare_by_type (NautilusFile *file_1, NautilusFile *file_2)
 {
 	gboolean is_directory_1;
 	gboolean is_directory_2;
-	char *type_string_1;
-	char *type_string_2;
-	int result;
+	const char *key_1;
+	const char *key_2;
 
-	/* Directories go first. Then, if mime types are identical,
-	 * don't bother getting strings (for speed). This assumes
-	 * that the string is dependent entirely on the mime type,
-	 * which is true now but might not be later.
+	/* Directories go first. Then, files of the same type share
+	 * their key, so there's no need to compare the strings.
 	 */
 	is_directory_1 = nautilus_file_is_directory (file_1);
 	is_directory_2 = nautilus_file_is_directory (file_2);
@@ -2972,34 +3468,22 @@ compare_by_type (NautilusFile *file_1, NautilusFile *file_2)
 		return +1;
 	}
 
-	if (file_1->details->mime_type != NULL &&
-	    file_2->details->mime_type != NULL &&
-	    strcmp (eel_ref_str_peek (file_1->details->mime_type),
-		    eel_ref_str_peek (file_2->details->mime_type)) == 0) {
-		return 0;
-	}
-
-	type_string_1 = nautilus_file_get_type_as_string (file_1);
-	type_string_2 = nautilus_file_get_type_as_string (file_2);
-
-	if (type_string_1 == NULL || type_string_2 == NULL) {
-		if (type_string_1 != NULL) {
-			return -1;
-		}
-
-		if (type_string_2 != NULL) {
-			return 1;
-		}
+	key_1 = get_type_sort_key (file_1);
+	key_2 = get_type_sort_key (file_2);
 
+	if (key_1 == key_2) {
 		return 0;
 	}
 
-	result = g_utf8_collate (type_string_1, type_string_2);
+	if (key_1 == NULL) {
+		return 1;
+	}
 
-	g_free (type_string_1);
-	g_free (type_string_2);
+	if (key_2 == NULL) {
+		return -1;
+	}
 
-	return result;
+	return strcmp (key_1, key_2);
 }
 
 static Knowledge
@@ -3009,7 +3493,7 @@ get_search_relevance (NautilusFile *file,
 	/* we're only called in search directories, and in that
 	 * case, the relevance is always known (or zero).
 	 */
-	*relevance_out = file->details->search_relevance;
+	*relevance_out = NAUTILUS_FILE_PEEK (file, rare_details, search_relevance, 0);
 	return KNOWN;
 }
 
@@ -3211,6 +3695,111 @@ nautilus_file_compare_for_sort (NautilusFile *file_1,
 	return result;
 }
 
+/* Sorting by a string attribute would otherwise build both strings on
+ * every comparison, so each file keeps the values it was last sorted by
+ * until it changes, one slot per attribute. A hit only reads the file;
+ * a miss drops the least recently added value.
+ */
+static const char *
+peek_sort_attribute_value (NautilusFile *file,
+			   GQuark attribute)
+{
+	NautilusFileSortValue *values;
+	int i;
+
+	values = file->details->sort_values;
+	for (i = 0; i < NAUTILUS_FILE_SORT_VALUES; i++) {
+		if (values[i].attribute == attribute) {
+			return values[i].value;
+		}
+	}
+
+	g_free (values[NAUTILUS_FILE_SORT_VALUES - 1].value);
+	memmove (values + 1, values,
+		 (NAUTILUS_FILE_SORT_VALUES - 1) * sizeof (NautilusFileSortValue));
+	values[0].attribute = attribute;
+	values[0].value = nautilus_file_get_string_attribute_q (file, attribute);
+
+	return values[0].value;
+}
+
+static void
+forget_sort_attribute_values (NautilusFile *file)
+{
+	int i;
+
+	for (i = 0; i < NAUTILUS_FILE_SORT_VALUES; i++) {
+		g_free (file->details->sort_values[i].value);
+		file->details->sort_values[i].value = NULL;
+		file->details->sort_values[i].attribute = 0;
+	}
+}
+
+static gboolean
+get_sort_type_for_attribute_q (GQuark attribute,
+			       NautilusFileSortType *sort_type)
+{
+	if (attribute == 0 || attribute == attribute_name_q) {
+		*sort_type = NAUTILUS_FILE_SORT_BY_DISPLAY_NAME;
+	} else if (attribute == attribute_size_q) {
+		*sort_type = NAUTILUS_FILE_SORT_BY_SIZE;
+	} else if (attribute == attribute_type_q) {
+		*sort_type = NAUTILUS_FILE_SORT_BY_TYPE;
+	} else if (attribute == attribute_modification_date_q || attribute == attribute_date_modified_q || attribute == attribute_date_modified_with_time_q || attribute == attribute_date_modified_full_q) {
+		*sort_type = NAUTILUS_FILE_SORT_BY_MTIME;
+        } else if (attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q || attribute == attribute_date_accessed_full_q) {
+		*sort_type = NAUTILUS_FILE_SORT_BY_ATIME;
+        } else if (attribute == attribute_trashed_on_q || attribute == attribute_trashed_on_full_q) {
+		*sort_type = NAUTILUS_FILE_SORT_BY_TRASHED_TIME;
+        } else if (attribute == attribute_search_relevance_q) {
+		*sort_type = NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE;
+	} else {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * nautilus_file_prepare_for_sort:
+ * @file: A file object
+ * @sort_type: Sort criterion
+ *
+ * Compute everything that nautilus_file_compare_for_sort() would
+ * otherwise compute and cache on first use for @sort_type. Once this
+ * was called on all files of a list, comparing them only reads the
+ * files, so they can be compared from several threads as long as
+ * the main thread leaves them alone meanwhile. Call
+ * nautilus_file_list_ensure_collation_keys() on the list first, so
+ * the name keys are computed in a batch rather than one by one here.
+ **/
+void
+nautilus_file_prepare_for_sort (NautilusFile *file,
+				NautilusFileSortType sort_type)
+{
+	/* The full path is the tie breaker for all sort types. */
+	nautilus_file_peek_display_name (file);
+	nautilus_file_peek_display_name_collation_key (file);
+	nautilus_file_peek_directory_name_collation_key (file);
+
+	if (sort_type == NAUTILUS_FILE_SORT_BY_TYPE) {
+		get_type_sort_key (file);
+	}
+}
+
+void
+nautilus_file_prepare_for_sort_by_attribute_q (NautilusFile *file,
+					       GQuark attribute)
+{
+	NautilusFileSortType sort_type;
+
+	if (get_sort_type_for_attribute_q (attribute, &sort_type)) {
+		nautilus_file_prepare_for_sort (file, sort_type);
+	} else {
+		peek_sort_attribute_value (file, attribute);
+	}
+}
+
 int
 nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile                   *file_1,
 						 NautilusFile                   *file_2,
@@ -3218,6 +3807,7 @@ nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile
 						 gboolean                        directories_first,
 						 gboolean                        reversed)
 {
+	NautilusFileSortType sort_type;
 	int result;
 
 	if (file_1 == file_2) {
@@ -3227,39 +3817,9 @@ nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile
 	/* Convert certain attributes into NautilusFileSortTypes and use
 	 * nautilus_file_compare_for_sort()
 	 */
-	if (attribute == 0 || attribute == attribute_name_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_DISPLAY_NAME,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_size_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_SIZE,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_type_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_TYPE,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_modification_date_q || attribute == attribute_date_modified_q || attribute == attribute_date_modified_with_time_q || attribute == attribute_date_modified_full_q) {
+	if (get_sort_type_for_attribute_q (attribute, &sort_type)) {
 		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_MTIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q || attribute == attribute_date_accessed_full_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_ATIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_trashed_on_q || attribute == attribute_trashed_on_full_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_TRASHED_TIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_search_relevance_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE,
+						       sort_type,
 						       directories_first,
 						       reversed);
 	}
@@ -3269,21 +3829,16 @@ nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile
 	result = nautilus_file_compare_for_sort_internal (file_1, file_2, directories_first, reversed);
 	
 	if (result == 0) {
-		char *value_1;
-		char *value_2;
+		const char *value_1;
+		const char *value_2;
 		
-		value_1 = nautilus_file_get_string_attribute_q (file_1, 
-								attribute);
-		value_2 = nautilus_file_get_string_attribute_q (file_2, 
-								attribute);
+		value_1 = peek_sort_attribute_value (file_1, attribute);
+		value_2 = peek_sort_attribute_value (file_2, attribute);
 
 		if (value_1 != NULL && value_2 != NULL) {
 			result = strcmp (value_1, value_2);
 		}
 
-		g_free (value_1);
-		g_free (value_2);
-
 		if (reversed) {
 			result = -result;
 		}
@@ -3729,16 +4284,53 @@ nautilus_file_set_integer_metadata (NautilusFile *file,
 				    default_as_string, value_as_string);
 }
 
+static void
+compute_display_name_collation_key (NautilusFile *file)
+{
+	file->details->display_name_collation_key =
+		g_utf8_collate_key_for_filename (eel_ref_str_peek (file->details->display_name), -1);
+}
+
 static const char *
 nautilus_file_peek_display_name_collation_key (NautilusFile *file)
 {
-	const char *res;
+	if (file->details->display_name_collation_key == NULL) {
+		if (file->details->display_name == NULL) {
+			return "";
+		}
+		compute_display_name_collation_key (file);
+	}
 
-	res = file->details->display_name_collation_key;
-	if (res == NULL)
-		res = "";
+	return file->details->display_name_collation_key;
+}
 
-	return res;
+static void
+compute_directory_name_collation_key (NautilusFile *file)
+{
+	char *parent_uri;
+
+	parent_uri = nautilus_file_get_parent_uri (file);
+	file->details->directory_name_collation_key = g_utf8_collate_key_for_filename (parent_uri, -1);
+	g_free (parent_uri);
+}
+
+static const char *
+nautilus_file_peek_directory_name_collation_key (NautilusFile *file)
+{
+	if (file->details->directory_name_collation_key == NULL) {
+		compute_directory_name_collation_key (file);
+	}
+
+	return file->details->directory_name_collation_key;
+}
+
+void
+nautilus_file_forget_collation_keys (NautilusFile *file)
+{
+	g_free (file->details->display_name_collation_key);
+	file->details->display_name_collation_key = NULL;
+	g_free (file->details->directory_name_collation_key);
+	file->details->directory_name_collation_key = NULL;
 }
 
 static const char *
@@ -4128,7 +4720,7 @@ nautilus_file_should_show_thumbnail (NautilusFile *file)
 	 * of the original file.
 	 */
 	if (nautilus_thumbnail_is_mimetype_limited_by_size (mime_type) &&
-	    file->details->thumbnail_path == NULL &&
+	    NAUTILUS_FILE_PEEK (file, thumbnail_details, path, NULL) == NULL &&
 	    nautilus_file_get_size (file) > cached_thumbnail_limit) {
 		return FALSE;
 	}
@@ -4263,8 +4855,8 @@ nautilus_file_get_keywords (NautilusFile *file)
 
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-	keywords = g_list_copy_deep (file->details->extension_emblems, (GCopyFunc) g_strdup, NULL);
-	keywords = g_list_concat (keywords, g_list_copy_deep (file->details->pending_extension_emblems, (GCopyFunc) g_strdup, NULL));
+	keywords = g_list_copy_deep (NAUTILUS_FILE_PEEK (file, extension_details, emblems, NULL), (GCopyFunc) g_strdup, NULL);
+	keywords = g_list_concat (keywords, g_list_copy_deep (NAUTILUS_FILE_PEEK (file, extension_details, pending_emblems, NULL), (GCopyFunc) g_strdup, NULL));
 
 	metadata_keywords = nautilus_file_get_metadata_list (file, NAUTILUS_METADATA_KEY_EMBLEMS);
 	clean_up_metadata_keywords (file, &metadata_keywords);
@@ -4469,7 +5061,7 @@ nautilus_file_get_gicon (NautilusFile *file,
 char *
 nautilus_file_get_thumbnail_path (NautilusFile *file)
 {
-	return g_strdup (file->details->thumbnail_path);
+	return g_strdup (NAUTILUS_FILE_PEEK (file, thumbnail_details, path, NULL));
 }
 
 static NautilusIconInfo *
@@ -4484,6 +5076,7 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 	double thumb_scale;
 	GIcon *gicon, *emblemed_icon;
 	NautilusIconInfo *icon;
+	NautilusFileThumbnailDetails *thumbnail;
 
 	icon = NULL;
 	gicon = NULL;
@@ -4497,9 +5090,10 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 		       modified_size, cached_thumbnail_size);
 	}
 
-	if (file->details->thumbnail) {
-		w = gdk_pixbuf_get_width (file->details->thumbnail);
-		h = gdk_pixbuf_get_height (file->details->thumbnail);
+	thumbnail = file->details->thumbnail_details;
+	if (thumbnail != NULL && thumbnail->pixbuf != NULL) {
+		w = gdk_pixbuf_get_width (thumbnail->pixbuf);
+		h = gdk_pixbuf_get_height (thumbnail->pixbuf);
 
 		s = MAX (w, h);
 		/* Don't scale up small thumbnails in the standard view */
@@ -4514,17 +5108,17 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 			thumb_scale = (double) NAUTILUS_LIST_ICON_SIZE_SMALL / s;
 		}
 
-		if (file->details->thumbnail_scale == thumb_scale &&
-		    file->details->scaled_thumbnail != NULL) {
-			pixbuf = file->details->scaled_thumbnail;
+		if (thumbnail->scale == thumb_scale &&
+		    thumbnail->scaled_pixbuf != NULL) {
+			pixbuf = thumbnail->scaled_pixbuf;
 		} else {
-			pixbuf = gdk_pixbuf_scale_simple (file->details->thumbnail,
+			pixbuf = gdk_pixbuf_scale_simple (thumbnail->pixbuf,
 							  MAX (w * thumb_scale, 1),
 							  MAX (h * thumb_scale, 1),
 							  GDK_INTERP_BILINEAR);
 
 			/* We don't want frames around small icons */
-			if (!gdk_pixbuf_get_has_alpha (file->details->thumbnail) || s >= 128 * scale) {
+			if (!gdk_pixbuf_get_has_alpha (thumbnail->pixbuf) || s >= 128 * scale) {
 				if (nautilus_is_video_file (file)) {
 					nautilus_ui_frame_video (&pixbuf);
 				} else {
@@ -4532,9 +5126,9 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 				}
 			}
 
-			g_clear_object (&file->details->scaled_thumbnail);
-			file->details->scaled_thumbnail = pixbuf;
-			file->details->thumbnail_scale = thumb_scale;
+			g_clear_object (&thumbnail->scaled_pixbuf);
+			thumbnail->scaled_pixbuf = pixbuf;
+			thumbnail->scale = thumb_scale;
 		}
 
 		/* Don't scale up if more than 25%, then read the original
@@ -4551,7 +5145,7 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 
 		DEBUG ("Returning thumbnailed image, at size %d %d",
 		       (int) (w * thumb_scale), (int) (h * thumb_scale));
-	} else if (file->details->thumbnail_path == NULL &&
+	} else if ((thumbnail == NULL || thumbnail->path == NULL) &&
 		   file->details->can_read &&
 		   !file->details->is_thumbnailing &&
 		   !file->details->thumbnailing_failed &&
@@ -4705,7 +5299,7 @@ nautilus_file_get_trash_original_file_parent_as_string (NautilusFile *file)
 	GFile *location;
 	char *filename;
 
-	if (file->details->trash_orig_path != NULL) {
+	if (NAUTILUS_FILE_PEEK (file, rare_details, trash_orig_path, NULL) != NULL) {
 		orig_file = nautilus_file_get_trash_original_file (file);
 		parent = nautilus_file_get_parent (orig_file);
 		location = nautilus_file_get_location (parent);
@@ -4722,144 +5316,383 @@ nautilus_file_get_trash_original_file_parent_as_string (NautilusFile *file)
 	return NULL;
 }
 
-/**
- * nautilus_file_get_date_as_string:
- * 
- * Get a user-displayable string representing a file modification date. 
- * The caller is responsible for g_free-ing this string.
- * @file: NautilusFile representing the file in question.
- * 
- * Returns: Newly allocated string ready to display to the user.
- * 
- **/
-static char *
-nautilus_file_get_date_as_string (NautilusFile       *file,
-                                  NautilusDateType    date_type,
-                                  NautilusDateFormat  date_format)
-{
-	time_t file_time_raw;
-  	GDateTime *file_date, *now;
-        GDateTime *today_midnight;
-	gint days_ago;
+/* Which of the relative formats a date falls in. */
+typedef enum {
+	DATE_RANGE_TODAY,
+	DATE_RANGE_YESTERDAY,
+	DATE_RANGE_THIS_WEEK,
+	DATE_RANGE_THIS_YEAR,
+	DATE_RANGE_OLDER,
+	DATE_RANGE_FULL,
+	DATE_RANGE_COUNT
+} DateRange;
+
+#define DATE_FORMAT_COUNT (NAUTILUS_DATE_FORMAT_FULL + 1)
+
+/* The day boundaries are recomputed at midnight, and once a minute
+ * in case the timezone changed under us. */
+#define DATE_FORMATTER_RECHECK_INTERVAL (60 * G_USEC_PER_SEC)
+
+/* Longest wait for the local day to change; timeouts don't run while
+ * the machine sleeps, so a single one set to midnight may come late. */
+#define DATE_FORMATTER_DAY_CHECK_INTERVAL (60 * 60)
+
+/* Bound on the number of remembered date strings */
+#define DATE_STRINGS_MAX 4096
+
+typedef struct {
+	gint64 time;
+	NautilusDateFormat format;
+} DateStringKey;
+
+typedef struct {
+	gboolean initialized;
 	gboolean use_24;
-	const gchar *format;
-	gchar *result;
-	gchar *result_with_ratio;
+	const char *formats[DATE_FORMAT_COUNT][DATE_RANGE_COUNT];
 
-  	if (!nautilus_file_get_date (file, date_type, &file_time_raw))
-		return NULL;
+	/* real time span, in microseconds, the boundaries are good for */
+	gint64 valid_from;
+	gint64 valid_until;
+	GTimeSpan utc_offset;
+
+	/* unix times */
+	gint64 today_midnight;
+	gint64 year_start;
+	gint64 next_year_start;
+
+	GHashTable *strings; /* DateStringKey -> formatted date */
+
+	/* fires at the next local midnight */
+	guint day_change_timeout_id;
+} DateFormatter;
+
+static DateFormatter date_formatter;
+
+static guint
+date_string_key_hash (gconstpointer p)
+{
+	const DateStringKey *key;
 
-  	file_date = g_date_time_new_from_unix_local (file_time_raw);
-	if (date_format != NAUTILUS_DATE_FORMAT_FULL) {
-		now = g_date_time_new_now_local ();
-                today_midnight = g_date_time_new_local (g_date_time_get_year (now),
-                                                        g_date_time_get_month (now),
-                                                        g_date_time_get_day_of_month (now),
-                                                        0, 1, 0);
+	key = p;
+	return (guint) (key->time ^ (key->time >> 32)) * 31 + key->format;
+}
+
+static gboolean
+date_string_key_equal (gconstpointer a,
+		       gconstpointer b)
+{
+	const DateStringKey *key_a, *key_b;
+
+	key_a = a;
+	key_b = b;
+	return key_a->time == key_b->time && key_a->format == key_b->format;
+}
+
+static void
+date_string_key_free (gpointer p)
+{
+	g_slice_free (DateStringKey, p);
+}
 
-		days_ago = g_date_time_difference (today_midnight, file_date) / G_TIME_SPAN_DAY;
+static const char *
+date_format_for_range (DateRange          range,
+		       NautilusDateFormat date_format,
+		       gboolean           use_24)
+{
+	const gchar *format;
 
-		use_24 = g_settings_get_enum (gnome_interface_preferences, "clock-format") ==
-		         G_DESKTOP_CLOCK_FORMAT_24H;
+	if (range == DATE_RANGE_FULL) {
+		// xgettext:no-c-format
+		return _("%c");
+	}
 
-		// Show only the time if date is on today
-		if (days_ago < 1) {
+	// Show only the time if date is on today
+	if (range == DATE_RANGE_TODAY) {
+		if (use_24) {
+			/* Translators: Time in 24h format */
+			format = _("%H:%M");
+		} else {
+			/* Translators: Time in 12h format */
+			format = _("%l:%M %p");
+		}
+	}
+	// Show the word "Yesterday" and time if date is on yesterday
+	else if (range == DATE_RANGE_YESTERDAY) {
+		if (date_format == NAUTILUS_DATE_FORMAT_REGULAR) {
+			// xgettext:no-c-format
+			format = _("Yesterday");
+		} else {
 			if (use_24) {
-				/* Translators: Time in 24h format */
-				format = _("%H:%M");
+				/* Translators: this is the word Yesterday followed by
+				 * a time in 24h format. i.e. "Yesterday 23:04" */
+				// xgettext:no-c-format
+				format = _("Yesterday %H:%M");
 			} else {
-				/* Translators: Time in 12h format */
-				format = _("%l:%M %p");
+				/* Translators: this is the word Yesterday followed by
+				 * a time in 12h format. i.e. "Yesterday 9:04 PM" */
+				// xgettext:no-c-format
+				format = _("Yesterday %l:%M %p");
 			}
 		}
-		// Show the word "Yesterday" and time if date is on yesterday
-		else if (days_ago < 2) {
-			if (date_format == NAUTILUS_DATE_FORMAT_REGULAR) {
+	}
+	// Show a week day and time if date is in the last week
+	else if (range == DATE_RANGE_THIS_WEEK) {
+		if (date_format == NAUTILUS_DATE_FORMAT_REGULAR) {
+			// xgettext:no-c-format
+			format = _("%a");
+		} else {
+			if (use_24) {
+				/* Translators: this is the name of the week day followed by
+				 * a time in 24h format. i.e. "Monday 23:04" */
 				// xgettext:no-c-format
-				format = _("Yesterday");
+				format = _("%a %H:%M");
 			} else {
-				if (use_24) {
-					/* Translators: this is the word Yesterday followed by
-					 * a time in 24h format. i.e. "Yesterday 23:04" */
-					// xgettext:no-c-format
-					format = _("Yesterday %H:%M");
-				} else {
-					/* Translators: this is the word Yesterday followed by
-					 * a time in 12h format. i.e. "Yesterday 9:04 PM" */
-					// xgettext:no-c-format
-					format = _("Yesterday %l:%M %p");
-				}
+				/* Translators: this is the week day name followed by
+				 * a time in 12h format. i.e. "Monday 9:04 PM" */
+				// xgettext:no-c-format
+				format = _("%a %l:%M %p");
 			}
 		}
-		// Show a week day and time if date is in the last week
-		else if (days_ago < 7) {
-			if (date_format == NAUTILUS_DATE_FORMAT_REGULAR) {
+	} else if (range == DATE_RANGE_THIS_YEAR) {
+		if (date_format == NAUTILUS_DATE_FORMAT_REGULAR) {
+			/* Translators: this is the day of the month followed
+			 * by the abbreviated month name i.e. "3 Feb" */
+			// xgettext:no-c-format
+			format = _("%-e %b");
+		} else {
+			if (use_24) {
+				/* Translators: this is the day of the month followed
+				 * by the abbreviated month name followed by a time in
+				 * 24h format i.e. "3 Feb 23:04" */
 				// xgettext:no-c-format
-				format = _("%a");
+				format = _("%-e %b %H:%M");
 			} else {
-				if (use_24) {
-					/* Translators: this is the name of the week day followed by
-					 * a time in 24h format. i.e. "Monday 23:04" */
-					// xgettext:no-c-format
-					format = _("%a %H:%M");
-				} else {
-					/* Translators: this is the week day name followed by
-					 * a time in 12h format. i.e. "Monday 9:04 PM" */
-					// xgettext:no-c-format
-					format = _("%a %l:%M %p");
-				}
-			}
-		} else if (g_date_time_get_year (file_date) == g_date_time_get_year (now)) {
-			if (date_format == NAUTILUS_DATE_FORMAT_REGULAR) {
 				/* Translators: this is the day of the month followed
-				 * by the abbreviated month name i.e. "3 Feb" */
+				 * by the abbreviated month name followed by a time in
+				 * 12h format i.e. "3 Feb 9:04" */
 				// xgettext:no-c-format
-				format = _("%-e %b");
-			} else {
-				if (use_24) {
-					/* Translators: this is the day of the month followed
-					 * by the abbreviated month name followed by a time in
-					 * 24h format i.e. "3 Feb 23:04" */
-					// xgettext:no-c-format
-					format = _("%-e %b %H:%M");
-				} else {
-					/* Translators: this is the day of the month followed
-					 * by the abbreviated month name followed by a time in
-					 * 12h format i.e. "3 Feb 9:04" */
-					// xgettext:no-c-format
-					format = _("%-e %b %l:%M %p");
-				}
+				format = _("%-e %b %l:%M %p");
 			}
+		}
+	} else {
+		if (date_format == NAUTILUS_DATE_FORMAT_REGULAR) {
+			/* Translators: this is the day of the month followed by the abbreviated
+			 * month name followed by the year i.e. "3 Feb 2015" */
+			// xgettext:no-c-format
+			format = _("%-e %b %Y");
 		} else {
-			if (date_format == NAUTILUS_DATE_FORMAT_REGULAR) {
-				/* Translators: this is the day of the month followed by the abbreviated
-				 * month name followed by the year i.e. "3 Feb 2015" */
+			if (use_24) {
+				/* Translators: this is the day number followed
+				 * by the abbreviated month name followed by the year followed
+				 * by a time in 24h format i.e. "3 Feb 2015 23:04" */
 				// xgettext:no-c-format
-				format = _("%-e %b %Y");
+				format = _("%-e %b %Y %H:%M");
 			} else {
-				if (use_24) {
-					/* Translators: this is the day number followed
-					 * by the abbreviated month name followed by the year followed
-					 * by a time in 24h format i.e. "3 Feb 2015 23:04" */
-					// xgettext:no-c-format
-					format = _("%-e %b %Y %H:%M");
-				} else {
-					/* Translators: this is the day number followed
-					 * by the abbreviated month name followed by the year followed
-					 * by a time in 12h format i.e. "3 Feb 2015 9:04 PM" */
-					// xgettext:no-c-format
-					format = _("%-e %b %Y %l:%M %p");
-				}
+				/* Translators: this is the day number followed
+				 * by the abbreviated month name followed by the year followed
+				 * by a time in 12h format i.e. "3 Feb 2015 9:04 PM" */
+				// xgettext:no-c-format
+				format = _("%-e %b %Y %l:%M %p");
 			}
 		}
+	}
+
+	return format;
+}
+
+static void
+clock_format_changed_callback (gpointer callback_data)
+{
+	int date_format, range;
+
+	date_formatter.use_24 = g_settings_get_enum (gnome_interface_preferences, "clock-format") ==
+		G_DESKTOP_CLOCK_FORMAT_24H;
+
+	for (date_format = 0; date_format < DATE_FORMAT_COUNT; date_format++) {
+		for (range = 0; range < DATE_RANGE_COUNT; range++) {
+			date_formatter.formats[date_format][range] =
+				date_format_for_range (range, date_format, date_formatter.use_24);
+		}
+	}
+
+	g_hash_table_remove_all (date_formatter.strings);
+
+	/* Let views drop the dates they formatted themselves */
+	if (date_formatter.initialized) {
+		g_signal_emit_by_name (nautilus_signaller_get_current (),
+				       "date-format-changed");
+	}
+}
+
+static gboolean day_change_callback (gpointer data);
+
+/* Returns whether the day boundaries moved, making strings formatted
+ * against the old ones wrong. */
+static gboolean
+date_formatter_update_boundaries (gint64 real_time)
+{
+	GDateTime *now, *today_midnight, *day_start, *next_day_start;
+	GDateTime *year_start, *next_year_start;
+	gint64 midnight, next_day;
+	GTimeSpan utc_offset;
+	gboolean changed;
+
+	now = g_date_time_new_from_unix_local (real_time / G_USEC_PER_SEC);
+	today_midnight = g_date_time_new_local (g_date_time_get_year (now),
+						g_date_time_get_month (now),
+						g_date_time_get_day_of_month (now),
+						0, 1, 0);
+	day_start = g_date_time_new_local (g_date_time_get_year (now),
+					   g_date_time_get_month (now),
+					   g_date_time_get_day_of_month (now),
+					   0, 0, 0);
+	next_day_start = g_date_time_add_days (day_start, 1);
+	year_start = g_date_time_new_local (g_date_time_get_year (now), 1, 1, 0, 0, 0);
+	next_year_start = g_date_time_add_years (year_start, 1);
+
+	midnight = g_date_time_to_unix (today_midnight);
+	utc_offset = g_date_time_get_utc_offset (now);
+
+	/* Strings formatted against other boundaries are wrong now */
+	changed = midnight != date_formatter.today_midnight ||
+		utc_offset != date_formatter.utc_offset;
+	if (changed) {
+		g_hash_table_remove_all (date_formatter.strings);
+	}
+
+	next_day = g_date_time_to_unix (next_day_start);
+	date_formatter.today_midnight = midnight;
+	date_formatter.utc_offset = utc_offset;
+	date_formatter.year_start = g_date_time_to_unix (year_start);
+	date_formatter.next_year_start = g_date_time_to_unix (next_year_start);
+	date_formatter.valid_from = real_time;
+	date_formatter.valid_until = MIN (next_day * G_USEC_PER_SEC,
+					  real_time + DATE_FORMATTER_RECHECK_INTERVAL);
+
+	/* Nothing may format a date when the day changes, so wake up
+	 * then to tell views their "Today" and "Yesterday" are stale */
+	if (date_formatter.day_change_timeout_id != 0) {
+		g_source_remove (date_formatter.day_change_timeout_id);
+	}
+	date_formatter.day_change_timeout_id =
+		g_timeout_add_seconds (CLAMP (next_day - real_time / G_USEC_PER_SEC, 1,
+					      DATE_FORMATTER_DAY_CHECK_INTERVAL),
+				       day_change_callback, NULL);
+
+	g_date_time_unref (now);
+	g_date_time_unref (today_midnight);
+	g_date_time_unref (day_start);
+	g_date_time_unref (next_day_start);
+	g_date_time_unref (year_start);
+	g_date_time_unref (next_year_start);
+
+	return changed;
+}
+
+static gboolean
+day_change_callback (gpointer data)
+{
+	date_formatter.day_change_timeout_id = 0;
+
+	if (date_formatter_update_boundaries (g_get_real_time ())) {
+		g_signal_emit_by_name (nautilus_signaller_get_current (),
+				       "date-format-changed");
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+date_formatter_ensure_up_to_date (void)
+{
+	gint64 real_time;
+
+	/* Add the callback once for the life of our process */
+	if (!date_formatter.initialized) {
+		date_formatter.strings = g_hash_table_new_full (date_string_key_hash,
+								date_string_key_equal,
+								date_string_key_free,
+								g_free);
+		g_signal_connect_swapped (gnome_interface_preferences,
+					  "changed::clock-format",
+					  G_CALLBACK (clock_format_changed_callback),
+					  NULL);
+		clock_format_changed_callback (NULL);
+		date_formatter.initialized = TRUE;
+	}
+
+	real_time = g_get_real_time ();
+	if (real_time < date_formatter.valid_from ||
+	    real_time >= date_formatter.valid_until) {
+		date_formatter_update_boundaries (real_time);
+	}
+}
+
+static DateRange
+date_formatter_get_range (gint64             file_time,
+			  NautilusDateFormat date_format)
+{
+	gint64 days_ago;
+
+	if (date_format == NAUTILUS_DATE_FORMAT_FULL) {
+		return DATE_RANGE_FULL;
+	}
+
+	days_ago = (date_formatter.today_midnight - file_time) / (60 * 60 * 24);
 
-		g_date_time_unref (now);
-		g_date_time_unref (today_midnight);
+	if (days_ago < 1) {
+		return DATE_RANGE_TODAY;
+	} else if (days_ago < 2) {
+		return DATE_RANGE_YESTERDAY;
+	} else if (days_ago < 7) {
+		return DATE_RANGE_THIS_WEEK;
+	} else if (file_time >= date_formatter.year_start &&
+		   file_time < date_formatter.next_year_start) {
+		return DATE_RANGE_THIS_YEAR;
 	} else {
-		// xgettext:no-c-format
-		format = _("%c");
+		return DATE_RANGE_OLDER;
+	}
+}
+
+/**
+ * nautilus_file_get_date_as_string:
+ * 
+ * Get a user-displayable string representing a file modification date. 
+ * The caller is responsible for g_free-ing this string.
+ * @file: NautilusFile representing the file in question.
+ * 
+ * Returns: Newly allocated string ready to display to the user.
+ * 
+ **/
+static char *
+nautilus_file_get_date_as_string (NautilusFile       *file,
+                                  NautilusDateType    date_type,
+                                  NautilusDateFormat  date_format)
+{
+	time_t file_time_raw;
+	GDateTime *file_date;
+	DateStringKey key;
+	DateRange range;
+	const gchar *format;
+	gchar *result;
+	gchar *result_with_ratio;
+
+	if (!nautilus_file_get_date (file, date_type, &file_time_raw))
+		return NULL;
+
+	date_formatter_ensure_up_to_date ();
+
+	key.time = file_time_raw;
+	key.format = date_format;
+	result_with_ratio = g_hash_table_lookup (date_formatter.strings, &key);
+	if (result_with_ratio != NULL) {
+		return g_strdup (result_with_ratio);
 	}
 
+	range = date_formatter_get_range (file_time_raw, date_format);
+	format = date_formatter.formats[date_format][range];
+
+	file_date = g_date_time_new_from_unix_local (file_time_raw);
 	result = g_date_time_format (file_date, format);
 	g_date_time_unref (file_date);
 
@@ -4868,6 +5701,15 @@ nautilus_file_get_date_as_string (NautilusFile       *file,
 	result_with_ratio = eel_str_replace_substring (result, ":", "∶");
  	g_free (result);
 
+	if (result_with_ratio != NULL) {
+		if (g_hash_table_size (date_formatter.strings) >= DATE_STRINGS_MAX) {
+			g_hash_table_remove_all (date_formatter.strings);
+		}
+		g_hash_table_insert (date_formatter.strings,
+				     g_slice_dup (DateStringKey, &key),
+				     g_strdup (result_with_ratio));
+	}
+
         return  result_with_ratio;
 }
 
@@ -5162,7 +6004,7 @@ void
 nautilus_file_set_search_relevance (NautilusFile *file,
 				    gdouble       relevance)
 {
-	file->details->search_relevance = relevance;
+	nautilus_file_ensure_rare_details (file)->search_relevance = relevance;
 }
 
 /**
@@ -5254,6 +6096,7 @@ nautilus_file_set_permissions (NautilusFile *file,
 		 * This makes it easier for some clients who see the "reverting"
 		 * to the old permissions as "changing back".
 		 */
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON);
 		nautilus_file_changed (file);
 		error = g_error_new (G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
 				     _("Not allowed to set permissions"));
@@ -5549,6 +6392,7 @@ nautilus_file_set_owner (NautilusFile *file,
 		 * clients who see the "reverting" to the old owner as
 		 * "changing back".
 		 */
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON);
 		nautilus_file_changed (file);
 		error = g_error_new (G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
 				     _("Not allowed to set owner"));
@@ -5567,6 +6411,7 @@ nautilus_file_set_owner (NautilusFile *file,
 		 * clients who see the "reverting" to the old owner as
 		 * "changing back".
 		 */
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON);
 		nautilus_file_changed (file);
 		error = g_error_new (G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
 				     _("Specified owner '%s' doesn't exist"), user_name_or_id);
@@ -5831,6 +6676,7 @@ nautilus_file_set_group (NautilusFile *file,
 		 * clients who see the "reverting" to the old group as
 		 * "changing back".
 		 */
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON);
 		nautilus_file_changed (file);
 		error = g_error_new (G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
 				     _("Not allowed to set group"));
@@ -5849,6 +6695,7 @@ nautilus_file_set_group (NautilusFile *file,
 		 * clients who see the "reverting" to the old group as
 		 * "changing back".
 		 */
+		nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_PERMISSIONS | NAUTILUS_FILE_CHANGE_ICON);
 		nautilus_file_changed (file);
 		error = g_error_new (G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
 				     _("Specified group '%s' doesn't exist"), group_name_or_id);
@@ -6249,6 +7096,7 @@ char *
 nautilus_file_get_string_attribute_q (NautilusFile *file, GQuark attribute_q)
 {
 	char *extension_attribute;
+	NautilusFileExtensionDetails *extension;
 
 	if (attribute_q == attribute_name_q) {
 		return nautilus_file_get_display_name (file);
@@ -6351,13 +7199,15 @@ nautilus_file_get_string_attribute_q (NautilusFile *file, GQuark attribute_q)
 
 	extension_attribute = NULL;
 	
-	if (file->details->pending_extension_attributes) {
-		extension_attribute = g_hash_table_lookup (file->details->pending_extension_attributes,
+	extension = file->details->extension_details;
+
+	if (extension != NULL && extension->pending_attributes) {
+		extension_attribute = g_hash_table_lookup (extension->pending_attributes,
 							   GINT_TO_POINTER (attribute_q));
 	} 
 
-	if (extension_attribute == NULL && file->details->extension_attributes) {
-		extension_attribute = g_hash_table_lookup (file->details->extension_attributes,
+	if (extension_attribute == NULL && extension != NULL && extension->attributes) {
+		extension_attribute = g_hash_table_lookup (extension->attributes,
 							   GINT_TO_POINTER (attribute_q));
 	}
 		
@@ -6735,8 +7585,8 @@ nautilus_file_is_symbolic_link (NautilusFile *file)
 GMount *
 nautilus_file_get_mount (NautilusFile *file)
 {
-	if (file->details->mount) {
-		return g_object_ref (file->details->mount);
+	if (peek_mount (file)) {
+		return g_object_ref (peek_mount (file));
 	}
 	return NULL;
 }
@@ -6756,14 +7606,18 @@ void
 nautilus_file_set_mount (NautilusFile *file,
 			 GMount *mount)
 {
-	if (file->details->mount) {
-		g_signal_handlers_disconnect_by_func (file->details->mount, file_mount_unmounted, file);
-		g_object_unref (file->details->mount);
-		file->details->mount = NULL;
+	NautilusFileRareDetails *rare;
+
+	rare = file->details->rare_details;
+	if (rare != NULL && rare->mount) {
+		g_signal_handlers_disconnect_by_func (rare->mount, file_mount_unmounted, file);
+		g_object_unref (rare->mount);
+		rare->mount = NULL;
 	}
 
 	if (mount) {
-		file->details->mount = g_object_ref (mount);
+		rare = nautilus_file_ensure_rare_details (file);
+		rare->mount = g_object_ref (mount);
 		g_signal_connect (mount, "unmounted",
 				  G_CALLBACK (file_mount_unmounted), file);
 	}
@@ -6812,8 +7666,8 @@ get_fs_free_cb (GObject *source_object,
 		g_object_unref (info);
 	}
 
-	if (file->details->free_space != free_space) {
-		file->details->free_space = free_space;
+	if (NAUTILUS_FILE_PEEK (file, rare_details, free_space, (guint64)-1) != free_space) {
+		nautilus_file_ensure_rare_details (file)->free_space = free_space;
 		nautilus_file_emit_changed (file);
 	}
 
@@ -6830,15 +7684,17 @@ get_fs_free_cb (GObject *source_object,
 char *
 nautilus_file_get_volume_free_space (NautilusFile *file)
 {
+	NautilusFileRareDetails *rare;
 	GFile *location;
 	char *res;
 	time_t now;
 
+	rare = nautilus_file_ensure_rare_details (file);
 	now = time (NULL);
 	/* Update first time and then every 2 seconds */
-	if (file->details->free_space_read == 0 ||
-	    (now - file->details->free_space_read) > 2)  {
-		file->details->free_space_read = now;
+	if (rare->free_space_read == 0 ||
+	    (now - rare->free_space_read) > 2)  {
+		rare->free_space_read = now;
 		location = nautilus_file_get_location (file);
 		g_file_query_filesystem_info_async (location,
 						    G_FILE_ATTRIBUTE_FILESYSTEM_FREE,
@@ -6849,8 +7705,8 @@ nautilus_file_get_volume_free_space (NautilusFile *file)
 	}
 
 	res = NULL;
-	if (file->details->free_space != (guint64)-1) {
-		res = g_format_size (file->details->free_space);
+	if (rare->free_space != (guint64)-1) {
+		res = g_format_size (rare->free_space);
 	}
 
 	return res;
@@ -7209,8 +8065,8 @@ nautilus_file_get_trash_original_file (NautilusFile *file)
 
 	original_file = NULL;
 
-	if (file->details->trash_orig_path != NULL) {
-		location = g_file_new_for_path (file->details->trash_orig_path);
+	if (NAUTILUS_FILE_PEEK (file, rare_details, trash_orig_path, NULL) != NULL) {
+		location = g_file_new_for_path (file->details->rare_details->trash_orig_path);
 		original_file = nautilus_file_get (location);
 		g_object_unref (location);
 	}
@@ -7314,6 +8170,17 @@ nautilus_file_emit_changed (NautilusFile *file)
 
 	g_assert (NAUTILUS_IS_FILE (file));
 
+	forget_sort_attribute_values (file);
+	file->details->type_sort_key_generation = 0;
+
+	/* Nobody said what changed, so assume everything did. */
+	if (file->details->pending_changes == 0) {
+		file->details->pending_changes = NAUTILUS_FILE_CHANGE_ALL;
+	}
+	file->details->last_changes = file->details->pending_changes;
+	file->details->pending_changes = 0;
+	file->details->generation++;
+
 	/* Send out a signal. */
 	g_signal_emit (file, signals[CHANGED], 0, file);
 
@@ -7327,6 +8194,62 @@ nautilus_file_emit_changed (NautilusFile *file)
 	nautilus_file_list_free (link_files);
 }
 
+/**
+ * nautilus_file_add_pending_changes
+ *
+ * Record which attributes changed, to be reported with the next
+ * "changed" signal. Callers do this right before nautilus_file_changed().
+ * @file: NautilusFile representing the file in question.
+ * @changes: the groups of attributes that changed.
+ **/
+void
+nautilus_file_add_pending_changes (NautilusFile *file,
+				   NautilusFileChangeFlags changes)
+{
+	g_assert (NAUTILUS_IS_FILE (file));
+
+	file->details->pending_changes |= changes;
+}
+
+/**
+ * nautilus_file_get_generation
+ *
+ * Get a counter that is bumped each time the file emits "changed".
+ * A consumer that remembers the generation it last saw can tell from
+ * nautilus_file_get_last_changes() what it has to refresh, as long as
+ * exactly one change happened since.
+ * @file: NautilusFile representing the file in question.
+ *
+ * Returns: the current generation.
+ **/
+guint
+nautilus_file_get_generation (NautilusFile *file)
+{
+	g_return_val_if_fail (NAUTILUS_IS_FILE (file), 0);
+
+	return file->details->generation;
+}
+
+/**
+ * nautilus_file_get_last_changes
+ *
+ * Get the groups of attributes reported by the last "changed" signal.
+ * @file: NautilusFile representing the file in question.
+ *
+ * Returns: the change mask, NAUTILUS_FILE_CHANGE_ALL if unknown.
+ **/
+NautilusFileChangeFlags
+nautilus_file_get_last_changes (NautilusFile *file)
+{
+	g_return_val_if_fail (NAUTILUS_IS_FILE (file), NAUTILUS_FILE_CHANGE_ALL);
+
+	if (file->details->generation == 0) {
+		return NAUTILUS_FILE_CHANGE_ALL;
+	}
+
+	return file->details->last_changes;
+}
+
 /**
  * nautilus_file_is_gone
  * 
@@ -7470,11 +8393,21 @@ invalidate_mount (NautilusFile *file)
 void
 nautilus_file_invalidate_extension_info_internal (NautilusFile *file)
 {
-	if (file->details->pending_info_providers)
-		g_list_free_full (file->details->pending_info_providers, g_object_unref);
+	NautilusFileExtensionDetails *extension;
+	GList *providers;
+
+	providers = nautilus_module_get_extensions_for_type (NAUTILUS_TYPE_INFO_PROVIDER);
+
+	/* Most setups have no info providers; don't allocate the
+	 * extension details just to store an empty list.
+	 */
+	if (providers == NULL && file->details->extension_details == NULL) {
+		return;
+	}
 
-	file->details->pending_info_providers =
-		nautilus_module_get_extensions_for_type (NAUTILUS_TYPE_INFO_PROVIDER);
+	extension = nautilus_file_ensure_extension_details (file);
+	g_list_free_full (extension->pending_info_providers, g_object_unref);
+	extension->pending_info_providers = providers;
 }
 
 void
@@ -7603,7 +8536,7 @@ nautilus_file_invalidate_all_attributes (NautilusFile *file)
 void
 nautilus_file_dump (NautilusFile *file)
 {
-	long size = file->details->deep_size;
+	long size = NAUTILUS_FILE_PEEK (file, deep_counts, size, 0);
 	char *uri;
 	const char *file_kind;
 
@@ -7812,9 +8745,137 @@ compare_by_display_name_cover (gconstpointer a, gconstpointer b)
 GList *
 nautilus_file_list_sort_by_display_name (GList *list)
 {
+	nautilus_file_list_ensure_collation_keys (list);
+
 	return g_list_sort (list, compare_by_display_name_cover);
 }
 
+typedef struct {
+	GMutex lock;
+	GCond done;
+	guint pending;
+} CollationKeyBatch;
+
+typedef struct {
+	CollationKeyBatch *batch;
+	NautilusFile **files;
+	guint n_files;
+} CollationKeyChunk;
+
+static GThreadPool *collation_key_pool = NULL;
+
+static gboolean
+lacks_collation_keys (NautilusFile *file)
+{
+	return (file->details->display_name_collation_key == NULL &&
+		file->details->display_name != NULL) ||
+		file->details->directory_name_collation_key == NULL;
+}
+
+static void
+compute_missing_collation_keys (NautilusFile *file)
+{
+	if (file->details->display_name_collation_key == NULL &&
+	    file->details->display_name != NULL) {
+		compute_display_name_collation_key (file);
+	}
+	if (file->details->directory_name_collation_key == NULL) {
+		compute_directory_name_collation_key (file);
+	}
+}
+
+static void
+collation_key_chunk_thread (gpointer data,
+			    gpointer user_data)
+{
+	CollationKeyChunk *chunk;
+	CollationKeyBatch *batch;
+	guint i;
+
+	chunk = data;
+	batch = chunk->batch;
+
+	for (i = 0; i < chunk->n_files; i++) {
+		compute_missing_collation_keys (chunk->files[i]);
+	}
+	g_free (chunk);
+
+	g_mutex_lock (&batch->lock);
+	if (--batch->pending == 0) {
+		g_cond_signal (&batch->done);
+	}
+	g_mutex_unlock (&batch->lock);
+}
+
+/**
+ * nautilus_file_list_ensure_collation_keys
+ *
+ * Compute the name collation keys that are missing in @file_list
+ * before sorting it; every sort type breaks ties by name. Large
+ * batches are split over a thread pool; the call returns once all
+ * keys are there.
+ * @file_list: GList of files.
+ **/
+void
+nautilus_file_list_ensure_collation_keys (GList *file_list)
+{
+	GPtrArray *missing;
+	CollationKeyBatch batch;
+	CollationKeyChunk *chunk;
+	NautilusFile *file;
+	GList *node;
+	guint i;
+
+	missing = g_ptr_array_new ();
+	for (node = file_list; node != NULL; node = node->next) {
+		file = node->data;
+		if (lacks_collation_keys (file)) {
+			g_ptr_array_add (missing, file);
+		}
+	}
+
+	if (missing->len < COLLATION_KEY_BATCH_MIN) {
+		for (i = 0; i < missing->len; i++) {
+			compute_missing_collation_keys (g_ptr_array_index (missing, i));
+		}
+		g_ptr_array_free (missing, TRUE);
+		return;
+	}
+
+	if (collation_key_pool == NULL) {
+		collation_key_pool = g_thread_pool_new (collation_key_chunk_thread, NULL,
+							g_get_num_processors (), FALSE, NULL);
+	}
+
+	/* The files are only touched by the pool until we return, and
+	 * each chunk writes to its own files.
+	 */
+	g_mutex_init (&batch.lock);
+	g_cond_init (&batch.done);
+	batch.pending = 0;
+
+	g_mutex_lock (&batch.lock);
+	for (i = 0; i < missing->len; i += COLLATION_KEY_CHUNK_SIZE) {
+		chunk = g_new (CollationKeyChunk, 1);
+		chunk->batch = &batch;
+		chunk->files = (NautilusFile **) missing->pdata + i;
+		chunk->n_files = MIN (COLLATION_KEY_CHUNK_SIZE, missing->len - i);
+		batch.pending++;
+		g_thread_pool_push (collation_key_pool, chunk, NULL);
+	}
+	while (batch.pending > 0) {
+		g_cond_wait (&batch.done, &batch.lock);
+	}
+	g_mutex_unlock (&batch.lock);
+
+	DEBUG ("Computed %u collation keys in %u chunks", missing->len,
+	       (missing->len + COLLATION_KEY_CHUNK_SIZE - 1) / COLLATION_KEY_CHUNK_SIZE);
+
+	g_mutex_clear (&batch.lock);
+	g_cond_clear (&batch.done);
+	g_ptr_array_free (missing, TRUE);
+}
+
 static GList *ready_data_list = NULL;
 
 typedef struct 
@@ -7975,6 +9036,9 @@ show_thumbnails_changed_callback (gpointer user_data)
 static void
 mime_type_data_changed_callback (GObject *signaller, gpointer user_data)
 {
+	/* Type descriptions might have changed too. */
+	clear_type_sort_keys ();
+
 	/* Tell the world that icons might have changed. We could invent a narrower-scope
 	 * signal to mean only "thumbnails might have changed" if this ends up being slow
 	 * for some reason.
@@ -8109,14 +9173,18 @@ static void
 nautilus_file_add_emblem (NautilusFile *file,
 			  const char *emblem_name)
 {
-	if (file->details->pending_info_providers) {
-		file->details->pending_extension_emblems = g_list_prepend (file->details->pending_extension_emblems,
-									   g_strdup (emblem_name));
+	NautilusFileExtensionDetails *extension;
+
+	extension = nautilus_file_ensure_extension_details (file);
+	if (extension->pending_info_providers) {
+		extension->pending_emblems = g_list_prepend (extension->pending_emblems,
+							     g_strdup (emblem_name));
 	} else {
-		file->details->extension_emblems = g_list_prepend (file->details->extension_emblems,
-								   g_strdup (emblem_name));
+		extension->emblems = g_list_prepend (extension->emblems,
+						     g_strdup (emblem_name));
 	}
 
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_EXTENSION | NAUTILUS_FILE_CHANGE_ICON);
 	nautilus_file_changed (file);
 }
 
@@ -8125,29 +9193,33 @@ nautilus_file_add_string_attribute (NautilusFile *file,
 				    const char *attribute_name,
 				    const char *value)
 {
-	if (file->details->pending_info_providers) {
+	NautilusFileExtensionDetails *extension;
+
+	extension = nautilus_file_ensure_extension_details (file);
+	if (extension->pending_info_providers) {
 		/* Lazily create hashtable */
-		if (!file->details->pending_extension_attributes) {
-			file->details->pending_extension_attributes = 
+		if (!extension->pending_attributes) {
+			extension->pending_attributes = 
 				g_hash_table_new_full (g_direct_hash, g_direct_equal,
 						       NULL, 
 						       (GDestroyNotify)g_free);
 		}
-		g_hash_table_insert (file->details->pending_extension_attributes,
+		g_hash_table_insert (extension->pending_attributes,
 				     GINT_TO_POINTER (g_quark_from_string (attribute_name)),
 				     g_strdup (value));
 	} else {
-		if (!file->details->extension_attributes) {
-			file->details->extension_attributes = 
+		if (!extension->attributes) {
+			extension->attributes = 
 				g_hash_table_new_full (g_direct_hash, g_direct_equal,
 						       NULL, 
 						       (GDestroyNotify)g_free);
 		}
-		g_hash_table_insert (file->details->extension_attributes,
+		g_hash_table_insert (extension->attributes,
 				     GINT_TO_POINTER (g_quark_from_string (attribute_name)),
 				     g_strdup (value));
 	}
 
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_EXTENSION);
 	nautilus_file_changed (file);
 }
 
@@ -8160,17 +9232,21 @@ nautilus_file_invalidate_extension_info (NautilusFile *file)
 void
 nautilus_file_info_providers_done (NautilusFile *file)
 {
-	g_list_free_full (file->details->extension_emblems, g_free);
-	file->details->extension_emblems = file->details->pending_extension_emblems;
-	file->details->pending_extension_emblems = NULL;
+	NautilusFileExtensionDetails *extension;
+
+	extension = nautilus_file_ensure_extension_details (file);
+	g_list_free_full (extension->emblems, g_free);
+	extension->emblems = extension->pending_emblems;
+	extension->pending_emblems = NULL;
 
-	if (file->details->extension_attributes) {
-		g_hash_table_destroy (file->details->extension_attributes);
+	if (extension->attributes) {
+		g_hash_table_destroy (extension->attributes);
 	}
 	
-	file->details->extension_attributes = file->details->pending_extension_attributes;
-	file->details->pending_extension_attributes = NULL;
+	extension->attributes = extension->pending_attributes;
+	extension->pending_attributes = NULL;
 
+	nautilus_file_add_pending_changes (file, NAUTILUS_FILE_CHANGE_EXTENSION | NAUTILUS_FILE_CHANGE_ICON);
 	nautilus_file_changed (file);
 }
 
@@ -83,6 +83,23 @@ typedef enum {
 	NAUTILUS_FILE_ICON_FLAGS_USE_ONE_EMBLEM = (1<<7)
 } NautilusFileIconFlags;	
 
+/* Which groups of attributes changed, reported for each "changed"
+ * signal by nautilus_file_get_last_changes(). */
+typedef enum {
+	NAUTILUS_FILE_CHANGE_NAME = (1<<0),
+	NAUTILUS_FILE_CHANGE_SIZE = (1<<1),
+	NAUTILUS_FILE_CHANGE_TIMES = (1<<2),
+	NAUTILUS_FILE_CHANGE_PERMISSIONS = (1<<3),
+	/* icon, thumbnail and emblems. Set along with PERMISSIONS and
+	 * MIME_TYPE, which the emblems and the icon are derived from. */
+	NAUTILUS_FILE_CHANGE_ICON = (1<<4),
+	NAUTILUS_FILE_CHANGE_MIME_TYPE = (1<<5),
+	/* attributes and emblems from NautilusInfoProviders */
+	NAUTILUS_FILE_CHANGE_EXTENSION = (1<<6),
+	NAUTILUS_FILE_CHANGE_OTHER = (1<<7),
+	NAUTILUS_FILE_CHANGE_ALL = (1<<8) - 1
+} NautilusFileChangeFlags;
+
 /* Emblems sometimes displayed for NautilusFiles. Do not localize. */ 
 #define NAUTILUS_FILE_EMBLEM_NAME_SYMBOLIC_LINK "symbolic-link"
 #define NAUTILUS_FILE_EMBLEM_NAME_CANT_READ "unreadable"
@@ -313,6 +330,8 @@ void                    nautilus_file_cancel                            (Nautilu
  * but it could hang around longer if someone ref'd it.
  */
 gboolean                nautilus_file_is_gone                           (NautilusFile                   *file);
+guint                   nautilus_file_get_generation                    (NautilusFile                   *file);
+NautilusFileChangeFlags nautilus_file_get_last_changes                  (NautilusFile                   *file);
 
 /* Return true if this file is not confirmed to have ever really
  * existed. This is true when the NautilusFile object has been created, but no I/O
@@ -398,6 +417,10 @@ int                     nautilus_file_compare_for_sort_by_attribute_q   (Nautilu
 									 gboolean                        directories_first,
 									 gboolean                        reversed);
 gboolean                nautilus_file_is_date_sort_attribute_q          (GQuark                          attribute);
+void                    nautilus_file_prepare_for_sort                  (NautilusFile                   *file,
+									 NautilusFileSortType            sort_type);
+void                    nautilus_file_prepare_for_sort_by_attribute_q   (NautilusFile                   *file,
+									 GQuark                          attribute);
 
 int                     nautilus_file_compare_display_name              (NautilusFile                   *file_1,
 									 const char                     *pattern);
@@ -448,6 +471,7 @@ void                    nautilus_file_list_unref                        (GList
 void                    nautilus_file_list_free                         (GList                          *file_list);
 GList *                 nautilus_file_list_copy                         (GList                          *file_list);
 GList *			nautilus_file_list_sort_by_display_name		(GList				*file_list);
+void                    nautilus_file_list_ensure_collation_keys        (GList                          *file_list);
 void                    nautilus_file_list_call_when_ready              (GList                          *file_list,
 									 NautilusFileAttributes          attributes,
 									 NautilusFileListHandle        **handle,
@@ -0,0 +1,44 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nautilus-local-enumerator.h: Fast listing of local directories.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NAUTILUS_LOCAL_ENUMERATOR_H
+#define NAUTILUS_LOCAL_ENUMERATOR_H
+
+#include <gio/gio.h>
+
+/* Lists a local directory straight from the kernel, producing
+ * GFileInfos with the NAUTILUS_FILE_FAST_ATTRIBUTES only. All calls
+ * are blocking and meant to be made from a worker thread.
+ */
+typedef struct NautilusLocalEnumerator NautilusLocalEnumerator;
+
+gboolean                 nautilus_local_enumerator_is_supported (GFile                   *location);
+NautilusLocalEnumerator *nautilus_local_enumerator_open         (GFile                   *location,
+								 GCancellable            *cancellable,
+								 GError                 **error);
+GList *                  nautilus_local_enumerator_next_files   (NautilusLocalEnumerator *enumerator,
+								 int                      num_files,
+								 GCancellable            *cancellable,
+								 GError                 **error);
+void                     nautilus_local_enumerator_free         (NautilusLocalEnumerator *enumerator);
+
+int                      nautilus_local_enumerator_count_children (const char          *path,
+								   gboolean             include_hidden,
+								   GHashTable          *content_types);
+
+#endif /* NAUTILUS_LOCAL_ENUMERATOR_H */
@@ -31,10 +31,26 @@
 
 #include <gio/gio.h>
 
+/* A directory that reports more than RATE_LIMIT_MAX_EVENTS events within
+ * RATE_LIMIT_WINDOW is considered busy (a log being written, a build
+ * running). Its changes are then held in the changes queue and handed
+ * over in batches, every flush_interval milliseconds, instead of after
+ * each event. The interval doubles for as long as the storm lasts.
+ */
+#define RATE_LIMIT_WINDOW (200 * G_TIME_SPAN_MILLISECOND)
+#define RATE_LIMIT_MAX_EVENTS 64
+#define RATE_LIMIT_MIN_INTERVAL 250
+#define RATE_LIMIT_MAX_INTERVAL 4000
+
 struct NautilusMonitor {
 	GFileMonitor *monitor;
 	GVolumeMonitor *volume_monitor;
 	GFile *location;
+
+	gint64 window_start;
+	guint window_events;
+	guint flush_interval;
+	guint flush_timeout_id;
 };
 
 static gboolean call_consume_changes_idle_id = 0;
@@ -74,6 +90,71 @@ mount_removed (GVolumeMonitor *volume_monitor,
 	g_object_unref (mount_location);
 }
 
+static gboolean
+flush_rate_limited_changes_cb (gpointer callback_data)
+{
+	NautilusMonitor *monitor = callback_data;
+
+	monitor->flush_timeout_id = 0;
+	nautilus_file_changes_queue_flush_directory (monitor->location);
+	schedule_call_consume_changes ();
+
+	return FALSE;
+}
+
+static void
+schedule_rate_limited_consume_changes (NautilusMonitor *monitor)
+{
+	gint64 now;
+	gboolean was_held;
+
+	was_held = monitor->flush_interval != 0;
+
+	now = g_get_monotonic_time ();
+	if (now - monitor->window_start > RATE_LIMIT_WINDOW) {
+		if (monitor->window_events < RATE_LIMIT_MAX_EVENTS ||
+		    now - monitor->window_start > 2 * RATE_LIMIT_WINDOW) {
+			/* the storm, if any, is over */
+			monitor->flush_interval = 0;
+		}
+		monitor->window_start = now;
+		monitor->window_events = 0;
+	}
+
+	if (++monitor->window_events == RATE_LIMIT_MAX_EVENTS) {
+		if (monitor->flush_interval == 0) {
+			monitor->flush_interval = RATE_LIMIT_MIN_INTERVAL;
+		} else {
+			monitor->flush_interval = MIN (monitor->flush_interval * 2,
+						       RATE_LIMIT_MAX_INTERVAL);
+		}
+	}
+
+	if (monitor->flush_interval == 0) {
+		if (was_held) {
+			if (monitor->flush_timeout_id != 0) {
+				g_source_remove (monitor->flush_timeout_id);
+				monitor->flush_timeout_id = 0;
+			}
+			nautilus_file_changes_queue_release_directory (monitor->location);
+		}
+		schedule_call_consume_changes ();
+		return;
+	}
+
+	if (!was_held) {
+		/* Only later events are held, this one goes out as usual. */
+		nautilus_file_changes_queue_hold_directory (monitor->location);
+		schedule_call_consume_changes ();
+	}
+	if (monitor->flush_timeout_id == 0) {
+		monitor->flush_timeout_id =
+			g_timeout_add (monitor->flush_interval,
+				       flush_rate_limited_changes_cb,
+				       monitor);
+	}
+}
+
 static void
 dir_changed (GFileMonitor* monitor,
 	     GFile *child,
@@ -81,19 +162,11 @@ dir_changed (GFileMonitor* monitor,
 	     GFileMonitorEvent event_type,
 	     gpointer user_data)
 {
-	char *uri, *to_uri;
-	
-	uri = g_file_get_uri (child);
-	to_uri = NULL;
-	if (other_file) {
-		to_uri = g_file_get_uri (other_file);
-	}
-
 	switch (event_type) {
 	default:
 	case G_FILE_MONITOR_EVENT_CHANGED:
 		/* ignore */
-		break;
+		return;
 	case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
 	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
 		nautilus_file_changes_queue_file_changed (child);
@@ -105,12 +178,26 @@ dir_changed (GFileMonitor* monitor,
 	case G_FILE_MONITOR_EVENT_CREATED:
 		nautilus_file_changes_queue_file_added (child);
 		break;
+	case G_FILE_MONITOR_EVENT_RENAMED:
+		nautilus_file_changes_queue_file_moved (child, other_file);
+		break;
+	case G_FILE_MONITOR_EVENT_MOVED_OUT:
+		if (other_file != NULL) {
+			nautilus_file_changes_queue_file_moved (child, other_file);
+		} else {
+			nautilus_file_changes_queue_file_removed (child);
+		}
+		break;
+	case G_FILE_MONITOR_EVENT_MOVED_IN:
+		/* If the source directory is watched too, it reports the
+		 * move itself as MOVED_OUT; an add of a file that is
+		 * already known is treated as a change.
+		 */
+		nautilus_file_changes_queue_file_added (child);
+		break;
 	}
 
-	g_free (uri);
-	g_free (to_uri);
-
-	schedule_call_consume_changes ();
+	schedule_rate_limited_consume_changes (user_data);
 }
  
 NautilusMonitor *
@@ -120,12 +207,14 @@ nautilus_monitor_directory (GFile *location)
 	NautilusMonitor *ret;
 
 	ret = g_slice_new0 (NautilusMonitor);
-	dir_monitor = g_file_monitor_directory (location, G_FILE_MONITOR_WATCH_MOUNTS, NULL, NULL);
+	ret->location = g_object_ref (location);
+	dir_monitor = g_file_monitor_directory (location,
+					       G_FILE_MONITOR_WATCH_MOUNTS | G_FILE_MONITOR_WATCH_MOVES,
+					       NULL, NULL);
 
 	if (dir_monitor != NULL) {
 		ret->monitor = dir_monitor;
 	} else if (!g_file_is_native (location)) {
-		ret->location = g_object_ref (location);
 		ret->volume_monitor = g_volume_monitor_get ();
 	}
 
@@ -157,6 +246,15 @@ nautilus_monitor_cancel (NautilusMonitor *monitor)
 		g_object_unref (monitor->volume_monitor);
 	}
 
+	if (monitor->flush_timeout_id != 0) {
+		g_source_remove (monitor->flush_timeout_id);
+	}
+	if (monitor->flush_interval != 0) {
+		/* don't leave the batched changes stranded in the queue */
+		nautilus_file_changes_queue_release_directory (monitor->location);
+		schedule_call_consume_changes ();
+	}
+
 	g_clear_object (&monitor->location);
 	g_slice_free (NautilusMonitor, monitor);
 }
@@ -37,6 +37,7 @@ enum {
 	HISTORY_LIST_CHANGED,
 	POPUP_MENU_CHANGED,
 	MIME_DATA_CHANGED,
+	DATE_FORMAT_CHANGED,
 	LAST_SIGNAL
 };
 
@@ -90,4 +91,12 @@ nautilus_signaller_class_init (NautilusSignallerClass *class)
 		              NULL, NULL,
 		              g_cclosure_marshal_VOID__VOID,
 		              G_TYPE_NONE, 0);
+	signals[DATE_FORMAT_CHANGED] =
+		g_signal_new ("date-format-changed",
+		              G_TYPE_FROM_CLASS (class),
+		              G_SIGNAL_RUN_LAST,
+		              0,
+		              NULL, NULL,
+		              g_cclosure_marshal_VOID__VOID,
+		              G_TYPE_NONE, 0);
 }
@@ -1370,6 +1370,13 @@ compare_files (NautilusFilesView   *canvas_view,
 	return nautilus_canvas_view_compare_files ((NautilusCanvasView *)canvas_view, a, b);
 }
 
+static void
+prepare_for_sort (NautilusFilesView *view,
+		  NautilusFile *file)
+{
+	nautilus_file_prepare_for_sort (file, NAUTILUS_CANVAS_VIEW (view)->details->sort->sort_type);
+}
+
 static void
 selection_changed_callback (NautilusCanvasContainer *container,
 			    NautilusCanvasView *canvas_view)
@@ -1918,6 +1925,7 @@ nautilus_canvas_view_class_init (NautilusCanvasViewClass *klass)
 	nautilus_files_view_class->set_selection = nautilus_canvas_view_set_selection;
 	nautilus_files_view_class->invert_selection = nautilus_canvas_view_invert_selection;
 	nautilus_files_view_class->compare_files = compare_files;
+	nautilus_files_view_class->prepare_for_sort = prepare_for_sort;
         nautilus_files_view_class->click_policy_changed = nautilus_canvas_view_click_policy_changed;
 	nautilus_files_view_class->update_actions_state = nautilus_canvas_view_update_actions_state;
         nautilus_files_view_class->sort_directories_first_changed = nautilus_canvas_view_sort_directories_first_changed;
@@ -3500,8 +3500,43 @@ static void
 sort_files (NautilusFilesView  *view,
             GList             **list)
 {
-        *list = g_list_sort_with_data (*list, compare_files_cover, view);
+        NautilusFilesViewClass *klass;
+        FileAndDirectory *fad;
+        gpointer *items;
+        GList *node, *files;
+        guint length, i;
+
+        klass = NAUTILUS_FILES_VIEW_CLASS (G_OBJECT_GET_CLASS (view));
+        length = g_list_length (*list);
+
+        if (klass->prepare_for_sort == NULL ||
+            length < EEL_SORT_PARALLEL_MIN_ITEMS) {
+                *list = g_list_sort_with_data (*list, compare_files_cover, view);
+                return;
+        }
 
+        /* compute the name sort keys in one batch before preparing */
+        files = NULL;
+        for (node = *list; node != NULL; node = node->next) {
+                fad = node->data;
+                files = g_list_prepend (files, fad->file);
+        }
+        nautilus_file_list_ensure_collation_keys (files);
+        g_list_free (files);
+
+        items = g_new (gpointer, length);
+        for (node = *list, i = 0; node != NULL; node = node->next, i++) {
+                fad = node->data;
+                klass->prepare_for_sort (view, fad->file);
+                items[i] = fad;
+        }
+
+        eel_sort_parallel (items, length, compare_files_cover, view);
+
+        for (node = *list, i = 0; node != NULL; node = node->next, i++) {
+                node->data = items[i];
+        }
+        g_free (items);
 }
 
 /* Go through all the new added and changed files.
@@ -226,6 +226,15 @@ struct NautilusFilesViewClass {
                                               NautilusFile      *a,
                                               NautilusFile      *b);
 
+        /* prepare_for_sort is called on every file of a large list
+         * before compare_files is called on them from several threads,
+         * and must compute whatever compare_files would compute lazily.
+         * Views that don't provide it have their files sorted in the
+         * main thread.
+         */
+        void    (* prepare_for_sort)         (NautilusFilesView *view,
+                                              NautilusFile      *file);
+
         /* using_manual_layout is a function pointer that subclasses may
          * override to control whether or not items can be freely positioned
          * on the user-visible area.
@@ -33,8 +33,10 @@
 #include <gtk/gtk.h>
 #include <cairo-gobject.h>
 
+#include <eel/eel-glib-extensions.h>
 #include <eel/eel-graphic-effects.h>
 #include <libnautilus-private/nautilus-dnd.h>
+#include <libnautilus-private/nautilus-signaller.h>
 
 enum {
 	SUBDIRECTORY_UNLOADED,
@@ -57,10 +59,56 @@ static int nautilus_list_model_file_entry_compare_func (gconstpointer a,
 static void nautilus_list_model_tree_model_init (GtkTreeModelIface *iface);
 static void nautilus_list_model_sortable_init (GtkTreeSortableIface *iface);
 
+typedef struct FileEntry FileEntry;
+typedef struct RowBlock RowBlock;
+typedef struct RowArray RowArray;
+typedef struct RowCache RowCache;
+
+/* The rows of one level of the tree (the top level, or the children
+ * of an expanded directory) are kept in order in a list of fixed size
+ * blocks. A row knows its block and its slot in it, and a block knows
+ * the index of its first row, so the index of a row is found in
+ * constant time. Inserting or removing a row moves at most one block's
+ * worth of pointers and then adjusts the start of the following blocks.
+ */
+#define ROW_BLOCK_SIZE 512
+
+struct RowBlock {
+	RowArray *array;
+	guint position;		/* index of the block in array->blocks */
+	guint start;		/* index of rows[0] in the level */
+	guint n_rows;
+	FileEntry *rows[ROW_BLOCK_SIZE];
+};
+
+struct RowArray {
+	GPtrArray *blocks;
+	guint n_rows;
+};
+
+/* The values a row was last rendered with, so that redrawing and
+ * scrolling do not load the same icon or format the same strings
+ * again. Only the ROW_CACHE_MAX_ROWS most recently drawn rows keep
+ * one. It is dropped when the file changes.
+ */
+#define ROW_CACHE_MAX_ROWS 4096
+
+struct RowCache {
+	GList lru_link;
+	GQueue *lru;
+
+	cairo_surface_t *icon;
+	int icon_column;
+	int icon_scale;
+
+	char **strings;		/* by column, past NAUTILUS_LIST_MODEL_NUM_COLUMNS */
+	guint n_strings;
+};
+
 struct NautilusListModelDetails {
-	GSequence *files;
-	GHashTable *directory_reverse_map; /* map from directory to GSequenceIter's */
-	GHashTable *top_reverse_map;	   /* map from files in top dir to GSequenceIter's */
+	RowArray *files;
+	GHashTable *directory_reverse_map; /* map from directory to FileEntry's */
+	GHashTable *top_reverse_map;	   /* map from files in top dir to FileEntry's */
 
 	int stamp;
 
@@ -76,6 +124,8 @@ struct NautilusListModelDetails {
 	GPtrArray *columns;
 
 	GList *highlight_files;
+
+	GQueue row_cache_lru;
 };
 
 typedef struct {
@@ -84,15 +134,16 @@ typedef struct {
 	GList *path_list;
 } DragDataGetInfo;
 
-typedef struct FileEntry FileEntry;
-
 struct FileEntry {
 	NautilusFile *file;
-	GHashTable *reverse_map;	/* map from files to GSequenceIter's */
+	GHashTable *reverse_map;	/* map from files to FileEntry's */
 	NautilusDirectory *subdirectory;
 	FileEntry *parent;
-	GSequence *files;
-	GSequenceIter *ptr;
+	RowArray *files;
+	RowBlock *block;
+	guint slot;
+	RowCache *cache;
+	guint generation;	/* of the file when the row last saw it */
 	guint loaded : 1;
 };
 
@@ -107,9 +158,108 @@ static const GtkTargetEntry drag_types [] = {
 	{ NAUTILUS_ICON_DND_URI_LIST_TYPE, 0, NAUTILUS_ICON_DND_URI_LIST },
 };
 
+static void row_array_free (RowArray *array);
+
+static void
+file_entry_clear_cache (FileEntry *file_entry)
+{
+	RowCache *cache;
+	guint i;
+
+	cache = file_entry->cache;
+	if (cache == NULL) {
+		return;
+	}
+	file_entry->cache = NULL;
+
+	g_queue_unlink (cache->lru, &cache->lru_link);
+	if (cache->icon != NULL) {
+		cairo_surface_destroy (cache->icon);
+	}
+	for (i = 0; i < cache->n_strings; i++) {
+		g_free (cache->strings[i]);
+	}
+	g_free (cache->strings);
+	g_slice_free (RowCache, cache);
+}
+
+static RowCache *
+file_entry_get_cache (NautilusListModel *model, FileEntry *file_entry)
+{
+	RowCache *cache;
+	GQueue *lru;
+
+	lru = &model->details->row_cache_lru;
+	cache = file_entry->cache;
+
+	if (cache == NULL) {
+		cache = g_slice_new0 (RowCache);
+		cache->lru = lru;
+		cache->lru_link.data = file_entry;
+		file_entry->cache = cache;
+		g_queue_push_head_link (lru, &cache->lru_link);
+
+		if (lru->length > ROW_CACHE_MAX_ROWS) {
+			file_entry_clear_cache (g_queue_peek_tail (lru));
+		}
+	} else if (lru->head != &cache->lru_link) {
+		g_queue_unlink (lru, &cache->lru_link);
+		g_queue_push_head_link (lru, &cache->lru_link);
+	}
+
+	return cache;
+}
+
+/* Drop only what the given changes can have made stale. */
+static void
+file_entry_forget_changes (FileEntry *file_entry,
+			   NautilusFileChangeFlags changes)
+{
+	RowCache *cache;
+	guint i;
+
+	cache = file_entry->cache;
+	if (cache == NULL) {
+		return;
+	}
+
+	/* The emblems follow the permissions, the icon the MIME type */
+	if (changes & (NAUTILUS_FILE_CHANGE_ICON |
+		       NAUTILUS_FILE_CHANGE_PERMISSIONS |
+		       NAUTILUS_FILE_CHANGE_MIME_TYPE)) {
+		if (cache->icon != NULL) {
+			cairo_surface_destroy (cache->icon);
+			cache->icon = NULL;
+		}
+	}
+	if (changes & ~NAUTILUS_FILE_CHANGE_ICON) {
+		for (i = 0; i < cache->n_strings; i++) {
+			g_free (cache->strings[i]);
+			cache->strings[i] = NULL;
+		}
+	}
+}
+
+static void
+nautilus_list_model_clear_row_caches (NautilusListModel *model)
+{
+	while (!g_queue_is_empty (&model->details->row_cache_lru)) {
+		file_entry_clear_cache (g_queue_peek_tail (&model->details->row_cache_lru));
+	}
+}
+
+static void
+date_format_changed_callback (NautilusListModel *model)
+{
+	/* the cached strings have dates in the old format, or relative
+	 * to a day that is over */
+	nautilus_list_model_clear_row_caches (model);
+}
+
 static void
 file_entry_free (FileEntry *file_entry)
 {
+	file_entry_clear_cache (file_entry);
 	nautilus_file_unref (file_entry->file);
 	if (file_entry->reverse_map) {
 		g_hash_table_destroy (file_entry->reverse_map);
@@ -119,9 +269,293 @@ file_entry_free (FileEntry *file_entry)
 		nautilus_directory_unref (file_entry->subdirectory);
 	}
 	if (file_entry->files != NULL) {
-		g_sequence_free (file_entry->files);
+		row_array_free (file_entry->files);
+	}
+	g_slice_free (FileEntry, file_entry);
+}
+
+static RowArray *
+row_array_new (void)
+{
+	RowArray *array;
+
+	array = g_slice_new0 (RowArray);
+	array->blocks = g_ptr_array_new ();
+
+	return array;
+}
+
+static void
+row_array_free (RowArray *array)
+{
+	RowBlock *block;
+	guint i, j;
+
+	for (i = 0; i < array->blocks->len; i++) {
+		block = g_ptr_array_index (array->blocks, i);
+		for (j = 0; j < block->n_rows; j++) {
+			file_entry_free (block->rows[j]);
+		}
+		g_slice_free (RowBlock, block);
+	}
+	g_ptr_array_free (array->blocks, TRUE);
+	g_slice_free (RowArray, array);
+}
+
+static guint
+row_array_get_length (RowArray *array)
+{
+	return array->n_rows;
+}
+
+static guint
+file_entry_get_index (FileEntry *file_entry)
+{
+	return file_entry->block->start + file_entry->slot;
+}
+
+static FileEntry *
+row_array_get_nth (RowArray *array, guint n)
+{
+	RowBlock *block;
+	guint low, high, mid;
+
+	if (n >= array->n_rows) {
+		return NULL;
+	}
+
+	/* find the last block starting at or before n */
+	low = 0;
+	high = array->blocks->len;
+	while (high - low > 1) {
+		mid = low + (high - low) / 2;
+		block = g_ptr_array_index (array->blocks, mid);
+		if (block->start <= n) {
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+
+	block = g_ptr_array_index (array->blocks, low);
+	return block->rows[n - block->start];
+}
+
+static FileEntry *
+file_entry_get_next (FileEntry *file_entry)
+{
+	RowBlock *block;
+
+	block = file_entry->block;
+	if (file_entry->slot + 1 < block->n_rows) {
+		return block->rows[file_entry->slot + 1];
+	}
+
+	if (block->position + 1 < block->array->blocks->len) {
+		block = g_ptr_array_index (block->array->blocks, block->position + 1);
+		return block->rows[0];
+	}
+
+	return NULL;
+}
+
+static void
+row_block_update_rows (RowBlock *block, guint first_slot)
+{
+	guint i;
+
+	for (i = first_slot; i < block->n_rows; i++) {
+		block->rows[i]->block = block;
+		block->rows[i]->slot = i;
+	}
+}
+
+static void
+row_array_update_blocks (RowArray *array, guint first_block)
+{
+	RowBlock *block;
+	guint i, start;
+
+	start = 0;
+	if (first_block > 0) {
+		block = g_ptr_array_index (array->blocks, first_block - 1);
+		start = block->start + block->n_rows;
+	}
+
+	for (i = first_block; i < array->blocks->len; i++) {
+		block = g_ptr_array_index (array->blocks, i);
+		block->position = i;
+		block->start = start;
+		start += block->n_rows;
+	}
+}
+
+static RowBlock *
+row_array_add_block (RowArray *array, guint position)
+{
+	RowBlock *block;
+
+	block = g_slice_new (RowBlock);
+	block->array = array;
+	block->n_rows = 0;
+	g_ptr_array_insert (array->blocks, position, block);
+
+	return block;
+}
+
+static void
+row_array_insert (RowArray *array, guint index, FileEntry *file_entry)
+{
+	RowBlock *block, *new_block;
+	guint slot, half;
+
+	g_assert (index <= array->n_rows);
+
+	if (array->blocks->len == 0) {
+		block = row_array_add_block (array, 0);
+		row_array_update_blocks (array, 0);
+	} else if (index == array->n_rows) {
+		block = g_ptr_array_index (array->blocks, array->blocks->len - 1);
+	} else {
+		block = row_array_get_nth (array, index)->block;
+	}
+	slot = index - block->start;
+
+	if (block->n_rows == ROW_BLOCK_SIZE) {
+		if (slot == ROW_BLOCK_SIZE) {
+			/* appending, start a fresh block so the full
+			 * one stays full */
+			block = row_array_add_block (array, block->position + 1);
+			slot = 0;
+		} else {
+			/* split the block in two */
+			half = ROW_BLOCK_SIZE / 2;
+			new_block = row_array_add_block (array, block->position + 1);
+			memcpy (new_block->rows, block->rows + half,
+				(ROW_BLOCK_SIZE - half) * sizeof (FileEntry *));
+			new_block->n_rows = ROW_BLOCK_SIZE - half;
+			block->n_rows = half;
+			row_block_update_rows (new_block, 0);
+
+			if (slot > half) {
+				block = new_block;
+				slot -= half;
+			}
+		}
+		row_array_update_blocks (array, 0);
+	}
+
+	memmove (block->rows + slot + 1, block->rows + slot,
+		 (block->n_rows - slot) * sizeof (FileEntry *));
+	block->rows[slot] = file_entry;
+	block->n_rows++;
+	row_block_update_rows (block, slot);
+
+	array->n_rows++;
+	row_array_update_blocks (array, block->position);
+}
+
+/* Takes the row out of the array without freeing it. */
+static void
+row_array_steal (RowArray *array, FileEntry *file_entry)
+{
+	RowBlock *block;
+	guint slot, position;
+
+	block = file_entry->block;
+	slot = file_entry->slot;
+	g_assert (block->array == array);
+
+	memmove (block->rows + slot, block->rows + slot + 1,
+		 (block->n_rows - slot - 1) * sizeof (FileEntry *));
+	block->n_rows--;
+	array->n_rows--;
+	file_entry->block = NULL;
+
+	position = block->position;
+	if (block->n_rows == 0) {
+		g_ptr_array_remove_index (array->blocks, position);
+		g_slice_free (RowBlock, block);
+	} else {
+		row_block_update_rows (block, slot);
+	}
+	row_array_update_blocks (array, position);
+}
+
+static void
+row_array_remove (RowArray *array, FileEntry *file_entry)
+{
+	row_array_steal (array, file_entry);
+	file_entry_free (file_entry);
+}
+
+/* Returns the index after the last row that does not sort after @file_entry. */
+static guint
+row_array_search (RowArray *array,
+		  FileEntry *file_entry,
+		  GCompareDataFunc compare_func,
+		  gpointer user_data)
+{
+	guint low, high, mid;
+
+	low = 0;
+	high = array->n_rows;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (compare_func (row_array_get_nth (array, mid), file_entry, user_data) <= 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+static guint
+row_array_insert_sorted (RowArray *array,
+			 FileEntry *file_entry,
+			 GCompareDataFunc compare_func,
+			 gpointer user_data)
+{
+	guint index;
+
+	index = row_array_search (array, file_entry, compare_func, user_data);
+	row_array_insert (array, index, file_entry);
+
+	return index;
+}
+
+static FileEntry **
+row_array_get_rows (RowArray *array)
+{
+	FileEntry **rows;
+	RowBlock *block;
+	guint i, n;
+
+	rows = g_new (FileEntry *, array->n_rows);
+	for (i = 0, n = 0; i < array->blocks->len; i++) {
+		block = g_ptr_array_index (array->blocks, i);
+		memcpy (rows + n, block->rows, block->n_rows * sizeof (FileEntry *));
+		n += block->n_rows;
+	}
+
+	return rows;
+}
+
+/* Puts the same rows back in a new order, reusing the existing blocks. */
+static void
+row_array_set_rows (RowArray *array, FileEntry **rows)
+{
+	RowBlock *block;
+	guint i, n;
+
+	for (i = 0, n = 0; i < array->blocks->len; i++) {
+		block = g_ptr_array_index (array->blocks, i);
+		memcpy (block->rows, rows + n, block->n_rows * sizeof (FileEntry *));
+		row_block_update_rows (block, 0);
+		n += block->n_rows;
 	}
-	g_free (file_entry);
 }
 
 static GtkTreeModelFlags
@@ -161,12 +595,12 @@ nautilus_list_model_get_column_type (GtkTreeModel *tree_model, int index)
 }
 
 static void
-nautilus_list_model_ptr_to_iter (NautilusListModel *model, GSequenceIter *ptr, GtkTreeIter *iter)
+nautilus_list_model_entry_to_iter (NautilusListModel *model, FileEntry *file_entry, GtkTreeIter *iter)
 {
-	g_assert (!g_sequence_iter_is_end (ptr));
+	g_assert (file_entry != NULL);
 	if (iter != NULL) {
 		iter->stamp = model->details->stamp;
-		iter->user_data = ptr;
+		iter->user_data = file_entry;
 	}
 }
 
@@ -174,28 +608,30 @@ static gboolean
 nautilus_list_model_get_iter (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
 {
 	NautilusListModel *model;
-	GSequence *files;
-	GSequenceIter *ptr;
+	RowArray *files;
 	FileEntry *file_entry;
 	int i, d;
 	
 	model = (NautilusListModel *)tree_model;
-	ptr = NULL;
+	file_entry = NULL;
 	
 	files = model->details->files;
 	for (d = 0; d < gtk_tree_path_get_depth (path); d++) {
 		i = gtk_tree_path_get_indices (path)[d];
 
-		if (files == NULL || i >= g_sequence_get_length (files)) {
+		if (files == NULL || i < 0 || i >= row_array_get_length (files)) {
 			return FALSE;
 		}
 
-		ptr = g_sequence_get_iter_at_pos (files, i);
-		file_entry = g_sequence_get (ptr);
+		file_entry = row_array_get_nth (files, i);
 		files = file_entry->files;
 	}
 
-	nautilus_list_model_ptr_to_iter (model, ptr, iter);
+	if (file_entry == NULL) {
+		return FALSE;
+	}
+
+	nautilus_list_model_entry_to_iter (model, file_entry, iter);
 	
 	return TRUE;
 }
@@ -205,7 +641,6 @@ nautilus_list_model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
 {
 	GtkTreePath *path;
 	NautilusListModel *model;
-	GSequenceIter *ptr;
 	FileEntry *file_entry;
 
 
@@ -213,21 +648,9 @@ nautilus_list_model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
 	
 	g_return_val_if_fail (iter->stamp == model->details->stamp, NULL);
 
-	if (g_sequence_iter_is_end (iter->user_data)) {
-		/* FIXME is this right? */
-		return NULL;
-	}
-	
 	path = gtk_tree_path_new ();
-	ptr = iter->user_data;
-	while (ptr != NULL) {
-		gtk_tree_path_prepend_index (path, g_sequence_iter_get_position (ptr));
-		file_entry = g_sequence_get (ptr);
-		if (file_entry->parent != NULL) {
-			ptr = file_entry->parent->ptr;
-		} else {
-			ptr = NULL;
-		}
+	for (file_entry = iter->user_data; file_entry != NULL; file_entry = file_entry->parent) {
+		gtk_tree_path_prepend_index (path, file_entry_get_index (file_entry));
 	}
 
 	return path;
@@ -276,13 +699,15 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 	NautilusListZoomLevel zoom_level;
 	NautilusFileIconFlags flags;
 	cairo_surface_t *surface;
+	RowCache *cache;
+	guint index;
 	
 	model = (NautilusListModel *)tree_model;
 
 	g_return_if_fail (model->details->stamp == iter->stamp);
-	g_return_if_fail (!g_sequence_iter_is_end (iter->user_data));
+	g_return_if_fail (iter->user_data != NULL);
 
-	file_entry = g_sequence_get (iter->user_data);
+	file_entry = iter->user_data;
 	file = file_entry->file;
 	
 	switch (column) {
@@ -330,6 +755,18 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 				}
 			}
 
+			/* the drag highlight comes and goes, don't keep it */
+			cache = NULL;
+			if ((flags & NAUTILUS_FILE_ICON_FLAGS_FOR_DRAG_ACCEPT) == 0) {
+				cache = file_entry_get_cache (model, file_entry);
+				if (cache->icon != NULL &&
+				    cache->icon_column == column &&
+				    cache->icon_scale == icon_scale) {
+					g_value_set_boxed (value, cache->icon);
+					break;
+				}
+			}
+
 			icon = nautilus_file_get_icon_pixbuf (file, icon_size, TRUE, icon_scale, flags);
 
 			if (model->details->highlight_files != NULL &&
@@ -345,6 +782,14 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 			}
 
 			surface = gdk_cairo_surface_create_from_pixbuf (icon, icon_scale, NULL);
+			if (cache != NULL) {
+				if (cache->icon != NULL) {
+					cairo_surface_destroy (cache->icon);
+				}
+				cache->icon = cairo_surface_reference (surface);
+				cache->icon_column = column;
+				cache->icon_scale = icon_scale;
+			}
 			g_value_take_boxed (value, surface);
 			g_object_unref (icon);
 		}
@@ -365,9 +810,23 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 				      "attribute_q", &attribute, 
 				      NULL);
 			if (file != NULL) {
-				str = nautilus_file_get_string_attribute_with_default_q (file, 
-											 attribute);
-				g_value_take_string (value, str);
+				cache = file_entry_get_cache (model, file_entry);
+				index = column - NAUTILUS_LIST_MODEL_NUM_COLUMNS;
+				if (index >= cache->n_strings) {
+					cache->strings = g_renew (char *, cache->strings,
+								  model->details->columns->len);
+					memset (cache->strings + cache->n_strings, 0,
+						(model->details->columns->len - cache->n_strings) * sizeof (char *));
+					cache->n_strings = model->details->columns->len;
+				}
+
+				str = cache->strings[index];
+				if (str == NULL) {
+					str = nautilus_file_get_string_attribute_with_default_q (file, 
+												 attribute);
+					cache->strings[index] = str;
+				}
+				g_value_set_string (value, str);
 			} else if (attribute == attribute_name_q) {
 				if (file_entry->parent->loaded) {
 					g_value_set_string (value, _("(Empty)"));
@@ -390,33 +849,38 @@ nautilus_list_model_iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
 
 	g_return_val_if_fail (model->details->stamp == iter->stamp, FALSE);
 
-	iter->user_data = g_sequence_iter_next (iter->user_data);
+	iter->user_data = file_entry_get_next (iter->user_data);
+
+	return iter->user_data != NULL;
+}
+
+static RowArray *
+nautilus_list_model_get_rows (NautilusListModel *model, GtkTreeIter *parent)
+{
+	FileEntry *file_entry;
+
+	if (parent == NULL) {
+		return model->details->files;
+	}
 
-	return !g_sequence_iter_is_end (iter->user_data);
+	file_entry = parent->user_data;
+	return file_entry->files;
 }
 
 static gboolean
 nautilus_list_model_iter_children (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
 {
 	NautilusListModel *model;
-	GSequence *files;
-	FileEntry *file_entry;
+	RowArray *files;
 
 	model = (NautilusListModel *)tree_model;
 
-	if (parent == NULL) {
-		files = model->details->files;
-	} else {
-		file_entry = g_sequence_get (parent->user_data);
-		files = file_entry->files;
-	}
-
-	if (files == NULL || g_sequence_get_length (files) == 0) {
+	files = nautilus_list_model_get_rows (model, parent);
+	if (files == NULL || row_array_get_length (files) == 0) {
 		return FALSE;
 	}
 
-	iter->stamp = model->details->stamp;
-	iter->user_data = g_sequence_get_begin_iter (files);
+	nautilus_list_model_entry_to_iter (model, row_array_get_nth (files, 0), iter);
 
 	return TRUE;
 }
@@ -430,55 +894,44 @@ nautilus_list_model_iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
 		return !nautilus_list_model_is_empty (NAUTILUS_LIST_MODEL (tree_model));
 	}
 
-	file_entry = g_sequence_get (iter->user_data);
+	file_entry = iter->user_data;
 
-	return (file_entry->files != NULL && g_sequence_get_length (file_entry->files) > 0);
+	return (file_entry->files != NULL && row_array_get_length (file_entry->files) > 0);
 }
 
 static int
 nautilus_list_model_iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
 {
-	NautilusListModel *model;
-	GSequence *files;
-	FileEntry *file_entry;
-
-	model = (NautilusListModel *)tree_model;
+	RowArray *files;
 
-	if (iter == NULL) {
-		files = model->details->files;
-	} else {
-		file_entry = g_sequence_get (iter->user_data);
-		files = file_entry->files;
+	files = nautilus_list_model_get_rows (NAUTILUS_LIST_MODEL (tree_model), iter);
+	if (files == NULL) {
+		return 0;
 	}
 
-	return g_sequence_get_length (files);
+	return row_array_get_length (files);
 }
 
 static gboolean
 nautilus_list_model_iter_nth_child (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, int n)
 {
 	NautilusListModel *model;
-	GSequenceIter *child;
-	GSequence *files;
-	FileEntry *file_entry;
+	RowArray *files;
+	FileEntry *child;
 
 	model = (NautilusListModel *)tree_model;
 
-	if (parent != NULL) {
-		file_entry = g_sequence_get (parent->user_data);
-		files = file_entry->files;
-	} else {
-		files = model->details->files;
+	files = nautilus_list_model_get_rows (model, parent);
+	if (files == NULL || n < 0) {
+		return FALSE;
 	}
 
-	child = g_sequence_get_iter_at_pos (files, n);
-
-	if (g_sequence_iter_is_end (child)) {
+	child = row_array_get_nth (files, n);
+	if (child == NULL) {
 		return FALSE;
 	}
 
-	iter->stamp = model->details->stamp;
-	iter->user_data = child;
+	nautilus_list_model_entry_to_iter (model, child, iter);
 
 	return TRUE;
 }
@@ -491,43 +944,40 @@ nautilus_list_model_iter_parent (GtkTreeModel *tree_model, GtkTreeIter *iter, Gt
 
 	model = (NautilusListModel *)tree_model;
 
-	file_entry = g_sequence_get (child->user_data);
+	file_entry = child->user_data;
 
 	if (file_entry->parent == NULL) {
 		return FALSE;
 	}
 
-	iter->stamp = model->details->stamp;
-	iter->user_data = file_entry->parent->ptr;
+	nautilus_list_model_entry_to_iter (model, file_entry->parent, iter);
 
 	return TRUE;
 }
 
-static GSequenceIter *
+static FileEntry *
 lookup_file (NautilusListModel *model, NautilusFile *file,
 	     NautilusDirectory *directory)
 {
-	FileEntry *file_entry;
-	GSequenceIter *ptr, *parent_ptr;
+	FileEntry *file_entry, *parent_entry;
 
-	parent_ptr = NULL;
+	parent_entry = NULL;
 	if (directory) {
-		parent_ptr = g_hash_table_lookup (model->details->directory_reverse_map,
-						  directory);
+		parent_entry = g_hash_table_lookup (model->details->directory_reverse_map,
+						    directory);
 	}
 	
-	if (parent_ptr) {
-		file_entry = g_sequence_get (parent_ptr);
-		ptr = g_hash_table_lookup (file_entry->reverse_map, file);
+	if (parent_entry) {
+		file_entry = g_hash_table_lookup (parent_entry->reverse_map, file);
 	} else {
-		ptr = g_hash_table_lookup (model->details->top_reverse_map, file);
+		file_entry = g_hash_table_lookup (model->details->top_reverse_map, file);
 	}
 
-	if (ptr) {
-		g_assert (((FileEntry *)g_sequence_get (ptr))->file == file);
+	if (file_entry) {
+		g_assert (file_entry->file == file);
 	}
 	
-	return ptr;
+	return file_entry;
 }
 
 
@@ -541,13 +991,13 @@ static void
 dir_to_iters (struct GetIters *data,
 	      GHashTable *reverse_map)
 {
-	GSequenceIter *ptr;
+	FileEntry *file_entry;
 	
-	ptr = g_hash_table_lookup (reverse_map, data->file);
-	if (ptr) {
+	file_entry = g_hash_table_lookup (reverse_map, data->file);
+	if (file_entry) {
 		GtkTreeIter *iter;
 		iter = g_new0 (GtkTreeIter, 1);
-		nautilus_list_model_ptr_to_iter (data->model, ptr, iter);
+		nautilus_list_model_entry_to_iter (data->model, file_entry, iter);
 		data->iters = g_list_prepend (data->iters, iter);
 	}
 }
@@ -561,7 +1011,7 @@ file_to_iter_cb (gpointer  key,
 	FileEntry *dir_file_entry;
 
 	data = user_data;
-	dir_file_entry = g_sequence_get ((GSequenceIter *)value);
+	dir_file_entry = value;
 	dir_to_iters (data, dir_file_entry->reverse_map);
 }
 
@@ -607,14 +1057,14 @@ nautilus_list_model_get_tree_iter_from_file (NautilusListModel *model, NautilusF
 					     NautilusDirectory *directory,
 					     GtkTreeIter *iter)
 {
-	GSequenceIter *ptr;
+	FileEntry *file_entry;
 
-	ptr = lookup_file (model, file, directory);
-	if (!ptr) {
+	file_entry = lookup_file (model, file, directory);
+	if (!file_entry) {
 		return FALSE;
 	}
 
-	nautilus_list_model_ptr_to_iter (model, ptr, iter);
+	nautilus_list_model_entry_to_iter (model, file_entry, iter);
 	
 	return TRUE;
 }
@@ -663,46 +1113,75 @@ nautilus_list_model_compare_func (NautilusListModel *model,
 	return result;
 }
 
+void
+nautilus_list_model_prepare_for_sort (NautilusListModel *model,
+				      NautilusFile *file)
+{
+	nautilus_file_prepare_for_sort_by_attribute_q (file, model->details->sort_attribute);
+}
+
 static void
-nautilus_list_model_sort_file_entries (NautilusListModel *model, GSequence *files, GtkTreePath *path)
+nautilus_list_model_sort_file_entries (NautilusListModel *model, RowArray *files, GtkTreePath *path)
 {
-	GSequenceIter **old_order;
+	FileEntry **old_order, **rows;
 	GtkTreeIter iter;
 	int *new_order;
 	int length;
 	int i;
 	FileEntry *file_entry;
+	GList *file_list;
+	gboolean batch_keys;
 	gboolean has_iter;
 
-	length = g_sequence_get_length (files);
+	length = row_array_get_length (files);
 
 	if (length <= 1) {
 		return;
 	}
 	
-	/* generate old order of GSequenceIter's */
-	old_order = g_new (GSequenceIter *, length);
+	/* generate old order of FileEntry's */
+	old_order = row_array_get_rows (files);
+	/* the files are prepared below when the sort runs in parallel;
+	 * their name keys must not be computed one by one there */
+	batch_keys = model->details->sort_attribute == attribute_name_q ||
+		length >= EEL_SORT_PARALLEL_MIN_ITEMS;
+	file_list = NULL;
 	for (i = 0; i < length; ++i) {
-		GSequenceIter *ptr = g_sequence_get_iter_at_pos (files, i);
-		
-		file_entry = g_sequence_get (ptr);
+		file_entry = old_order[i];
 		if (file_entry->files != NULL) {
 			gtk_tree_path_append_index (path, i);
 			nautilus_list_model_sort_file_entries (model, file_entry->files, path);
 			gtk_tree_path_up (path);
 		}
-
-		old_order[i] = ptr;
+		if (batch_keys && file_entry->file != NULL) {
+			file_list = g_list_prepend (file_list, file_entry->file);
+		}
 	}
 
-	/* sort */
-	g_sequence_sort (files, nautilus_list_model_file_entry_compare_func, model);
+	/* compute the name sort keys up front, in one batch */
+	nautilus_file_list_ensure_collation_keys (file_list);
+	g_list_free (file_list);
+
+	/* sort; when the comparisons are spread over several threads, the
+	 * files are prepared first so that comparing them only reads them */
+	rows = g_memdup (old_order, length * sizeof (FileEntry *));
+	if (length >= EEL_SORT_PARALLEL_MIN_ITEMS) {
+		for (i = 0; i < length; ++i) {
+			if (rows[i]->file != NULL) {
+				nautilus_list_model_prepare_for_sort (model, rows[i]->file);
+			}
+		}
+	}
+	eel_sort_parallel ((gpointer *) rows, length,
+			   nautilus_list_model_file_entry_compare_func, model);
+	row_array_set_rows (files, rows);
+	g_free (rows);
 
 	/* generate new order */
 	new_order = g_new (int, length);
 	/* Note: new_order[newpos] = oldpos */
 	for (i = 0; i < length; ++i) {
-		new_order[g_sequence_iter_get_position (old_order[i])] = i;
+		new_order[file_entry_get_index (old_order[i])] = i;
 	}
 
 	/* Let the world know about our new order */
@@ -792,12 +1271,11 @@ add_dummy_row (NautilusListModel *model, FileEntry *parent_entry)
 	GtkTreeIter iter;
 	GtkTreePath *path;
 	
-	dummy_file_entry = g_new0 (FileEntry, 1);
+	dummy_file_entry = g_slice_new0 (FileEntry);
 	dummy_file_entry->parent = parent_entry;
-	dummy_file_entry->ptr = g_sequence_insert_sorted (parent_entry->files, dummy_file_entry,
-							  nautilus_list_model_file_entry_compare_func, model);
-	iter.stamp = model->details->stamp;
-	iter.user_data = dummy_file_entry->ptr;
+	row_array_insert_sorted (parent_entry->files, dummy_file_entry,
+				 nautilus_list_model_file_entry_compare_func, model);
+	nautilus_list_model_entry_to_iter (model, dummy_file_entry, &iter);
 	
 	path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
 	gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
@@ -810,29 +1288,27 @@ nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 {
 	GtkTreeIter iter;
 	GtkTreePath *path;
-	FileEntry *file_entry;
-	GSequenceIter *ptr, *parent_ptr;
-	GSequence *files;
+	FileEntry *file_entry, *parent_entry, *existing;
+	RowArray *files;
 	gboolean replace_dummy;
 	GHashTable *parent_hash;
 
-	parent_ptr = g_hash_table_lookup (model->details->directory_reverse_map,
-					  directory);
-	if (parent_ptr) {
-		file_entry = g_sequence_get (parent_ptr);
-		ptr = g_hash_table_lookup (file_entry->reverse_map, file);
+	parent_entry = g_hash_table_lookup (model->details->directory_reverse_map,
+					    directory);
+	if (parent_entry) {
+		existing = g_hash_table_lookup (parent_entry->reverse_map, file);
 	} else {
-		file_entry = NULL;
-		ptr = g_hash_table_lookup (model->details->top_reverse_map, file);
+		existing = g_hash_table_lookup (model->details->top_reverse_map, file);
 	}
 
-	if (ptr != NULL) {
-		g_warning ("file already in tree (parent_ptr: %p)!!!\n", parent_ptr);
+	if (existing != NULL) {
+		g_warning ("file already in tree (parent_entry: %p)!!!\n", parent_entry);
 		return FALSE;
 	}
 	
-	file_entry = g_new0 (FileEntry, 1);
+	file_entry = g_slice_new0 (FileEntry);
 	file_entry->file = nautilus_file_ref (file);
+	file_entry->generation = nautilus_file_get_generation (file);
 	file_entry->parent = NULL;
 	file_entry->subdirectory = NULL;
 	file_entry->files = NULL;
@@ -842,8 +1318,8 @@ nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 	
 	replace_dummy = FALSE;
 
-	if (parent_ptr != NULL) {
-		file_entry->parent = g_sequence_get (parent_ptr);
+	if (parent_entry != NULL) {
+		file_entry->parent = parent_entry;
 		/* At this point we set loaded. Either we saw
 		 * "done" and ignored it waiting for this, or we do this
 		 * earlier, but then we replace the dummy row anyway,
@@ -851,13 +1327,12 @@ nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 		file_entry->parent->loaded = 1;
 		parent_hash = file_entry->parent->reverse_map;
 		files = file_entry->parent->files;
-		if (g_sequence_get_length (files) == 1) {
-			GSequenceIter *dummy_ptr = g_sequence_get_iter_at_pos (files, 0);
-			FileEntry *dummy_entry = g_sequence_get (dummy_ptr);
+		if (row_array_get_length (files) == 1) {
+			FileEntry *dummy_entry = row_array_get_nth (files, 0);
 			if (dummy_entry->file == NULL) {
 				/* replace the dummy loading entry */
 				model->details->stamp++;
-				g_sequence_remove (dummy_ptr);
+				row_array_remove (files, dummy_entry);
 				
 				replace_dummy = TRUE;
 			}
@@ -865,13 +1340,12 @@ nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 	}
 
 	
-	file_entry->ptr = g_sequence_insert_sorted (files, file_entry,
-					    nautilus_list_model_file_entry_compare_func, model);
+	row_array_insert_sorted (files, file_entry,
+				 nautilus_list_model_file_entry_compare_func, model);
 
-	g_hash_table_insert (parent_hash, file, file_entry->ptr);
+	g_hash_table_insert (parent_hash, file, file_entry);
 	
-	iter.stamp = model->details->stamp;
-	iter.user_data = file_entry->ptr;
+	nautilus_list_model_entry_to_iter (model, file_entry, &iter);
 
 	path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
 	if (replace_dummy) {
@@ -881,7 +1355,7 @@ nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 	}
 
 	if (nautilus_file_is_directory (file)) {
-		file_entry->files = g_sequence_new ((GDestroyNotify)file_entry_free);
+		file_entry->files = row_array_new ();
 
 		add_dummy_row (model, file_entry);
 
@@ -893,48 +1367,203 @@ nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 	return TRUE;
 }
 
+/* Below this ratio of new rows to existing ones, each new row is
+ * placed by binary search rather than by walking the whole level. */
+#define ADD_FILES_MERGE_RATIO 32
+
+/**
+ * nautilus_list_model_add_files:
+ * @files: (element-type NautilusFile): files in @directory to add
+ *
+ * Adds several files at once. The batch is sorted on its own and then
+ * merged with the rows already in the model, announcing each new row
+ * as soon as it is in place.
+ */
+void
+nautilus_list_model_add_files (NautilusListModel *model, GList *files,
+			       NautilusDirectory *directory)
+{
+	GtkTreeIter iter;
+	GtkTreePath *path;
+	FileEntry *file_entry, *parent_entry, *dummy_entry, *next_entry;
+	FileEntry **new_rows;
+	RowArray *array;
+	GHashTable *parent_hash;
+	NautilusFile *file;
+	GList *l, *key_files;
+	gboolean merge;
+	guint n_new, n_old, i, j, position;
+
+	parent_entry = g_hash_table_lookup (model->details->directory_reverse_map,
+					    directory);
+	if (parent_entry != NULL) {
+		parent_hash = parent_entry->reverse_map;
+		array = parent_entry->files;
+
+		/* Let the first file replace the "Loading…" row */
+		if (files != NULL && row_array_get_length (array) == 1) {
+			dummy_entry = row_array_get_nth (array, 0);
+			if (dummy_entry->file == NULL) {
+				nautilus_list_model_add_file (model, files->data, directory);
+				files = files->next;
+			}
+		}
+	} else {
+		parent_hash = model->details->top_reverse_map;
+		array = model->details->files;
+	}
+
+	new_rows = g_new (FileEntry *, g_list_length (files));
+	key_files = NULL;
+	n_new = 0;
+	for (l = files; l != NULL; l = l->next) {
+		file = l->data;
+		if (g_hash_table_lookup (parent_hash, file) != NULL) {
+			g_warning ("file already in tree (parent_entry: %p)!!!\n", parent_entry);
+			continue;
+		}
+
+		file_entry = g_slice_new0 (FileEntry);
+		file_entry->file = nautilus_file_ref (file);
+		file_entry->generation = nautilus_file_get_generation (file);
+		file_entry->parent = parent_entry;
+		g_hash_table_insert (parent_hash, file, file_entry);
+		new_rows[n_new++] = file_entry;
+
+		key_files = g_list_prepend (key_files, file);
+	}
+
+	if (n_new == 0) {
+		g_free (new_rows);
+		return;
+	}
+
+	if (parent_entry != NULL) {
+		parent_entry->loaded = 1;
+	}
+
+	/* sort the batch; the name keys break ties for every sort type,
+	 * so they are computed up front in one batch */
+	if (model->details->sort_attribute == attribute_name_q ||
+	    n_new >= EEL_SORT_PARALLEL_MIN_ITEMS) {
+		nautilus_file_list_ensure_collation_keys (key_files);
+	}
+	g_list_free (key_files);
+	if (n_new >= EEL_SORT_PARALLEL_MIN_ITEMS) {
+		for (i = 0; i < n_new; i++) {
+			nautilus_list_model_prepare_for_sort (model, new_rows[i]->file);
+		}
+	}
+	eel_sort_parallel ((gpointer *) new_rows, n_new,
+			   nautilus_list_model_file_entry_compare_func, model);
+
+	/* Put the rows in place one at a time and announce each one
+	 * right away, so the view is never asked about a row it was not
+	 * told about. A few rows find their place by binary search, more
+	 * by walking the level along with the sorted batch. */
+	n_old = row_array_get_length (array);
+	merge = n_new * ADD_FILES_MERGE_RATIO >= n_old;
+	next_entry = row_array_get_nth (array, 0);
+	position = 0;
+	for (j = 0; j < n_new; j++) {
+		file_entry = new_rows[j];
+		if (merge) {
+			while (next_entry != NULL &&
+			       nautilus_list_model_file_entry_compare_func (next_entry, file_entry, model) <= 0) {
+				next_entry = file_entry_get_next (next_entry);
+				position++;
+			}
+			row_array_insert (array, position++, file_entry);
+		} else {
+			row_array_insert_sorted (array, file_entry,
+						 nautilus_list_model_file_entry_compare_func, model);
+		}
+
+		nautilus_list_model_entry_to_iter (model, file_entry, &iter);
+		path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
+		gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+
+		if (nautilus_file_is_directory (file_entry->file)) {
+			file_entry->files = row_array_new ();
+
+			add_dummy_row (model, file_entry);
+
+			gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
+							      path, &iter);
+		}
+		gtk_tree_path_free (path);
+	}
+
+	g_free (new_rows);
+}
+
 void
 nautilus_list_model_file_changed (NautilusListModel *model, NautilusFile *file,
 				  NautilusDirectory *directory)
 {
-	FileEntry *parent_file_entry;
+	FileEntry *file_entry, *parent_file_entry;
 	GtkTreeIter iter;
 	GtkTreePath *path, *parent_path;
-	GSequenceIter *ptr;
 	int pos_before, pos_after, length, i, old;
 	int *new_order;
 	gboolean has_iter;
-	GSequence *files;
+	RowArray *files;
+	NautilusFileChangeFlags changes;
+	guint generation;
 
-	ptr = lookup_file (model, file, directory);
-	if (!ptr) {
+	file_entry = lookup_file (model, file, directory);
+	if (!file_entry) {
 		return;
 	}
 
+	/* If this row saw the previous change, the file can tell us what
+	 * this one touched. Otherwise changes were folded together on the
+	 * way here and anything may be stale. */
+	generation = nautilus_file_get_generation (file);
+	if (file_entry->generation + 1 == generation) {
+		changes = nautilus_file_get_last_changes (file);
+	} else {
+		changes = NAUTILUS_FILE_CHANGE_ALL;
+	}
+	file_entry->generation = generation;
+
+	file_entry_forget_changes (file_entry, changes);
+
+	if ((changes & ~NAUTILUS_FILE_CHANGE_ICON) == 0) {
+		/* No sort key is taken from the icon */
+		nautilus_list_model_entry_to_iter (model, file_entry, &iter);
+		path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
+		gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+		gtk_tree_path_free (path);
+		return;
+	}
+
+	parent_file_entry = file_entry->parent;
+	if (parent_file_entry == NULL) {
+		files = model->details->files;
+	} else {
+		files = parent_file_entry->files;
+	}
 	
-	pos_before = g_sequence_iter_get_position (ptr);
+	pos_before = file_entry_get_index (file_entry);
 		
-	g_sequence_sort_changed (ptr, nautilus_list_model_file_entry_compare_func, model);
-
-	pos_after = g_sequence_iter_get_position (ptr);
+	row_array_steal (files, file_entry);
+	pos_after = row_array_insert_sorted (files, file_entry,
+					     nautilus_list_model_file_entry_compare_func, model);
 
 	if (pos_before != pos_after) {
 		/* The file moved, we need to send rows_reordered */
 		
-		parent_file_entry = ((FileEntry *)g_sequence_get (ptr))->parent;
-
 		if (parent_file_entry == NULL) {
 			has_iter = FALSE;
 			parent_path = gtk_tree_path_new ();
-			files = model->details->files;
 		} else {
 			has_iter = TRUE;
-			nautilus_list_model_ptr_to_iter (model, parent_file_entry->ptr, &iter);
+			nautilus_list_model_entry_to_iter (model, parent_file_entry, &iter);
 			parent_path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
-			files = parent_file_entry->files;
 		}
 
-		length = g_sequence_get_length (files);
+		length = row_array_get_length (files);
 		new_order = g_new (int, length);
 		/* Note: new_order[newpos] = oldpos */
 		for (i = 0, old = 0; i < length; ++i) {
@@ -954,7 +1583,7 @@ nautilus_list_model_file_changed (NautilusListModel *model, NautilusFile *file,
 		g_free (new_order);
 	}
 	
-	nautilus_list_model_ptr_to_iter (model, ptr, &iter);
+	nautilus_list_model_entry_to_iter (model, file_entry, &iter);
 	path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
 	gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
 	gtk_tree_path_free (path);
@@ -963,24 +1592,22 @@ nautilus_list_model_file_changed (NautilusListModel *model, NautilusFile *file,
 gboolean
 nautilus_list_model_is_empty (NautilusListModel *model)
 {
-	return (g_sequence_get_length (model->details->files) == 0);
+	return (row_array_get_length (model->details->files) == 0);
 }
 
 static void
 nautilus_list_model_remove (NautilusListModel *model, GtkTreeIter *iter)
 {
-	GSequenceIter *ptr, *child_ptr;
 	FileEntry *file_entry, *child_file_entry, *parent_file_entry;
+	RowArray *files;
 	GtkTreePath *path;
 	GtkTreeIter parent_iter;
 
-	ptr = iter->user_data;
-	file_entry = g_sequence_get (ptr);
+	file_entry = iter->user_data;
 	
 	if (file_entry->files != NULL) {
-		while (g_sequence_get_length (file_entry->files) > 0) {
-			child_ptr = g_sequence_get_begin_iter (file_entry->files);
-			child_file_entry = g_sequence_get (child_ptr);
+		while (row_array_get_length (file_entry->files) > 0) {
+			child_file_entry = row_array_get_nth (file_entry->files, 0);
 			if (child_file_entry->file != NULL) {
 				nautilus_list_model_remove_file (model,
 							   child_file_entry->file,
@@ -989,7 +1616,7 @@ nautilus_list_model_remove (NautilusListModel *model, GtkTreeIter *iter)
 				path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), iter);
 				gtk_tree_path_append_index (path, 0);
 				model->details->stamp++;
-				g_sequence_remove (child_ptr);
+				row_array_remove (file_entry->files, child_file_entry);
 				gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
 				gtk_tree_path_free (path);
 			}
@@ -1009,7 +1636,7 @@ nautilus_list_model_remove (NautilusListModel *model, GtkTreeIter *iter)
 	}
 
 	parent_file_entry = file_entry->parent;
-	if (parent_file_entry && g_sequence_get_length (parent_file_entry->files) == 1 &&
+	if (parent_file_entry && row_array_get_length (parent_file_entry->files) == 1 &&
 	    file_entry->file != NULL) {
 		/* this is the last non-dummy child, add a dummy node */
 		/* We need to do this before removing the last file to avoid
@@ -1028,15 +1655,15 @@ nautilus_list_model_remove (NautilusListModel *model, GtkTreeIter *iter)
 	
 	path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), iter);
 	
-	g_sequence_remove (ptr);
+	files = parent_file_entry != NULL ? parent_file_entry->files : model->details->files;
+	row_array_remove (files, file_entry);
 	model->details->stamp++;
 	gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
 	
 	gtk_tree_path_free (path);
 
-	if (parent_file_entry && g_sequence_get_length (parent_file_entry->files) == 0) {
-		parent_iter.stamp = model->details->stamp;
-		parent_iter.user_data = parent_file_entry->ptr;
+	if (parent_file_entry && row_array_get_length (parent_file_entry->files) == 0) {
+		nautilus_list_model_entry_to_iter (model, parent_file_entry, &parent_iter);
 		path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &parent_iter);
 		gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
 						      path, &parent_iter);
@@ -1056,20 +1683,18 @@ nautilus_list_model_remove_file (NautilusListModel *model, NautilusFile *file,
 }
 
 static void
-nautilus_list_model_clear_directory (NautilusListModel *model, GSequence *files)
+nautilus_list_model_clear_directory (NautilusListModel *model, RowArray *files)
 {
 	GtkTreeIter iter;
 	FileEntry *file_entry;
 
-	while (g_sequence_get_length (files) > 0) {
-		iter.user_data = g_sequence_get_begin_iter (files);
-
-		file_entry = g_sequence_get (iter.user_data);
+	while (row_array_get_length (files) > 0) {
+		file_entry = row_array_get_nth (files, 0);
 		if (file_entry->files != NULL) {
 			nautilus_list_model_clear_directory (model, file_entry->files);
 		}
 		
-		iter.stamp = model->details->stamp;
+		nautilus_list_model_entry_to_iter (model, file_entry, &iter);
 		nautilus_list_model_remove (model, &iter);
 	}
 }
@@ -1110,7 +1735,7 @@ nautilus_list_model_load_subdirectory (NautilusListModel *model, GtkTreePath *pa
 		return FALSE;
 	}
 
-	file_entry = g_sequence_get (iter.user_data);
+	file_entry = iter.user_data;
 	if (file_entry->file == NULL ||
 	    file_entry->subdirectory != NULL) {
 		return FALSE;
@@ -1127,7 +1752,7 @@ nautilus_list_model_load_subdirectory (NautilusListModel *model, GtkTreePath *pa
 	
 	file_entry->subdirectory = subdirectory,
 	g_hash_table_insert (model->details->directory_reverse_map,
-			     subdirectory, file_entry->ptr);
+			     subdirectory, file_entry);
 	file_entry->reverse_map = g_hash_table_new (g_direct_hash, g_direct_equal);
 
 	/* Return a ref too */
@@ -1141,11 +1766,10 @@ nautilus_list_model_load_subdirectory (NautilusListModel *model, GtkTreePath *pa
 void
 nautilus_list_model_unload_subdirectory (NautilusListModel *model, GtkTreeIter *iter)
 {
-	GSequenceIter *child_ptr;
 	FileEntry *file_entry, *child_file_entry;
 	GtkTreeIter child_iter;
 
-	file_entry = g_sequence_get (iter->user_data);
+	file_entry = iter->user_data;
 	if (file_entry->file == NULL ||
 	    file_entry->subdirectory == NULL) {
 		return;
@@ -1154,14 +1778,13 @@ nautilus_list_model_unload_subdirectory (NautilusListModel *model, GtkTreeIter *
 	file_entry->loaded = 0;
 	
 	/* Remove all children */
-	while (g_sequence_get_length (file_entry->files) > 0) {
-		child_ptr = g_sequence_get_begin_iter (file_entry->files);
-		child_file_entry = g_sequence_get (child_ptr);
+	while (row_array_get_length (file_entry->files) > 0) {
+		child_file_entry = row_array_get_nth (file_entry->files, 0);
 		if (child_file_entry->file == NULL) {
 			/* Don't delete the dummy node */
 			break;
 		} else {
-			nautilus_list_model_ptr_to_iter (model, child_ptr, &child_iter);
+			nautilus_list_model_entry_to_iter (model, child_file_entry, &child_iter);
 			nautilus_list_model_remove (model, &child_iter);
 		}
 	}
@@ -1353,7 +1976,7 @@ nautilus_list_model_dispose (GObject *object)
 	}
 
 	if (model->details->files) {
-		g_sequence_free (model->details->files);
+		row_array_free (model->details->files);
 		model->details->files = NULL;
 	}
 	
@@ -1390,12 +2013,18 @@ static void
 nautilus_list_model_init (NautilusListModel *model)
 {
 	model->details = g_new0 (NautilusListModelDetails, 1);
-	model->details->files = g_sequence_new ((GDestroyNotify)file_entry_free);
+	model->details->files = row_array_new ();
 	model->details->top_reverse_map = g_hash_table_new (g_direct_hash, g_direct_equal);
 	model->details->directory_reverse_map = g_hash_table_new (g_direct_hash, g_direct_equal);
 	model->details->stamp = g_random_int ();
 	model->details->sort_attribute = 0;
 	model->details->columns = g_ptr_array_new ();
+	g_queue_init (&model->details->row_cache_lru);
+
+	g_signal_connect_object (nautilus_signaller_get_current (),
+				 "date-format-changed",
+				 G_CALLBACK (date_format_changed_callback),
+				 model, G_CONNECT_SWAPPED);
 }
 
 static void
@@ -1461,34 +2090,30 @@ nautilus_list_model_subdirectory_done_loading (NautilusListModel *model, Nautilu
 	GtkTreeIter iter;
 	GtkTreePath *path;
 	FileEntry *file_entry, *dummy_entry;
-	GSequenceIter *parent_ptr, *dummy_ptr;
-	GSequence *files;
+	RowArray *files;
 	
 	if (model == NULL || model->details->directory_reverse_map == NULL) {
 		return;
 	}
-	parent_ptr = g_hash_table_lookup (model->details->directory_reverse_map,
+	file_entry = g_hash_table_lookup (model->details->directory_reverse_map,
 					  directory);
-	if (parent_ptr == NULL) {
+	if (file_entry == NULL) {
 		return;
 	}
 	
-	file_entry = g_sequence_get (parent_ptr);
 	files = file_entry->files;
 
 	/* Only swap loading -> empty if we saw no files yet at "done",
 	 * otherwise, toggle loading at first added file to the model.
 	 */
 	if (!nautilus_directory_is_not_empty (directory) &&
-	    g_sequence_get_length (files) == 1) {
-		dummy_ptr = g_sequence_get_iter_at_pos (file_entry->files, 0);
-		dummy_entry = g_sequence_get (dummy_ptr);
+	    row_array_get_length (files) == 1) {
+		dummy_entry = row_array_get_nth (files, 0);
 		if (dummy_entry->file == NULL) {
 			/* was the dummy file */
 			file_entry->loaded = 1;
 			
-			iter.stamp = model->details->stamp;
-			iter.user_data = dummy_ptr;
+			nautilus_list_model_entry_to_iter (model, dummy_entry, &iter);
 			
 			path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
 			gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
@@ -1511,6 +2136,9 @@ refresh_row (gpointer data,
 
 	iters = nautilus_list_model_get_all_iters_for_file (model, file);
 	for (l = iters; l != NULL; l = l->next) {
+		/* the highlight is drawn into the cached icon */
+		file_entry_clear_cache (((GtkTreeIter *) l->data)->user_data);
+
 		path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), l->data);
 		gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, l->data);
 
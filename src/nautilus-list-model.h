@@ -71,6 +71,9 @@ GType    nautilus_list_model_get_type                          (void);
 gboolean nautilus_list_model_add_file                          (NautilusListModel          *model,
 								NautilusFile         *file,
 								NautilusDirectory    *directory);
+void     nautilus_list_model_add_files                         (NautilusListModel          *model,
+								GList                *files,
+								NautilusDirectory    *directory);
 void     nautilus_list_model_file_changed                      (NautilusListModel          *model,
 								NautilusFile         *file,
 								NautilusDirectory    *directory);
@@ -116,6 +119,8 @@ GtkTreeView *     nautilus_list_model_get_drag_view (NautilusListModel *model,
 
 GtkTargetList *   nautilus_list_model_get_drag_target_list (void);
 
+void              nautilus_list_model_prepare_for_sort (NautilusListModel *model,
+							NautilusFile *file);
 int               nautilus_list_model_compare_func (NautilusListModel *model,
 						    NautilusFile *file1,
 						    NautilusFile *file2);
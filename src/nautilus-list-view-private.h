@@ -65,6 +65,12 @@ struct NautilusListViewDetails {
 
   GQuark last_sort_attr;
 
+  /* Files added between begin_file_changes and end_file_changes,
+   * by directory, waiting to go into the model in one batch. */
+  gboolean batching_file_changes;
+  GHashTable *pending_added_files;
+  guint n_pending_added_files;
+
   GIcon *icon;
 };
 
@@ -90,6 +90,7 @@ static void   nautilus_list_view_set_zoom_level                  (NautilusListVi
 								  NautilusListZoomLevel    new_level);
 static void   nautilus_list_view_scroll_to_file                  (NautilusListView        *view,
 								  NautilusFile      *file);
+static void   nautilus_list_view_flush_added_files               (NautilusListView        *list_view);
 
 static void   apply_columns_settings                             (NautilusListView *list_view,
                                                                   char **column_order,
@@ -921,6 +922,7 @@ nautilus_list_view_reveal_selection (NautilusFilesView *view)
 		GtkTreePath *path;
 		
 		list_view = NAUTILUS_LIST_VIEW (view);
+		nautilus_list_view_flush_added_files (list_view);
 		file = selection->data;
 		if (nautilus_list_model_get_first_iter_for_file (list_view->details->model, file, &iter)) {
 			path = gtk_tree_model_get_path (GTK_TREE_MODEL (list_view->details->model), &iter);
@@ -1823,13 +1825,64 @@ create_and_set_up_tree_view (NautilusListView *view)
 	g_strfreev (default_column_order);
 }
 
+/* When at least this many files arrive in one batch for an empty view,
+ * the tree view is detached from the model while they are added, so it
+ * does not have to handle each row insertion on its own.
+ */
+#define ADD_FILES_DETACH_THRESHOLD 1000
+
+static void
+nautilus_list_view_flush_added_files (NautilusListView *list_view)
+{
+	GHashTableIter iter;
+	NautilusDirectory *directory;
+	GList *files;
+	gboolean detach;
+
+	if (list_view->details->n_pending_added_files == 0) {
+		return;
+	}
+
+	detach = list_view->details->n_pending_added_files >= ADD_FILES_DETACH_THRESHOLD &&
+		nautilus_list_model_is_empty (list_view->details->model);
+	if (detach) {
+		gtk_tree_view_set_model (list_view->details->tree_view, NULL);
+	}
+
+	g_hash_table_iter_init (&iter, list_view->details->pending_added_files);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &directory, (gpointer *) &files)) {
+		files = g_list_reverse (files);
+		nautilus_list_model_add_files (list_view->details->model, files, directory);
+		nautilus_file_list_free (files);
+	}
+	g_hash_table_remove_all (list_view->details->pending_added_files);
+	list_view->details->n_pending_added_files = 0;
+
+	if (detach) {
+		gtk_tree_view_set_model (list_view->details->tree_view,
+					 GTK_TREE_MODEL (list_view->details->model));
+	}
+}
+
 static void
 nautilus_list_view_add_file (NautilusFilesView *view, NautilusFile *file, NautilusDirectory *directory)
 {
-	NautilusListModel *model;
+	NautilusListView *list_view;
+	GList *files;
+
+	list_view = NAUTILUS_LIST_VIEW (view);
 
-	model = NAUTILUS_LIST_VIEW (view)->details->model;
-	nautilus_list_model_add_file (model, file, directory);
+	if (!list_view->details->batching_file_changes) {
+		nautilus_list_model_add_file (list_view->details->model, file, directory);
+		return;
+	}
+
+	/* Held back until end_file_changes, or until something needs
+	 * to find the rows in the model. */
+	files = g_hash_table_lookup (list_view->details->pending_added_files, directory);
+	files = g_list_prepend (files, nautilus_file_ref (file));
+	g_hash_table_insert (list_view->details->pending_added_files, directory, files);
+	list_view->details->n_pending_added_files++;
 }
 
 static char **
@@ -2057,6 +2110,7 @@ nautilus_list_view_clear (NautilusFilesView *view)
 	list_view = NAUTILUS_LIST_VIEW (view);
 
 	if (list_view->details->model != NULL) {
+		nautilus_list_view_flush_added_files (list_view);
 		nautilus_list_model_clear (list_view->details->model);
 	}
 }
@@ -2068,6 +2122,7 @@ nautilus_list_view_file_changed (NautilusFilesView *view, NautilusFile *file, Na
 
 	listview = NAUTILUS_LIST_VIEW (view);
 	
+	nautilus_list_view_flush_added_files (listview);
 	nautilus_list_model_file_changed (listview->details->model, file, directory);
 }
 
@@ -2308,6 +2363,12 @@ nautilus_list_view_is_empty (NautilusFilesView *view)
 	return nautilus_list_model_is_empty (NAUTILUS_LIST_VIEW (view)->details->model);
 }
 
+static void
+nautilus_list_view_begin_file_changes (NautilusFilesView *view)
+{
+	NAUTILUS_LIST_VIEW (view)->details->batching_file_changes = TRUE;
+}
+
 static void
 nautilus_list_view_end_file_changes (NautilusFilesView *view)
 {
@@ -2315,6 +2376,9 @@ nautilus_list_view_end_file_changes (NautilusFilesView *view)
 
 	list_view = NAUTILUS_LIST_VIEW (view);
 
+	nautilus_list_view_flush_added_files (list_view);
+	list_view->details->batching_file_changes = FALSE;
+
 	if (list_view->details->new_selection_path) {
 		gtk_tree_view_set_cursor (list_view->details->tree_view,
 					  list_view->details->new_selection_path,
@@ -2340,6 +2404,8 @@ nautilus_list_view_remove_file (NautilusFilesView *view, NautilusFile *file, Nau
 	row_reference = NULL;
 	list_view = NAUTILUS_LIST_VIEW (view);
 	tree_model = GTK_TREE_MODEL(list_view->details->model);
+
+	nautilus_list_view_flush_added_files (list_view);
 	
 	if (nautilus_list_model_get_tree_iter_from_file (list_view->details->model, file, directory, &iter)) {
 		selection = gtk_tree_view_get_selection (list_view->details->tree_view);
@@ -2395,6 +2461,8 @@ nautilus_list_view_set_selection (NautilusFilesView *view, GList *selection)
 	list_view = NAUTILUS_LIST_VIEW (view);
 	tree_selection = gtk_tree_view_get_selection (list_view->details->tree_view);
 
+	nautilus_list_view_flush_added_files (list_view);
+
 	g_signal_handlers_block_by_func (tree_selection, list_selection_changed_callback, view);
 
 	gtk_tree_selection_unselect_all (tree_selection);
@@ -2877,6 +2945,15 @@ nautilus_list_view_compare_files (NautilusFilesView *view, NautilusFile *file1,
 	return nautilus_list_model_compare_func (list_view->details->model, file1, file2);
 }
 
+static void
+nautilus_list_view_prepare_for_sort (NautilusFilesView *view, NautilusFile *file)
+{
+	NautilusListView *list_view;
+
+	list_view = NAUTILUS_LIST_VIEW (view);
+	nautilus_list_model_prepare_for_sort (list_view->details->model, file);
+}
+
 static gboolean
 nautilus_list_view_using_manual_layout (NautilusFilesView *view)
 {
@@ -2885,6 +2962,12 @@ nautilus_list_view_using_manual_layout (NautilusFilesView *view)
 	return FALSE;
 }
 
+static void
+free_pending_added_files (gpointer key, gpointer value, gpointer user_data)
+{
+	nautilus_file_list_free (value);
+}
+
 static void
 nautilus_list_view_dispose (GObject *object)
 {
@@ -2892,6 +2975,13 @@ nautilus_list_view_dispose (GObject *object)
 
 	list_view = NAUTILUS_LIST_VIEW (object);
 
+	if (list_view->details->pending_added_files != NULL) {
+		g_hash_table_foreach (list_view->details->pending_added_files,
+				      free_pending_added_files, NULL);
+		g_hash_table_destroy (list_view->details->pending_added_files);
+		list_view->details->pending_added_files = NULL;
+	}
+
 	if (list_view->details->model) {
 		g_object_unref (list_view->details->model);
 		list_view->details->model = NULL;
@@ -3148,7 +3238,9 @@ nautilus_list_view_class_init (NautilusListViewClass *class)
 	nautilus_files_view_class->set_selection = nautilus_list_view_set_selection;
 	nautilus_files_view_class->invert_selection = nautilus_list_view_invert_selection;
 	nautilus_files_view_class->compare_files = nautilus_list_view_compare_files;
+	nautilus_files_view_class->prepare_for_sort = nautilus_list_view_prepare_for_sort;
 	nautilus_files_view_class->sort_directories_first_changed = nautilus_list_view_sort_directories_first_changed;
+	nautilus_files_view_class->begin_file_changes = nautilus_list_view_begin_file_changes;
 	nautilus_files_view_class->end_file_changes = nautilus_list_view_end_file_changes;
 	nautilus_files_view_class->using_manual_layout = nautilus_list_view_using_manual_layout;
 	nautilus_files_view_class->get_view_id = nautilus_list_view_get_id;
@@ -3163,6 +3255,7 @@ nautilus_list_view_init (NautilusListView *list_view)
 {
 	GActionGroup *view_action_group;
 	list_view->details = g_new0 (NautilusListViewDetails, 1);
+	list_view->details->pending_added_files = g_hash_table_new (NULL, NULL);
 
         list_view->details->icon = g_themed_icon_new ("view-list-symbolic");
 